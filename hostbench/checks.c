@@ -0,0 +1,355 @@
+// Correctness checks for the klib code hostbench builds, run before the
+// benchmarks. Formatting and string functions are compared against the
+// host libc, utf8_decode against known-good and malformed input, and the
+// clocksource mult/shift math against exact arithmetic; the run fails if
+// any check does.
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <klib/printf.h>
+#include <klib/string.h>
+#include <time/clocksource.h>
+#include "hostbench.h"
+
+// the cases below deliberately combine flags that C says to ignore,
+// truncate output and pass NULL to %s
+#pragma GCC diagnostic ignored "-Wformat"
+#pragma GCC diagnostic ignored "-Wformat-overflow"
+#pragma GCC diagnostic ignored "-Wformat-truncation"
+
+static size_t checks;
+static size_t failures;
+
+#define CHECK(cond, ...)                                                    \
+    do {                                                                    \
+        checks++;                                                           \
+        if (!(cond)) {                                                      \
+            failures++;                                                     \
+            fprintf(stderr, "check failed (%s:%d): ", __FILE__, __LINE__);  \
+            fprintf(stderr, __VA_ARGS__);                                   \
+            fputc('\n', stderr);                                            \
+        }                                                                   \
+    } while (0)
+
+// formats with both kvsnprintf and the host vsnprintf and compares
+// the text and the return value
+static void check_format(const char *fmt, ...) {
+    char want[256], got[256];
+    va_list ap, ap2;
+
+    va_start(ap, fmt);
+    va_copy(ap2, ap);
+    int n_want = vsnprintf(want, sizeof(want), fmt, ap);
+    int n_got = kvsnprintf(got, sizeof(got), fmt, ap2);
+    va_end(ap2);
+    va_end(ap);
+
+    CHECK(n_got == n_want && !strcmp(got, want), "\"%s\": got \"%s\" (%d), want \"%s\" (%d)",
+          fmt, got, n_got, want, n_want);
+}
+
+static void check_printf(void) {
+    check_format("plain text");
+    check_format("%%");
+    check_format("a%%b%%c");
+
+    // %d / %i and every flag
+    check_format("%d %d %d %d %d", 0, 1, -1, INT_MAX, INT_MIN);
+    check_format("%i %i", 42, -42);
+    check_format("[%5d] [%-5d] [%05d] [%+d] [% d] [%+05d] [%-+5d] [% 5d]", 42, 42, 42, 42, 42, 42, 42, 42);
+    check_format("[%5d] [%-5d] [%05d] [%+d] [% d]", -42, -42, -42, -42, -42);
+    check_format("[%+d] [% d] [%+ d]", 0, 0, 0);
+    check_format("[%1d] [%2d]", 12345, -12345);
+
+    // integer precision
+    check_format("[%.5d] [%.5d] [%8.3d] [%-8.3d] [%08.3d] [%+.3d]", 42, -42, 42, 42, 42, 7);
+    check_format("[%.0d] [%+.0d] [% .0d] [%5.0d] [%-3.0d]", 0, 0, 0, 0, 0);
+    check_format("[%.0d] [%.1d] [%.2d]", 1, 0, 0);
+    check_format("[%.3u] [%.0u] [%.6x] [%.0x] [%8.4X] [%-8.4x] [%08.4x]", 5u, 0u, 0xabu, 0u, 0xabu, 0xabu, 0xabu);
+    check_format("[%.*d] [%.*d] [%*.*d]", 4, 3, -1, 3, 6, 2, 1);
+    check_format("[%.20lu] [%.20ld]", UINT64_MAX, INT64_MIN);
+
+    // unsigned and length modifiers
+    check_format("%u %u %u", 0u, 1u, UINT_MAX);
+    check_format("%lu %ld %ld", UINT64_MAX, INT64_MIN, INT64_MAX);
+    check_format("%llu %lld %zu", 1234567890123ULL, -1234567890123LL, (size_t)SIZE_MAX);
+    check_format("%hd %hu %hhd %hhu", 70000, 70000, 300, 300);
+    check_format("%hd %hhd %hx %hhx %hhX", -32769, -129, 0x12345u, 0x1ffu, 0x1abu);
+    check_format("[%+u] [% u] [%5u] [%-5u] [%05u]", 7u, 7u, 7u, 7u, 7u);
+
+    // hex
+    check_format("%x %X %x %X", 0u, 0u, 0xdeadbeefu, 0xdeadbeefu);
+    check_format("%lx %lX %llx", UINT64_MAX, 0x0123456789abcdefUL, 0x10ULL);
+    check_format("[%8x] [%-8x] [%08x] [%08X]", 0xbeefu, 0xbeefu, 0xbeefu, 0xbeefu);
+
+    // strings and characters
+    check_format("%s|%s|%s", "abc", "", "a longer string with spaces");
+    check_format("[%5s] [%-5s] [%.2s] [%5.1s] [%-5.1s] [%.0s] [%.10s]", "abc", "abc", "abc", "abc", "abc",
+                 "abc", "abc");
+    check_format("[%.*s] [%.*s] [%*s] [%*s]", 2, "abcdef", -1, "abcdef", 6, "ab", -6, "ab");
+    check_format("[%c] [%3c] [%-3c] [%c%c]", 'x', 'y', 'z', 'o', 'k');
+    check_format("[%*d] [%*d] [%-*d]", 5, 1, -5, 1, 5, 1);
+
+    // the parts the kernel defines differently from libc
+    char buf[64];
+    int n = ksnprintf(buf, sizeof(buf), "%p", (void *)(uintptr_t)0xdeadbeef);
+    CHECK(n == 18 && !strcmp(buf, "0x00000000deadbeef"), "%%p: got \"%s\"", buf);
+    n = ksnprintf(buf, sizeof(buf), "[%20p] [%-20p]", (void *)0, (void *)0);
+    CHECK(!strcmp(buf, "[  0x0000000000000000] [0x0000000000000000  ]"), "%%20p: got \"%s\"", buf);
+    n = ksnprintf(buf, sizeof(buf), "%s", (const char *)NULL);
+    CHECK(!strcmp(buf, "(null)"), "%%s NULL: got \"%s\"", buf);
+
+    // truncation keeps the full length as return value and terminates
+    static const char *const text = "hello, world";
+    for (size_t size = 1; size <= 16; size++) {
+        char got[16], want[16];
+        memset(got, '#', sizeof(got));
+        memset(want, '#', sizeof(want));
+        int n_got = ksnprintf(got, size, "%s", text);
+        int n_want = snprintf(want, size, "%s", text);
+        CHECK(n_got == n_want && !memcmp(got, want, sizeof(got)), "truncated to %zu: got \"%.*s\" (%d)",
+              size, (int)sizeof(got), got, n_got);
+    }
+    for (size_t size = 1; size <= 8; size++) {
+        char got[8], want[8];
+        memset(got, '#', sizeof(got));
+        memset(want, '#', sizeof(want));
+        int n_got = ksnprintf(got, size, "[%5d|%-4x]", -12, 0xabu);
+        int n_want = snprintf(want, size, "[%5d|%-4x]", -12, 0xabu);
+        CHECK(n_got == n_want && !memcmp(got, want, sizeof(got)), "numbers truncated to %zu", size);
+    }
+
+    // size 0 writes nothing, not even the terminator
+    memset(buf, '#', sizeof(buf));
+    n = ksnprintf(buf, 0, "%d-%s", 1234, "abc");
+    CHECK(n == 8 && buf[0] == '#', "size 0: returned %d, buf[0] = 0x%02x", n, (unsigned char)buf[0]);
+    n = ksnprintf(NULL, 0, "%lu", UINT64_MAX);
+    CHECK(n == 20, "size 0, NULL buffer: returned %d", n);
+}
+
+// two pages, the second inaccessible: anything ending at the end of the
+// first page shows whether a word-at-a-time loop reads too far
+static char *guarded_page(void) {
+    long page = sysconf(_SC_PAGESIZE);
+    char *p = mmap(NULL, 2 * (size_t)page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) return NULL;
+    mprotect(p + page, (size_t)page, PROT_NONE);
+    return p;
+}
+
+static void check_strlen(char *page, size_t page_size) {
+    char buf[160];
+
+    // every start alignment, with non-zero bytes after the terminator
+    for (size_t align = 0; align < 16; align++) {
+        for (size_t len = 0; len <= 80; len++) {
+            memset(buf, 'x', sizeof(buf));
+            char *s = buf + align;
+            s[len] = '\0';
+            CHECK(kstrlen(s) == strlen(s), "strlen align %zu len %zu: got %zu", align, len, kstrlen(s));
+        }
+    }
+
+    // terminator on the last byte before the guard page, every alignment
+    char *end = page + page_size;
+    for (size_t len = 0; len <= 80; len++) {
+        char *s = end - 1 - len;
+        memset(s, 'y', len);
+        s[len] = '\0';
+        CHECK(kstrlen(s) == len, "strlen at page end, len %zu: got %zu", len, kstrlen(s));
+    }
+
+    // and at the start of a page, where the aligned loop begins at once
+    memset(page, 'z', 40);
+    page[37] = '\0';
+    CHECK(kstrlen(page) == 37, "strlen at page start: got %zu", kstrlen(page));
+    CHECK(kstrlen(NULL) == 0, "strlen(NULL): got %zu", kstrlen(NULL));
+}
+
+static void check_memchr(char *page, size_t page_size) {
+    unsigned char buf[160];
+
+    for (size_t i = 0; i < sizeof(buf); i++) buf[i] = (unsigned char)(i * 7 + 1);
+
+    for (size_t align = 0; align < 16; align++) {
+        for (size_t n = 0; n <= 80; n++) {
+            const unsigned char *s = buf + align;
+            // each byte in range, the byte right after it, and high-bit bytes
+            for (size_t at = 0; at <= n; at++) {
+                int c = s[at];
+                CHECK(kmemchr(s, c, n) == memchr(s, c, n), "memchr align %zu n %zu byte at %zu", align, n, at);
+            }
+            CHECK(kmemchr(s, 0x100 | s[0], n) == memchr(s, 0x100 | s[0], n),
+                  "memchr align %zu n %zu: c above 0xFF", align, n);
+            CHECK(kmemchr(s, 0xEE, n) == memchr(s, 0xEE, n), "memchr align %zu n %zu: 0xEE", align, n);
+        }
+    }
+
+    // ranges that end exactly at the guard page
+    char *end = page + page_size;
+    for (size_t n = 0; n <= 80; n++) {
+        char *s = end - n;
+        memset(s, 'a', n);
+        CHECK(kmemchr(s, 'b', n) == NULL, "memchr at page end, n %zu: found a byte that is not there", n);
+        if (n) {
+            s[n - 1] = 'b';
+            CHECK(kmemchr(s, 'b', n) == s + n - 1, "memchr at page end, n %zu: missed the last byte", n);
+        }
+    }
+}
+
+// decodes one sequence and checks both the code point and how far it moved
+static void check_utf8_one(const char *s, size_t n, uint32_t want, size_t want_len) {
+    const char *pos = s;
+    uint32_t cp = utf8_decode(&pos, s + n);
+    CHECK(cp == want && (size_t)(pos - s) == want_len,
+          "utf8 %02x...(%zu bytes): got U+%04x after %td bytes, want U+%04x after %zu", (unsigned char)s[0], n,
+          cp, pos - s, want, want_len);
+}
+
+#define UTF8_OK(str, cp) check_utf8_one(str, sizeof(str) - 1, cp, sizeof(str) - 1)
+#define UTF8_BAD(str) check_utf8_one(str, sizeof(str) - 1, UTF8_INVALID, 1)
+
+static void check_utf8(void) {
+    // valid sequences at each length and at the edges of each range
+    UTF8_OK("\x00", 0x00);
+    UTF8_OK("A", 0x41);
+    UTF8_OK("\x7f", 0x7F);
+    UTF8_OK("\xc2\x80", 0x80);
+    UTF8_OK("\xc3\xa9", 0xE9);
+    UTF8_OK("\xdf\xbf", 0x7FF);
+    UTF8_OK("\xe0\xa0\x80", 0x800);
+    UTF8_OK("\xe2\x82\xac", 0x20AC);
+    UTF8_OK("\xed\x9f\xbf", 0xD7FF);
+    UTF8_OK("\xee\x80\x80", 0xE000);
+    UTF8_OK("\xef\xbf\xbd", 0xFFFD);
+    UTF8_OK("\xef\xbf\xbf", 0xFFFF);
+    UTF8_OK("\xf0\x90\x80\x80", 0x10000);
+    UTF8_OK("\xf0\x9f\x98\x80", 0x1F600);
+    UTF8_OK("\xf4\x8f\xbf\xbf", 0x10FFFF);
+
+    // overlong encodings
+    UTF8_BAD("\xc0\x80");
+    UTF8_BAD("\xc1\xbf");
+    UTF8_BAD("\xe0\x80\x80");
+    UTF8_BAD("\xe0\x9f\xbf");
+    UTF8_BAD("\xf0\x80\x80\x80");
+    UTF8_BAD("\xf0\x8f\xbf\xbf");
+
+    // UTF-16 surrogates U+D800..U+DFFF
+    UTF8_BAD("\xed\xa0\x80");
+    UTF8_BAD("\xed\xad\xbf");
+    UTF8_BAD("\xed\xb0\x80");
+    UTF8_BAD("\xed\xbf\xbf");
+
+    // above U+10FFFF, and lead bytes that can only start such values
+    UTF8_BAD("\xf4\x90\x80\x80");
+    UTF8_BAD("\xf7\xbf\xbf\xbf");
+    UTF8_BAD("\xf8\x88\x80\x80\x80");
+    UTF8_BAD("\xfc\x84\x80\x80\x80\x80");
+    UTF8_BAD("\xfe");
+    UTF8_BAD("\xff");
+
+    // stray continuation bytes
+    UTF8_BAD("\x80");
+    UTF8_BAD("\xbf");
+    UTF8_BAD("\x80\x80");
+
+    // truncated sequences: cut by the end pointer, and by a non-continuation byte
+    UTF8_BAD("\xc3");
+    UTF8_BAD("\xe2\x82");
+    UTF8_BAD("\xf0\x9f\x98");
+    UTF8_BAD("\xc3" "A");
+    UTF8_BAD("\xe2\x82" "A");
+    UTF8_BAD("\xf0\x9f\x98" "A");
+    check_utf8_one("\xe2\x82\xac", 2, UTF8_INVALID, 1);
+
+    // a whole string: each bad byte becomes one UTF8_INVALID and decoding resyncs
+    static const char mixed[] = "a\xc3\xa9\x80\xe2\x82" "z\xf0\x9f\x98\x80";
+    static const uint32_t want[] = {'a', 0xE9, UTF8_INVALID, UTF8_INVALID, UTF8_INVALID, 'z', 0x1F600};
+    const char *pos = mixed, *end = mixed + sizeof(mixed) - 1;
+    size_t i = 0;
+    while (pos < end && i < sizeof(want) / sizeof(want[0])) {
+        uint32_t cp = utf8_decode(&pos, end);
+        CHECK(cp == want[i], "utf8 string, code point %zu: got U+%04x, want U+%04x", i, cp, want[i]);
+        i++;
+    }
+    CHECK(pos == end && i == sizeof(want) / sizeof(want[0]), "utf8 string: stopped after %zu code points", i);
+}
+
+// one counter as clocksource_init() would register it: the longest delta
+// cyc2ns ever sees is the mask for narrow counters (refreshed at half the
+// wrap), and the whole uptime for 64-bit ones, which are never refreshed
+struct clock_case {
+    const char *name;
+    uint64_t freq_hz;
+    uint64_t max_delta;
+};
+
+#define UPTIME_YEARS(hz, years) ((uint64_t)(hz) * 3600 * 24 * 365 * (years))
+
+static void check_cyc2ns(const struct clock_case *c, uint32_t mult, uint32_t shift, uint64_t delta) {
+    uint64_t got = clocksource_cyc2ns(delta, mult, shift);
+    uint64_t exact = (uint64_t)((unsigned __int128)delta * 1000000000 / c->freq_hz);
+    uint64_t err = got > exact ? got - exact : exact - got;
+    // 1 ppm, or a nanosecond of rounding while that is less
+    CHECK(err <= 1 || (unsigned __int128)err * 1000000 <= exact,
+          "%s: delta %lu gives %lu ns, exact %lu ns (mult %u, shift %u)", c->name, delta, got, exact, mult, shift);
+}
+
+static void check_clocksource(void) {
+    static const struct clock_case cases[] = {
+        { "tsc 1 GHz",              1000000000,  UPTIME_YEARS(1000000000, 100) },
+        { "tsc 2.4 GHz",            2400000000,  UPTIME_YEARS(2400000000, 100) },
+        { "tsc 3.7 GHz",            3700000000,  UPTIME_YEARS(3700000000, 100) },
+        { "tsc 5 GHz",              5000000000,  UPTIME_YEARS(5000000000, 100) },
+        { "hpet 14.318 MHz",        14318180,    UINT32_MAX },
+        { "hpet 14.318 MHz 64-bit", 14318180,    UPTIME_YEARS(14318180, 100) },
+        { "hpet 100 MHz",           100000000,   UINT32_MAX },
+        { "hpet 100 MHz 64-bit",    100000000,   UPTIME_YEARS(100000000, 100) },
+        { "pmtimer 24-bit",         3579545,     0xFFFFFF },
+        { "pmtimer 32-bit",         3579545,     UINT32_MAX },
+    };
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        const struct clock_case *c = &cases[i];
+        uint32_t mult, shift;
+        clocksource_calc_mult_shift(c->freq_hz, &mult, &shift);
+
+        // the product and the result must both fit: delta * mult in 128 bits,
+        // its shifted value in the 64 bits cyc2ns returns
+        unsigned __int128 product = (unsigned __int128)c->max_delta * mult;
+        CHECK(product / mult == c->max_delta && (product >> shift) >> 64 == 0,
+              "%s: cyc2ns overflows at delta %lu (mult %u, shift %u)", c->name, c->max_delta, mult, shift);
+
+        // deltas from a tick to the whole window, against the exact value
+        for (uint64_t delta = 1; delta < c->max_delta / 3; delta = delta * 3 + 1)
+            check_cyc2ns(c, mult, shift, delta);
+        check_cyc2ns(c, mult, shift, c->max_delta / 2);
+        check_cyc2ns(c, mult, shift, c->max_delta);
+    }
+}
+
+size_t hostbench_checks(void) {
+    long page_size = sysconf(_SC_PAGESIZE);
+    char *page = guarded_page();
+
+    check_printf();
+    check_utf8();
+    check_clocksource();
+    if (page) {
+        check_strlen(page, (size_t)page_size);
+        check_memchr(page, (size_t)page_size);
+        munmap(page, 2 * (size_t)page_size);
+    } else {
+        fprintf(stderr, "hostbench: no guard page, skipping strlen / memchr checks\n");
+    }
+
+    printf("checks: %zu run, %zu failed\n", checks, failures);
+    return failures;
+}
@@ -0,0 +1,258 @@
+// Host-side microbenchmarks for the PMM, VMM page-table code and klib,
+// after the klib correctness checks in checks.c.
+// The kernel sources are compiled unchanged against shim.c, so numbers here
+// track the real allocator logic without booting a VM.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <mm/pmm.h>
+#include <mm/vmm.h>
+#include <arch/x86_64/cpu.h>
+#include "hostbench.h"
+
+#define ARENA_MIB_DEFAULT 256
+#define BENCH_VIRT_BASE   0xFFFF900000000000ULL
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void report(const char *name, size_t ops, uint64_t ns) {
+    printf("  %-44s %10zu ops %10.1f ns/op\n", name, ops, ops ? (double)ns / (double)ops : 0.0);
+}
+
+static void report_bw(const char *name, size_t ops, size_t bytes, uint64_t ns) {
+    double per_op = ops ? (double)ns / (double)ops : 0.0;
+    double gbps = ns ? (double)bytes * (double)ops / (double)ns : 0.0;
+    printf("  %-44s %10zu ops %10.1f ns/op %8.2f GB/s\n", name, ops, per_op, gbps);
+}
+
+static void bench_pmm_single(size_t iters) {
+    uint64_t t0 = now_ns();
+    for (size_t i = 0; i < iters; i++) {
+        void *p = pmm_alloc();
+        pmm_free(p);
+    }
+    report("pmm_alloc + pmm_free (1 frame)", iters, now_ns() - t0);
+}
+
+static void bench_pmm_frames(size_t iters, size_t count) {
+    char name[64];
+    snprintf(name, sizeof(name), "pmm_alloc_frames + free (%zu frames)", count);
+
+    uint64_t t0 = now_ns();
+    for (size_t i = 0; i < iters; i++) {
+        void *p = pmm_alloc_frames(count);
+        pmm_free_frames(p, count);
+    }
+    report(name, iters, now_ns() - t0);
+}
+
+static void bench_pmm_aligned(size_t iters, size_t count, size_t alignment) {
+    char name[64];
+    snprintf(name, sizeof(name), "pmm_alloc_frames_aligned (%zu, %zu KiB)", count, alignment / 1024);
+
+    uint64_t t0 = now_ns();
+    for (size_t i = 0; i < iters; i++) {
+        void *p = pmm_alloc_frames_aligned(count, alignment);
+        pmm_free_frames(p, count);
+    }
+    report(name, iters, now_ns() - t0);
+}
+
+static void bench_pmm_batch(size_t batch) {
+    void **pages = malloc(batch * sizeof(void *));
+
+    uint64_t t0 = now_ns();
+    for (size_t i = 0; i < batch; i++) {
+        pages[i] = pmm_alloc();
+    }
+    uint64_t t1 = now_ns();
+    for (size_t i = 0; i < batch; i++) {
+        pmm_free(pages[i]);
+    }
+    uint64_t t2 = now_ns();
+
+    report("pmm_alloc batch (fill)", batch, t1 - t0);
+    report("pmm_free batch (drain)", batch, t2 - t1);
+    free(pages);
+}
+
+// Take every free frame, return every other one, then ask for runs that only
+// exist past the fragmented region: the worst case for a next-fit bitmap scan.
+static void bench_pmm_fragmented(size_t iters) {
+    size_t total = pmm_get_free_frames();
+    void **pages = malloc(total * sizeof(void *));
+    size_t got = 0;
+
+    while (got < total && (pages[got] = pmm_alloc()) != NULL) {
+        got++;
+    }
+
+    for (size_t i = 0; i < got; i += 2) {
+        pmm_free(pages[i]);
+    }
+    // one contiguous tail so multi-frame requests can succeed
+    size_t tail_start = (got > 64 ? got - 64 : 0) | 1;
+    for (size_t i = tail_start; i < got; i += 2) {
+        pmm_free(pages[i]);
+    }
+
+    uint64_t t0 = now_ns();
+    for (size_t i = 0; i < iters; i++) {
+        void *p = pmm_alloc();
+        pmm_free(p);
+    }
+    report("fragmented: pmm_alloc + free (1 frame)", iters, now_ns() - t0);
+
+    t0 = now_ns();
+    for (size_t i = 0; i < iters; i++) {
+        void *p = pmm_alloc_frames(4);
+        if (p) pmm_free_frames(p, 4);
+    }
+    report("fragmented: pmm_alloc_frames + free (4)", iters, now_ns() - t0);
+
+    for (size_t i = 1; i < tail_start && i < got; i += 2) {
+        pmm_free(pages[i]);
+    }
+    free(pages);
+}
+
+static void bench_vmm_range(size_t pages, size_t rounds) {
+    char name[64];
+    uint64_t phys = 0x40000000ULL;
+    uint64_t map_ns = 0, unmap_ns = 0, walk_ns = 0;
+    uint64_t sink = 0;
+
+    for (size_t r = 0; r < rounds; r++) {
+        uint64_t t0 = now_ns();
+        if (!vmm_map_range(BENCH_VIRT_BASE, phys, pages, PTE_KERNEL_RW)) {
+            fprintf(stderr, "hostbench: vmm_map_range failed\n");
+            exit(1);
+        }
+        uint64_t t1 = now_ns();
+        for (size_t i = 0; i < pages; i++) {
+            sink += vmm_get_physical(BENCH_VIRT_BASE + i * PAGE_SIZE);
+        }
+        uint64_t t2 = now_ns();
+        vmm_unmap_range(BENCH_VIRT_BASE, pages);
+        uint64_t t3 = now_ns();
+
+        map_ns += t1 - t0;
+        walk_ns += t2 - t1;
+        unmap_ns += t3 - t2;
+    }
+
+    if (sink == 0) {
+        fprintf(stderr, "hostbench: vmm_get_physical returned nothing\n");
+    }
+
+    snprintf(name, sizeof(name), "vmm_map_range (%zu MiB, per page)", (size_t)(pages * PAGE_SIZE >> 20));
+    report(name, pages * rounds, map_ns);
+    snprintf(name, sizeof(name), "vmm_get_physical (%zu MiB, per page)", (size_t)(pages * PAGE_SIZE >> 20));
+    report(name, pages * rounds, walk_ns);
+    snprintf(name, sizeof(name), "vmm_unmap_range (%zu MiB, per page)", (size_t)(pages * PAGE_SIZE >> 20));
+    report(name, pages * rounds, unmap_ns);
+}
+
+static void bench_memcpy(size_t bytes, size_t iters) {
+    char name[64];
+    uint8_t *src = malloc(bytes + 64);
+    uint8_t *dst = malloc(bytes + 64);
+    memset(src, 0x5A, bytes + 64);
+
+    snprintf(name, sizeof(name), "memcpy %zu B", bytes);
+    uint64_t t0 = now_ns();
+    for (size_t i = 0; i < iters; i++) {
+        kmemcpy(dst, src, bytes);
+        asm volatile("" : : "r"(dst) : "memory");
+    }
+    report_bw(name, iters, bytes, now_ns() - t0);
+
+    snprintf(name, sizeof(name), "memset %zu B", bytes);
+    t0 = now_ns();
+    for (size_t i = 0; i < iters; i++) {
+        kmemset(dst, (int)i, bytes);
+        asm volatile("" : : "r"(dst) : "memory");
+    }
+    report_bw(name, iters, bytes, now_ns() - t0);
+
+    snprintf(name, sizeof(name), "memmove %zu B (overlap)", bytes);
+    t0 = now_ns();
+    for (size_t i = 0; i < iters; i++) {
+        kmemmove(dst + 1, dst, bytes);
+        asm volatile("" : : "r"(dst) : "memory");
+    }
+    report_bw(name, iters, bytes, now_ns() - t0);
+
+    free(src);
+    free(dst);
+}
+
+static void bench_strlen(size_t bytes, size_t iters) {
+    char name[64];
+    char *s = malloc(bytes + 1);
+    memset(s, 'a', bytes);
+    s[bytes] = '\0';
+
+    size_t sink = 0;
+    snprintf(name, sizeof(name), "strlen %zu B", bytes);
+    uint64_t t0 = now_ns();
+    for (size_t i = 0; i < iters; i++) {
+        sink += kstrlen(s);
+        asm volatile("" : : "r"(s) : "memory");
+    }
+    report_bw(name, iters, bytes, now_ns() - t0);
+
+    if (sink != bytes * iters) {
+        fprintf(stderr, "hostbench: strlen mismatch\n");
+    }
+    free(s);
+}
+
+int main(int argc, char **argv) {
+    size_t arena_mib = ARENA_MIB_DEFAULT;
+    if (argc > 1) {
+        arena_mib = strtoul(argv[1], NULL, 0);
+        if (arena_mib < 64) arena_mib = 64;
+    }
+
+    if (hostbench_checks()) return 1;
+
+    shim_init(arena_mib * 1024 * 1024);
+    pmm_init();
+
+    hostbench_cr3 = (uint64_t)(uintptr_t)pmm_alloc_zeroed();
+    vmm_init();
+
+    printf("hostbench: arena %zu MiB, %zu usable frames, %zu free\n",
+           arena_mib, pmm_get_usable_frames(), pmm_get_free_frames());
+
+    printf("pmm\n");
+    bench_pmm_single(1000000);
+    bench_pmm_frames(200000, 8);
+    bench_pmm_frames(20000, 512);
+    bench_pmm_aligned(100000, 16, 64 * 1024);
+    bench_pmm_batch(16384);
+    bench_pmm_fragmented(2000);
+
+    printf("vmm\n");
+    bench_vmm_range(512, 200);
+    bench_vmm_range(16384, 10);
+
+    printf("klib\n");
+    bench_memcpy(64, 2000000);
+    bench_memcpy(4096, 100000);
+    bench_memcpy(65536, 10000);
+    bench_memcpy(1 << 20, 500);
+    bench_strlen(16, 5000000);
+    bench_strlen(4096, 100000);
+
+    printf("hostbench: %zu free frames at exit, %zu bytes of serial output\n",
+           pmm_get_free_frames(), shim_serial_bytes());
+    return 0;
+}
@@ -0,0 +1,24 @@
+#ifndef HOSTBENCH_H
+#define HOSTBENCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// kernel klib is built with its symbols renamed (see HOSTBENCH_RENAME in the
+// Makefile) so it can coexist with the host libc
+void *kmemcpy(void *restrict dest, const void *restrict src, size_t n);
+void *kmemset(void *s, int c, size_t n);
+void *kmemmove(void *dest, const void *src, size_t n);
+size_t kstrlen(const char *s);
+void *kmemchr(const void *s, int c, size_t n);
+
+// checks.c: klib correctness against the host libc, returns the failures
+size_t hostbench_checks(void);
+
+// shim.c
+void shim_init(size_t arena_bytes);
+void *shim_arena(void);
+size_t shim_arena_size(void);
+size_t shim_serial_bytes(void);
+
+#endif
@@ -0,0 +1,106 @@
+// Host stand-ins for what the kernel gets from Limine and the drivers:
+// a synthetic memory map, an HHDM pointing at a malloc'd arena, a serial
+// port and klog that only count bytes, and tracepoints that stay off.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <limine.h>
+#include <klib/printf.h>
+#include <log/klog.h>
+#include <log/trace.h>
+#include "hostbench.h"
+
+struct limine_hhdm_request hhdm_request;
+struct limine_memmap_request memmap_request;
+
+uint64_t hostbench_cr3;
+
+static struct limine_hhdm_response hhdm_response;
+static struct limine_memmap_response memmap_response;
+
+#define MAX_ENTRIES 8
+static struct limine_memmap_entry entries[MAX_ENTRIES];
+static struct limine_memmap_entry *entry_ptrs[MAX_ENTRIES];
+
+static void *arena;
+static size_t arena_size;
+static size_t serial_bytes;
+
+void serial_putc(char c) {
+    (void)c;
+    serial_bytes++;
+}
+
+void serial_puts(const char *s) {
+    serial_bytes += strlen(s);
+}
+
+// klog without sinks: format like the kernel does, then only count the bytes
+int klog_level = KLOG_INFO;
+
+void klog_write(int level, const char *tag, uint32_t color, const char *fmt, ...) {
+    char buf[KPRINTF_BUF_SIZE];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = kvsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    (void)level; (void)tag; (void)color;
+    if (n > 0) serial_bytes += (size_t)n;
+}
+
+// tracepoints stay off on the host
+struct static_key trace_keys[TRACE_EVENT_COUNT];
+
+void trace_record(uint16_t event, uint64_t arg0, uint64_t arg1) {
+    (void)event; (void)arg0; (void)arg1;
+}
+
+static void add_entry(uint64_t base, uint64_t length, uint64_t type) {
+    size_t i = memmap_response.entry_count++;
+    entries[i].base = base;
+    entries[i].length = length;
+    entries[i].type = type;
+    entry_ptrs[i] = &entries[i];
+}
+
+// Shaped like a small PC: low memory with a legacy hole, firmware and
+// bootloader regions below 1 MiB + 16 MiB, then one large usable range.
+void shim_init(size_t bytes) {
+    arena_size = bytes;
+    arena = aligned_alloc(4096, arena_size);
+    if (!arena) {
+        fprintf(stderr, "hostbench: cannot allocate %zu byte arena\n", arena_size);
+        exit(1);
+    }
+
+    const uint64_t MiB = 1024 * 1024;
+
+    memmap_response.entry_count = 0;
+    memmap_response.entries = entry_ptrs;
+    add_entry(0x0,          0x9F000,               LIMINE_MEMMAP_USABLE);
+    add_entry(0x9F000,      0x100000 - 0x9F000,    LIMINE_MEMMAP_RESERVED);
+    add_entry(1 * MiB,      7 * MiB,               LIMINE_MEMMAP_USABLE);
+    add_entry(8 * MiB,      4 * MiB,               LIMINE_MEMMAP_EXECUTABLE_AND_MODULES);
+    add_entry(12 * MiB,     2 * MiB,               LIMINE_MEMMAP_BOOTLOADER_RECLAIMABLE);
+    add_entry(14 * MiB,     1 * MiB,               LIMINE_MEMMAP_ACPI_RECLAIMABLE);
+    add_entry(15 * MiB,     1 * MiB,               LIMINE_MEMMAP_ACPI_NVS);
+    add_entry(16 * MiB,     arena_size - 16 * MiB, LIMINE_MEMMAP_USABLE);
+
+    memmap_request.response = &memmap_response;
+
+    hhdm_response.offset = (uint64_t)(uintptr_t)arena;
+    hhdm_request.response = &hhdm_response;
+}
+
+void *shim_arena(void) {
+    return arena;
+}
+
+size_t shim_arena_size(void) {
+    return arena_size;
+}
+
+size_t shim_serial_bytes(void) {
+    return serial_bytes;
+}
@@ -0,0 +1,41 @@
+#ifndef ESTELLA_ARCH_X86_64_CPU_H
+#define ESTELLA_ARCH_X86_64_CPU_H
+
+// hostbench replacement for kernel/arch/x86_64/cpu.h: found first on the
+// include path, so the kernel sources under test never touch privileged state
+
+#include <stdint.h>
+
+#define CR0_WP (1ULL << 16)
+
+#define RFLAGS_IF (1ULL << 9)
+
+static inline uint64_t rdtsc(void) {
+    uint32_t low, high;
+    asm volatile("rdtsc" : "=a"(low), "=d"(high));
+    return ((uint64_t)high << 32) | low;
+}
+
+// page table root handed to vmm_init(), set up by the harness
+extern uint64_t hostbench_cr3;
+
+static inline uint64_t read_cr3(void) {
+    return hostbench_cr3;
+}
+
+static inline void invlpg(uint64_t addr) {
+    (void)addr;
+}
+
+static inline uint64_t irq_save(void) {
+    return 0;
+}
+
+static inline void irq_restore(uint64_t flags) {
+    (void)flags;
+}
+
+static inline void sync_core(void) {
+}
+
+#endif
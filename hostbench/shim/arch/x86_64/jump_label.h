@@ -0,0 +1,21 @@
+#ifndef ESTELLA_ARCH_X86_64_JUMP_LABEL_H
+#define ESTELLA_ARCH_X86_64_JUMP_LABEL_H
+
+// hostbench replacement for kernel/arch/x86_64/jump_label.h: nothing patches
+// host text, so a static key is an ordinary flag test
+
+#include <stdbool.h>
+
+struct static_key {
+    bool enabled;
+};
+
+static inline bool static_key_false(struct static_key *key) {
+    return __builtin_expect(key->enabled, 0);
+}
+
+static inline bool static_key_enabled(const struct static_key *key) {
+    return key->enabled;
+}
+
+#endif
@@ -42,4 +42,11 @@ struct hpet *acpi_get_hpet(void *rsdp_ptr) {
     if (!xsdt) return NULL;
 
     return (struct hpet *)acpi_find_table(xsdt, "HPET");
+}
+
+struct fadt *acpi_get_fadt(void *rsdp_ptr) {
+    struct xsdt *xsdt = acpi_get_xsdt(rsdp_ptr);
+    if (!xsdt) return NULL;
+
+    return (struct fadt *)acpi_find_table(xsdt, "FACP");
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #ifndef ESTELLA_ARCH_X86_64_ACPI_H
 #define ESTELLA_ARCH_X86_64_ACPI_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 struct rsdp2 {
@@ -122,7 +123,11 @@ struct madt_x2apic_nmi {
 #define IA32_X2APIC_TIMER_DCR       0x83E
 #define IA32_X2APIC_SELF_IPI        0x83F
 
-struct hpet_address {
+// Generic Address Structure
+#define ACPI_GAS_MEMORY     0
+#define ACPI_GAS_IO         1
+
+struct acpi_gas {
     uint8_t address_space_id;
     uint8_t register_bit_width;
     uint8_t register_bit_offset;
@@ -133,7 +138,7 @@ struct hpet_address {
 struct hpet {
     struct acpi_sdt_header header;
     uint32_t event_timer_block_id;
-    struct hpet_address base_address;
+    struct acpi_gas base_address;
     uint8_t hpet_number;
     uint16_t minimum_clock_tick;
     uint8_t page_protection_oem_attribute;
@@ -144,13 +149,94 @@ struct hpet {
 #define HPET_ISR            0x020
 #define HPET_MAIN_COUNTER   0x0F0
 
+#define HPET_CAP_COUNT_64   (1ULL << 13)
+
 #define HPET_CFG_ENABLE     (1ULL << 0)
 #define HPET_CFG_LEGACY     (1ULL << 1)
 
+// comparator n
+#define HPET_TIMER_CONFIG(n)        (0x100 + 0x20 * (n))
+#define HPET_TIMER_COMPARATOR(n)    (0x108 + 0x20 * (n))
+
+#define HPET_TN_LEVEL           (1ULL << 1)
+#define HPET_TN_ENABLE          (1ULL << 2)
+#define HPET_TN_PERIODIC        (1ULL << 3)
+#define HPET_TN_PERIODIC_CAP    (1ULL << 4)
+#define HPET_TN_64BIT_CAP       (1ULL << 5)
+#define HPET_TN_SETVAL          (1ULL << 6)
+#define HPET_TN_32BIT           (1ULL << 8)
+#define HPET_TN_ROUTE_SHIFT     9
+#define HPET_TN_ROUTE_MASK      (0x1FULL << HPET_TN_ROUTE_SHIFT)
+#define HPET_TN_ROUTE_CAP(cfg)  ((uint32_t)((cfg) >> 32))   // bit n: IOAPIC input n allowed
+
+struct fadt {
+    struct acpi_sdt_header header;
+    uint32_t firmware_ctrl;
+    uint32_t dsdt;
+    uint8_t  reserved0;
+    uint8_t  preferred_pm_profile;
+    uint16_t sci_int;
+    uint32_t smi_cmd;
+    uint8_t  acpi_enable;
+    uint8_t  acpi_disable;
+    uint8_t  s4bios_req;
+    uint8_t  pstate_cnt;
+    uint32_t pm1a_evt_blk;
+    uint32_t pm1b_evt_blk;
+    uint32_t pm1a_cnt_blk;
+    uint32_t pm1b_cnt_blk;
+    uint32_t pm2_cnt_blk;
+    uint32_t pm_tmr_blk;
+    uint32_t gpe0_blk;
+    uint32_t gpe1_blk;
+    uint8_t  pm1_evt_len;
+    uint8_t  pm1_cnt_len;
+    uint8_t  pm2_cnt_len;
+    uint8_t  pm_tmr_len;
+    uint8_t  gpe0_blk_len;
+    uint8_t  gpe1_blk_len;
+    uint8_t  gpe1_base;
+    uint8_t  cst_cnt;
+    uint16_t p_lvl2_lat;
+    uint16_t p_lvl3_lat;
+    uint16_t flush_size;
+    uint16_t flush_stride;
+    uint8_t  duty_offset;
+    uint8_t  duty_width;
+    uint8_t  day_alrm;
+    uint8_t  mon_alrm;
+    uint8_t  century;
+    uint16_t iapc_boot_arch;
+    uint8_t  reserved1;
+    uint32_t flags;
+    struct acpi_gas reset_reg;
+    uint8_t  reset_value;
+    uint16_t arm_boot_arch;
+    uint8_t  minor_version;
+    // ACPI 2.0+; check header.length before using anything from here on
+    uint64_t x_firmware_ctrl;
+    uint64_t x_dsdt;
+    struct acpi_gas x_pm1a_evt_blk;
+    struct acpi_gas x_pm1b_evt_blk;
+    struct acpi_gas x_pm1a_cnt_blk;
+    struct acpi_gas x_pm1b_cnt_blk;
+    struct acpi_gas x_pm2_cnt_blk;
+    struct acpi_gas x_pm_tmr_blk;
+    struct acpi_gas x_gpe0_blk;
+    struct acpi_gas x_gpe1_blk;
+} __attribute__((packed));
+
+#define FADT_TMR_VAL_EXT    (1U << 8)   // PM timer is 32 bits wide, not 24
+
+// whether the FADT is long enough to hold field
+#define FADT_HAS(fadt, field) \
+    ((fadt)->header.length >= offsetof(struct fadt, field) + sizeof((fadt)->field))
+
 struct xsdt* acpi_get_xsdt(void* rsdp_ptr);
 struct acpi_sdt_header* acpi_find_table(struct xsdt* xsdt, const char* signature);
 struct madt* acpi_get_madt(void* rsdp_ptr);
 struct hpet *acpi_get_hpet(void *rsdp_ptr);
+struct fadt *acpi_get_fadt(void *rsdp_ptr);
 
 extern volatile struct limine_rsdp_request rsdp_request;
 
@@ -0,0 +1,108 @@
+#include <arch/x86_64/alternative.h>
+#include <arch/x86_64/cpu.h>
+#include <klib/memory.h>
+#include <klib/printf.h>
+
+extern struct alt_instr __alt_instructions_start[];
+extern struct alt_instr __alt_instructions_end[];
+
+#define OPCODE_JMP_SHORT 0xEB
+#define OPCODE_JMP_NEAR  0xE9
+#define OPCODE_CALL_NEAR 0xE8
+
+// P6 long NOPs, index = length
+static const uint8_t nops[9][8] = {
+    { 0 },
+    { 0x90 },
+    { 0x66, 0x90 },
+    { 0x0F, 0x1F, 0x00 },
+    { 0x0F, 0x1F, 0x40, 0x00 },
+    { 0x0F, 0x1F, 0x44, 0x00, 0x00 },
+    { 0x66, 0x0F, 0x1F, 0x44, 0x00, 0x00 },
+    { 0x0F, 0x1F, 0x80, 0x00, 0x00, 0x00, 0x00 },
+    { 0x0F, 0x1F, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00 },
+};
+
+static void add_nops(uint8_t *buf, size_t len) {
+    while (len) {
+        size_t n = len > 8 ? 8 : len;
+        memcpy(buf, nops[n], n);
+        buf += n;
+        len -= n;
+    }
+}
+
+void text_poke(void *addr, const void *src, size_t len) {
+    uint64_t flags = irq_save();
+    uint64_t cr0 = read_cr0();
+
+    write_cr0(cr0 & ~CR0_WP);
+    memcpy(addr, src, len);
+    write_cr0(cr0);
+
+    irq_restore(flags);
+}
+
+// A rel32 jmp/call copied out of .altinstr_replacement still encodes its
+// displacement from the replacement address. Rebase it onto the patch site,
+// and turn a jmp that now fits into a 2-byte short jmp.
+static void recompute_branch(uint8_t *buf, size_t *len, uint8_t *site, uint8_t *repl) {
+    if (*len < 5 || (buf[0] != OPCODE_JMP_NEAR && buf[0] != OPCODE_CALL_NEAR)) {
+        return;
+    }
+
+    int32_t disp;
+    memcpy(&disp, buf + 1, sizeof(disp));
+
+    int64_t target = (int64_t)(intptr_t)repl + 5 + disp;
+    int64_t new_disp = target - ((int64_t)(intptr_t)site + 5);
+
+    if (buf[0] == OPCODE_JMP_NEAR && *len == 5) {
+        int64_t short_disp = target - ((int64_t)(intptr_t)site + 2);
+        if (short_disp >= -128 && short_disp <= 127) {
+            buf[0] = OPCODE_JMP_SHORT;
+            buf[1] = (uint8_t)(int8_t)short_disp;
+            *len = 2;
+            return;
+        }
+    }
+
+    disp = (int32_t)new_disp;
+    memcpy(buf + 1, &disp, sizeof(disp));
+}
+
+void apply_alternatives(void) {
+    size_t total = 0;
+    size_t patched = 0;
+    uint8_t buf[256];
+
+    for (struct alt_instr *a = __alt_instructions_start; a < __alt_instructions_end; a++) {
+        uint8_t *site = (uint8_t *)&a->instr_offset + a->instr_offset;
+        uint8_t *repl = (uint8_t *)&a->repl_offset + a->repl_offset;
+        uint16_t feature = a->feature & ~ALT_FLAG_NOT;
+        bool want = (a->feature & ALT_FLAG_NOT) == 0;
+
+        total++;
+
+        if (cpu_has(feature) != want) {
+            continue;
+        }
+
+        if (a->replacementlen > a->instrlen) {
+            kprintf("alternatives: replacement longer than site at %p\n", site);
+            continue;
+        }
+
+        size_t len = a->replacementlen;
+        memcpy(buf, repl, len);
+        recompute_branch(buf, &len, site, repl);
+        add_nops(buf + len, a->instrlen - len);
+
+        text_poke(site, buf, a->instrlen);
+        patched++;
+    }
+
+    sync_core();
+
+    kprintf("alternatives: applied %zu of %zu entries\n", patched, total);
+}
@@ -0,0 +1,76 @@
+#ifndef ESTELLA_ARCH_X86_64_ALTERNATIVE_H
+#define ESTELLA_ARCH_X86_64_ALTERNATIVE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <arch/x86_64/cpufeature.h>
+
+// one patch site, emitted into .altinstructions
+// offsets are relative to the field itself so the table needs no relocations
+struct alt_instr {
+    int32_t instr_offset;   // default instructions in .text
+    int32_t repl_offset;    // replacement in .altinstr_replacement
+    uint16_t feature;       // X86_FEATURE_*, ALT_NOT() inverts the condition
+    uint8_t instrlen;       // length of the site, padded with NOPs
+    uint8_t replacementlen; // must be <= instrlen
+} __attribute__((packed));
+
+#define ALT_FLAG_NOT 0x8000
+#define ALT_NOT(feature) ((feature) | ALT_FLAG_NOT)
+
+#define __ALT_STR(x) #x
+#define ALT_STR(x) __ALT_STR(x)
+
+#define ALT_ENTRY(site, site_end, repl, repl_end, feature)        \
+    ".pushsection .altinstructions, \"a\"\n\t"                      \
+    ".long " site " - .\n\t"                                        \
+    ".long " repl " - .\n\t"                                        \
+    ".word " feature "\n\t"                                         \
+    ".byte " site_end " - " site "\n\t"                             \
+    ".byte " repl_end " - " repl "\n\t"                             \
+    ".popsection\n\t"
+
+// inline asm fragment: runs oldinstr, or newinstr once apply_alternatives()
+// has seen the feature. oldinstr is NOP-padded to the length of newinstr.
+#define ALTERNATIVE(oldinstr, newinstr, feature)                                    \
+    "661:\n\t" oldinstr "\n662:\n\t"                                                \
+    ".skip -(((665f-664f)-(662b-661b)) > 0) * ((665f-664f)-(662b-661b)), 0x90\n"    \
+    "663:\n\t"                                                                      \
+    ALT_ENTRY("661b", "663b", "664f", "665f", ALT_STR(feature))                     \
+    ".pushsection .altinstr_replacement, \"ax\"\n"                                  \
+    "664:\n\t" newinstr "\n665:\n\t"                                                \
+    ".popsection\n\t"
+
+// Branch on a CPU feature with no load or test on the hot path.
+// Until patching, the site is a 5-byte jmp to a cpu_has() check. Afterwards it
+// is either NOPs (feature present, fall through) or a direct jmp to the
+// "absent" path, relocated from .altinstr_replacement and shortened to 2 bytes
+// when in range.
+static inline __attribute__((always_inline)) bool static_cpu_has(uint16_t feature) {
+    asm goto("1: .byte 0xe9\n\t"
+             ".long %l[t_dynamic] - 2f\n\t"
+             "2:\n\t"
+             ALT_ENTRY("1b", "2b", "3f", "3f", "%c[feature]")
+             ALT_ENTRY("1b", "2b", "3f", "4f", "%c[not_feature]")
+             ".pushsection .altinstr_replacement, \"ax\"\n"
+             "3: .byte 0xe9\n\t"
+             ".long %l[t_no] - 4f\n"
+             "4:\n\t"
+             ".popsection\n\t"
+             : : [feature] "i"(feature), [not_feature] "i"(ALT_NOT(feature))
+             : : t_dynamic, t_no);
+    return true;
+t_no:
+    return false;
+t_dynamic:
+    return cpu_has(feature);
+}
+
+void apply_alternatives(void);
+
+// writes into kernel text, which Limine maps read-only
+void text_poke(void *addr, const void *src, size_t len);
+
+#endif
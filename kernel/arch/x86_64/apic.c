@@ -1,3 +1,5 @@
+#define KLOG_TAG "apic"
+
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -6,12 +8,24 @@
 #include <arch/x86_64/acpi.h>
 #include <arch/x86_64/apic.h>
 #include <arch/x86_64/cpuid.h>
+#include <arch/x86_64/cpufeature.h>
+#include <arch/x86_64/alternative.h>
+#include <arch/x86_64/cpu.h>
 #include <arch/x86_64/msr.h>
+#include <arch/x86_64/idle.h>
+#include <arch/x86_64/irq.h>
 #include <mm/vmm.h>
 #include <drivers/serial.h>
+#include <log/klog.h>
+#include <log/trace.h>
+#include <time/hrtimer.h>
+#include <colors.h>
 #include <klib/string.h>
+#include <klib/printf.h>
 #include <arch/x86_64/io.h>
 #include <arch/x86_64/hpet.h>
+#include <arch/x86_64/tsc.h>
+#include <cmdline.h>
 
 void ioapic_init_all(void* madt_ptr);
 
@@ -27,20 +41,55 @@ uint64_t tsc_ticks_per_10ms = 0;
 ioapic_t ioapics[8];
 size_t ioapic_count = 0;
 
-volatile bool lapic_timer_needed = false;
-
-static inline uint64_t rdtsc(void) {
-    uint32_t low, high;
-    asm volatile("rdtsc" : "=a"(low), "=d"(high));
-    return ((uint64_t)high << 32) | low;
-}
+enum timer_mode {
+    TIMER_NONE,
+    TIMER_TSC_DEADLINE,
+    TIMER_LAPIC_ONESHOT,    // count computed from the TSC deadline
+    TIMER_HPET_ONESHOT,     // comparator 0, likewise
+    TIMER_HPET_PERIODIC,
+    TIMER_LAPIC_PERIODIC,   // nothing better could be set up
+};
+
+static enum timer_mode timer_mode = TIMER_NONE;
+static const char *const timer_mode_names[] = {
+    "none", "tsc-deadline", "lapic-oneshot", "hpet-oneshot", "hpet-periodic", "lapic-periodic",
+};
+
+// LAPIC timer / HPET counts per TSC tick, 32.32 fixed point
+static uint64_t lapic_per_tsc_mult = 0;
+static uint64_t hpet_per_tsc_mult = 0;
+// a longer one-shot is cut short and re-armed; keeps delta * mult in 64 bits
+#define ONESHOT_MAX_TSC (1ULL << 31)
+
+#define NS_PER_SEC 1000000000ULL
+
+#define LAPIC_TIMER_DCR_DIV16   0b0011
+#define LAPIC_TIMER_DIV         16
+// how far the CPUID 0x15 crystal may be from the measured timer rate
+#define LAPIC_CRYSTAL_AGREE_PPM 10000
+
+// LAPIC timer counts per second at LAPIC_TIMER_DIV, 0 if it does not count
+static uint64_t lapic_timer_hz = 0;
+static const char *lapic_timer_source = "none";
+// an HPET comparator was set up by hpet_timer_init()
+static bool hpet_usable = false;
+// interrupt period of the periodic timers, 0 in the one-shot modes
+static uint64_t timer_period_ns = 0;
+
+// deadline writes timed per one-shot candidate when picking the timer
+#define TIMER_COST_SAMPLES 32
+
+// jiffies are derived from the TSC, not counted, so ticks that never
+// fired still add up
+static uint64_t tick_base_tsc = 0;
+static uint64_t timer_interrupts = 0;
 
 uint64_t timer_get_tsc(void) {
     return rdtsc();
 }
 
 static inline uint32_t lapic_read(uint32_t reg) {
-    if (x2apic_enabled) {
+    if (static_cpu_has(X86_FEATURE_X2APIC)) {
         uint32_t msr = 0x800 + (reg >> 4);
         return (uint32_t)rdmsr(msr);
     } else {
@@ -50,7 +99,7 @@ static inline uint32_t lapic_read(uint32_t reg) {
 }
 
 static inline void lapic_write(uint32_t reg, uint32_t value) {
-    if (x2apic_enabled) {
+    if (static_cpu_has(X86_FEATURE_X2APIC)) {
         uint32_t msr = 0x800 + (reg >> 4);
         wrmsr(msr, value);
     } else {
@@ -63,127 +112,300 @@ void lapic_eoi(void) {
     lapic_write(LAPIC_EOI, 0);
 }
 
-void lapic_timer_handler(void) {
-    lapic_eoi();
+// the LAPIC timer vector and the HPET comparator's both land here; the
+// EOI is irq_dispatch()'s
+static void timer_irq(void *ctx) {
+    lapic_ticks_sync();
+    timer_interrupts++;
+    trace(TRACE_LAPIC_TIMER, lapic_ticks, 0);
 
-    if (!lapic_timer_needed) {
-        return;
-    }
+    hrtimer_interrupt();
+}
+
+uint64_t lapic_ticks_sync(void) {
+    if (timer_mode == TIMER_NONE) return lapic_ticks;
 
-    lapic_ticks++;
-    
-    if (x2apic_enabled) {
-        uint64_t next_deadline = rdtsc() + tsc_ticks_per_10ms;
-        wrmsr(IA32_TSC_DEADLINE, next_deadline);
+    uint64_t ticks = (rdtsc() - tick_base_tsc) / tsc_ticks_per_10ms;
+    // only moves forward; an interrupt may have synced in between
+    uint64_t seen = lapic_ticks;
+    while (ticks > seen && !__atomic_compare_exchange_n(&lapic_ticks, &seen, ticks, false,
+                                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
     }
+    return lapic_ticks;
 }
 
-void apic_init() {
-    void *rsdp_ptr = rsdp_request.response->address;
-    struct madt* madt = acpi_get_madt(rsdp_ptr);
-    if (!madt) {
-        return;
-    }
+static uint64_t oneshot_delta(uint64_t tsc_deadline) {
+    uint64_t now = rdtsc();
+    uint64_t delta = tsc_deadline > now ? tsc_deadline - now : 0;
+    return delta > ONESHOT_MAX_TSC ? ONESHOT_MAX_TSC : delta;
+}
 
-    lapic_phys = madt->lapic_address;
-    lapic_va = lapic_phys + hhdm_offset;
+bool timer_program(uint64_t tsc_deadline) {
+    switch (timer_mode) {
+    case TIMER_TSC_DEADLINE:
+        wrmsr(IA32_TSC_DEADLINE, tsc_deadline);
+        return true;
 
-    vmm_map(lapic_va, lapic_phys, PTE_KERNEL_RW | PTE_PCD | PTE_PWT);
+    case TIMER_LAPIC_ONESHOT: {
+        if (!tsc_deadline) {
+            lapic_write(LAPIC_TIMER_INIT, 0);
+            return true;
+        }
+        uint64_t count = (oneshot_delta(tsc_deadline) * lapic_per_tsc_mult) >> 32;
+        if (count > UINT32_MAX) count = UINT32_MAX;
+        // 0 would stop the timer instead of firing now
+        lapic_write(LAPIC_TIMER_INIT, count ? (uint32_t)count : 1);
+        return true;
+    }
 
-    uint32_t eax, ebx, ecx, edx;
-    cpuid(1, &eax, &ebx, &ecx, &edx);
+    case TIMER_HPET_ONESHOT:
+        if (!tsc_deadline) {
+            hpet_timer_stop();
+            return true;
+        }
+        hpet_timer_oneshot((oneshot_delta(tsc_deadline) * hpet_per_tsc_mult) >> 32);
+        return true;
 
-    bool x2apic_supported = (ecx & (1U << 21)) != 0;
-    bool tsc_deadline_supported = (ecx & (1U << 24)) != 0;
+    default:
+        return false;
+    }
+}
 
-    if (x2apic_supported) {
-        serial_puts("x2APIC supported\n");
+bool timer_running(void) {
+    return timer_mode != TIMER_NONE;
+}
 
-        uint64_t apic_base = rdmsr(IA32_APIC_BASE_MSR);
-        apic_base |= IA32_APIC_BASE_ENABLE | IA32_APIC_BASE_X2APIC;
-        wrmsr(IA32_APIC_BASE_MSR, apic_base);
+bool timer_is_oneshot(void) {
+    return timer_mode == TIMER_TSC_DEADLINE || timer_mode == TIMER_LAPIC_ONESHOT ||
+           timer_mode == TIMER_HPET_ONESHOT;
+}
 
-        x2apic_enabled = true;
-    } else {
-        serial_puts("x2APIC not supported\n");
-        x2apic_enabled = false;
-        return;
-    }
+const char *timer_mode_name(void) {
+    return timer_mode_names[timer_mode];
+}
+
+void timer_get_stats(struct timer_stats *out) {
+    out->jiffies = lapic_ticks_sync();
+    out->interrupts = timer_interrupts;
+    out->elapsed_tsc = rdtsc() - tick_base_tsc;
+    out->period_ns = timer_period_ns;
+    out->lapic_hz = lapic_timer_hz;
+    // a fixed 10 ms tick would have interrupted once per jiffy
+    out->avoided = out->jiffies > out->interrupts ? out->jiffies - out->interrupts : 0;
+}
 
-    bool tsc_invariant = false;
+// Counts LAPIC timer decrements over 10 ms of TSC at the divider in use.
+// Returns counts per second, 0 if the timer did not move.
+static uint64_t lapic_timer_measure(void) {
+    lapic_write(LAPIC_TIMER_DCR, LAPIC_TIMER_DCR_DIV16);
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_MASKED | LAPIC_TIMER_VECTOR);
+    lapic_write(LAPIC_TIMER_INIT, UINT32_MAX);
 
-    cpuid(0x80000000, &eax, &ebx, &ecx, &edx);
-    uint32_t max_ext_leaf = eax;
+    // both counter reads are bracketed by the TSC, the window runs
+    // between the middles of the brackets
+    uint64_t t0 = rdtsc();
+    uint32_t first = lapic_read(LAPIC_TIMER_CURR);
+    uint64_t start = t0 + (rdtsc() - t0) / 2;
 
-    if (max_ext_leaf >= 0x80000007) {
-        cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
-        tsc_invariant = (edx & (1 << 8)) != 0;
+    while (rdtsc() - start < tsc_ticks_per_10ms) {
+        asm("pause");
     }
 
-    if (!tsc_invariant)
-        serial_puts("TSC not invariant\n");
+    uint64_t t1 = rdtsc();
+    uint32_t last = lapic_read(LAPIC_TIMER_CURR);
+    uint64_t end = t1 + (rdtsc() - t1) / 2;
+    lapic_write(LAPIC_TIMER_INIT, 0);
 
-    tsc_frequency_hz = 0;
-    tsc_ticks_per_10ms = 0;
+    if (first == last) return 0;
+    return (uint64_t)(first - last) * tsc_frequency_hz / (end - start);
+}
 
-    cpuid(0, &eax, &ebx, &ecx, &edx);
-    uint32_t max_leaf = eax;
+// LAPIC timer counts per second at divide-by-16. Parts that enumerate the
+// core crystal in CPUID 0x15 clock the timer from it, which is exact. A
+// hypervisor may report a crystal its emulated timer does not run at, so
+// the CPUID value is only taken when the measurement agrees with it.
+static uint64_t lapic_timer_calibrate(void) {
+    uint64_t measured = lapic_timer_measure();
+    uint32_t eax, ebx, ecx, edx;
 
-    if (max_leaf >= 0x15) {
-        cpuid(0x15, &eax, &ebx, &ecx, &edx);
+    lapic_timer_source = "tsc";
+    if (!measured) return 0;
 
-        if (eax && ebx && ecx) {
-            tsc_frequency_hz = ((uint64_t)ecx * ebx) / eax;
+    cpuid(0, &eax, &ebx, &ecx, &edx);
+    if (eax >= 0x15) {
+        cpuid(0x15, &eax, &ebx, &ecx, &edx);
+        uint64_t crystal = ecx / LAPIC_TIMER_DIV;
+        uint64_t diff = crystal > measured ? crystal - measured : measured - crystal;
+        if (crystal && diff * 1000000 / crystal <= LAPIC_CRYSTAL_AGREE_PPM) {
+            lapic_timer_source = "cpuid";
+            return crystal;
         }
     }
+    return measured;
+}
 
-    if (tsc_frequency_hz == 0 && max_leaf >= 0x16) {
-        cpuid(0x16, &eax, &ebx, &ecx, &edx);
+static uint64_t timer_arm_cost(enum timer_mode mode) {
+    timer_mode = mode;
+    // a second out, never reached before the disarm below
+    uint64_t deadline = rdtsc() + tsc_frequency_hz;
 
-        if (eax)
-            tsc_frequency_hz = (uint64_t)eax * 1000000ULL;
+    uint64_t start = rdtsc();
+    for (int i = 0; i < TIMER_COST_SAMPLES; i++) {
+        timer_program(deadline + i);
     }
+    uint64_t cost = (rdtsc() - start) / TIMER_COST_SAMPLES;
 
-    if (tsc_frequency_hz) {
-        tsc_ticks_per_10ms = tsc_frequency_hz / 100;
-        serial_puts("TSC calibrated via CPUID\n");
-    } else {
-        serial_puts("TSC calibration via CPUID failed, trying via HPET\n");
+    timer_program(0);
+    timer_mode = TIMER_NONE;
+    return cost;
+}
 
-        hpet_init(rsdp_request.response->address);
-        if (hpet_frequency_hz == 0) {
-            serial_puts("HPET init failed, no TSC calibration\n");
-            return;
-        }
-        const uint64_t calibration_duration_ns = 100000000ULL;
-        const uint64_t ticks_to_wait = (hpet_frequency_hz * calibration_duration_ns) / 1000000000ULL;
+// Every one-shot candidate is armed a few times with its interrupt masked;
+// the one with the cheapest deadline write wins, since it is paid on every
+// hrtimer change. Periodic timers are the fallback. timer= on the cmdline
+// overrides the choice.
+static enum timer_mode timer_select(bool tsc_deadline_ok, bool hpet_ok) {
+    uint32_t available = lapic_timer_hz ? 1U << TIMER_LAPIC_PERIODIC : 0;
+    uint64_t cost[TIMER_LAPIC_PERIODIC + 1] = { 0 };
+    enum timer_mode best = TIMER_NONE;
+
+    if (tsc_deadline_ok) {
+        lapic_write(LAPIC_LVT_TIMER, LAPIC_MASKED | LAPIC_TIMER_VECTOR | LAPIC_LVT_TIMER_TSC_DEADLINE);
+        cost[TIMER_TSC_DEADLINE] = timer_arm_cost(TIMER_TSC_DEADLINE);
+        available |= 1U << TIMER_TSC_DEADLINE;
+    }
+    if (lapic_timer_hz && lapic_timer_hz < tsc_frequency_hz) {
+        lapic_write(LAPIC_LVT_TIMER, LAPIC_MASKED | LAPIC_TIMER_VECTOR);
+        cost[TIMER_LAPIC_ONESHOT] = timer_arm_cost(TIMER_LAPIC_ONESHOT);
+        available |= 1U << TIMER_LAPIC_ONESHOT;
+    }
+    if (hpet_ok && hpet_frequency_hz < tsc_frequency_hz) {
+        cost[TIMER_HPET_ONESHOT] = timer_arm_cost(TIMER_HPET_ONESHOT);
+        available |= 1U << TIMER_HPET_ONESHOT;
+    }
+    if (hpet_ok && hpet_timer_can_periodic()) available |= 1U << TIMER_HPET_PERIODIC;
 
-        uint64_t hpet_start = hpet_read(HPET_MAIN_COUNTER);
-        uint64_t tsc_start = rdtsc();
+    for (int m = TIMER_TSC_DEADLINE; m <= TIMER_HPET_ONESHOT; m++) {
+        if (!(available & (1U << m))) continue;
+        kprintf("Timer %s: %lu cycles per deadline write\n", timer_mode_names[m], cost[m]);
+        if (best == TIMER_NONE || cost[m] < cost[best]) best = m;
+    }
+    if (best == TIMER_NONE && (available & (1U << TIMER_HPET_PERIODIC))) best = TIMER_HPET_PERIODIC;
+    if (best == TIMER_NONE && (available & (1U << TIMER_LAPIC_PERIODIC))) best = TIMER_LAPIC_PERIODIC;
+
+    char want[16];
+    if (cmdline_get_str("timer", want, sizeof(want))) {
+        int m = TIMER_TSC_DEADLINE;
+        while (m <= TIMER_LAPIC_PERIODIC && strcmp(want, timer_mode_names[m])) m++;
+        if (m <= TIMER_LAPIC_PERIODIC && (available & (1U << m)))
+            best = m;
+        else
+            klog_warn("timer=%s not available, keeping %s", want, timer_mode_names[best]);
+    }
+    return best;
+}
 
-        while (hpet_read(HPET_MAIN_COUNTER) - hpet_start < ticks_to_wait) {
-            asm("pause");
-        }
+// counts of a clock at hz closest to one jiffy
+static uint64_t timer_period_count(uint64_t hz) {
+    return (hz * TIMER_TICK_NS + NS_PER_SEC / 2) / NS_PER_SEC;
+}
 
-        uint64_t tsc_end = rdtsc();
-        uint64_t hpet_end = hpet_read(HPET_MAIN_COUNTER);
+// the timer only fires for the earliest hrtimer; nothing is armed yet
+static void timer_start(enum timer_mode mode) {
+    switch (mode) {
+    case TIMER_TSC_DEADLINE:
+        lapic_write(LAPIC_LVT_TIMER, LAPIC_TIMER_VECTOR | LAPIC_LVT_TIMER_TSC_DEADLINE);
+        wrmsr(IA32_TSC_DEADLINE, 0);
+        break;
+
+    case TIMER_LAPIC_ONESHOT:
+        // divide-by-16 as calibrated
+        lapic_write(LAPIC_LVT_TIMER, LAPIC_TIMER_VECTOR);
+        break;
+
+    case TIMER_HPET_ONESHOT:
+        lapic_write(LAPIC_LVT_TIMER, LAPIC_MASKED | LAPIC_TIMER_VECTOR);
+        hpet_timer_route(timer_irq);
+        break;
+
+    case TIMER_HPET_PERIODIC: {
+        uint64_t period = timer_period_count(hpet_frequency_hz);
+        lapic_write(LAPIC_LVT_TIMER, LAPIC_MASKED | LAPIC_TIMER_VECTOR);
+        hpet_timer_route(timer_irq);
+        hpet_timer_periodic(period);
+        timer_period_ns = period * NS_PER_SEC / hpet_frequency_hz;
+        break;
+    }
 
-        uint64_t hpet_delta = hpet_end - hpet_start;
-        uint64_t tsc_delta = tsc_end - tsc_start;
+    case TIMER_LAPIC_PERIODIC: {
+        uint64_t count = timer_period_count(lapic_timer_hz);
+        if (count > UINT32_MAX) count = UINT32_MAX;
+        lapic_write(LAPIC_TIMER_DCR, LAPIC_TIMER_DCR_DIV16);
+        lapic_write(LAPIC_LVT_TIMER, LAPIC_TIMER_VECTOR | LAPIC_MODE_PERIODIC);
+        lapic_write(LAPIC_TIMER_INIT, (uint32_t)count);
+        timer_period_ns = count * NS_PER_SEC / lapic_timer_hz;
+        break;
+    }
 
-        tsc_frequency_hz = (tsc_delta * hpet_frequency_hz) / hpet_delta;
+    default:
+        serial_puts("No timer could be set up, hrtimers will not fire\n");
+        return;
+    }
 
-        tsc_ticks_per_10ms = tsc_frequency_hz / 100ULL;
+    timer_mode = mode;
+    tick_base_tsc = rdtsc();
+    if (timer_period_ns)
+        kprintf("Using %s timer, %lu ns period\n", timer_mode_names[mode], timer_period_ns);
+    else
+        kprintf("Using %s timer\n", timer_mode_names[mode]);
+}
 
-        serial_puts("TSC calibrated via HPET: ");
-        char buf[32];
-        u64_to_dec(tsc_frequency_hz, buf);
-        serial_puts(buf);
-        serial_puts(" Hz\n");
+void timer_tsc_freq_changed(uint64_t old_hz) {
+    uint64_t flags = irq_save();
+
+    // a measured LAPIC rate is counts per TSC tick times the TSC rate used
+    // for the measurement; only the crystal from CPUID 0x15 is absolute
+    if (old_hz && lapic_timer_hz && !strcmp(lapic_timer_source, "tsc")) {
+        uint64_t old_lapic_hz = lapic_timer_hz;
+        // scaled by the correction alone, so nothing overflows 64 bits
+        int64_t diff = (int64_t)(tsc_frequency_hz - old_hz);
+        lapic_timer_hz += (uint64_t)((int64_t)lapic_timer_hz * diff / (int64_t)old_hz);
+        if (timer_mode == TIMER_LAPIC_PERIODIC)
+            timer_period_ns = timer_period_ns * old_lapic_hz / lapic_timer_hz;
     }
 
+    hpet_per_tsc_mult = hpet_usable ? (hpet_frequency_hz << 32) / tsc_frequency_hz : 0;
+    lapic_per_tsc_mult = lapic_timer_hz ? (lapic_timer_hz << 32) / tsc_frequency_hz : 0;
+    irq_restore(flags);
+}
 
-    bool use_tsc_deadline = tsc_deadline_supported && (tsc_frequency_hz != 0) && tsc_invariant;
+void apic_init() {
+    void *rsdp_ptr = rsdp_request.response->address;
+    struct madt* madt = acpi_get_madt(rsdp_ptr);
+    if (!madt) {
+        return;
+    }
+
+    lapic_phys = madt->lapic_address;
+    lapic_va = lapic_phys + hhdm_offset;
+
+    vmm_map(lapic_va, lapic_phys, PTE_KERNEL_RW | PTE_PCD | PTE_PWT);
+
+    bool x2apic_supported = cpu_has(X86_FEATURE_X2APIC);
+    bool tsc_deadline_supported = cpu_has(X86_FEATURE_TSC_DEADLINE);
+
+    uint64_t apic_base = rdmsr(IA32_APIC_BASE_MSR);
+    if (x2apic_supported) {
+        serial_puts("x2APIC supported\n");
+        apic_base |= IA32_APIC_BASE_ENABLE | IA32_APIC_BASE_X2APIC;
+        x2apic_enabled = true;
+    } else {
+        // lapic_read/lapic_write go through the MMIO window mapped above
+        serial_puts("x2APIC not supported, using xAPIC MMIO\n");
+        apic_base |= IA32_APIC_BASE_ENABLE;
+        x2apic_enabled = false;
+    }
+    wrmsr(IA32_APIC_BASE_MSR, apic_base);
 
     lapic_write(LAPIC_ESR, 0);
     lapic_write(LAPIC_TPR, 0);
@@ -193,28 +415,36 @@ void apic_init() {
     lapic_write(LAPIC_LVT_PERF, LAPIC_MASKED);
     lapic_write(LAPIC_LVT_LINT0, LAPIC_MASKED);
     lapic_write(LAPIC_LVT_LINT1, LAPIC_MASKED);
-    lapic_write(LAPIC_LVT_ERROR, LAPIC_MASKED | LAPIC_ERROR_VECTOR);
+    lapic_write(LAPIC_LVT_ERROR, LAPIC_ERROR_VECTOR);
+    irq_set_handler(LAPIC_TIMER_VECTOR, timer_irq, NULL);
 
-    if (use_tsc_deadline) {
-        serial_puts("Using TSC-deadline timer\n");
+    // device interrupts work from here on, with or without a timer
+    ioapic_init_all(madt);
 
-        lapic_write(LAPIC_LVT_TIMER, LAPIC_TIMER_VECTOR | LAPIC_LVT_TIMER_TSC_DEADLINE);
+    bool tsc_invariant = cpu_has(X86_FEATURE_INVARIANT_TSC);
 
-        wrmsr(IA32_TSC_DEADLINE, 0);
-        wrmsr(IA32_TSC_DEADLINE, rdtsc() + tsc_ticks_per_10ms);
-    } else {
-        serial_puts("Using periodic LAPIC timer\n");
+    if (!tsc_invariant)
+        serial_puts("TSC not invariant\n");
 
-        lapic_write(LAPIC_TIMER_DCR, 0b0011);
-        lapic_write(LAPIC_LVT_TIMER, LAPIC_TIMER_VECTOR | LAPIC_MODE_PERIODIC);
-        lapic_write(LAPIC_TIMER_INIT, 1000000);
+    if (!tsc_calibrate()) {
+        return;
     }
 
-    lapic_write(LAPIC_LVT_ERROR, LAPIC_ERROR_VECTOR);
+    if (!hpet_va) hpet_init(rsdp_ptr);
+    bool hpet_ok = hpet_timer_init();
 
-    ioapic_init_all(madt);
+    lapic_timer_hz = lapic_timer_calibrate();
+    if (lapic_timer_hz) {
+        kprintf("LAPIC timer: %lu Hz (via %s)\n", lapic_timer_hz, lapic_timer_source);
+    }
+
+    hpet_usable = hpet_ok;
+    timer_tsc_freq_changed(0);
+
+    bool use_tsc_deadline = tsc_deadline_supported && (tsc_frequency_hz != 0) && tsc_invariant;
+    timer_start(timer_select(use_tsc_deadline, hpet_ok));
 
-    serial_puts("APIC initialized\n");
+    klog_color(KLOG_INFO, COL_SUCCESS_INIT, "APIC initialized");
 }
 
 static inline void ioapic_write_internal(volatile uint32_t* base, uint32_t reg, uint32_t value) {
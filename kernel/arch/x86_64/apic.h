@@ -79,7 +79,46 @@ void ioapic_set_irq(uint32_t irq, uint8_t vector, bool level_triggered,
 void ioapic_mask_irq(uint32_t irq);
 void ioapic_unmask_irq(uint32_t irq);
 
-extern volatile bool lapic_timer_needed;
+#define TIMER_TICK_NS       10000000ULL     // one lapic_ticks jiffy
+
+struct timer_stats {
+    uint64_t jiffies;           // 10 ms ticks since the timer started
+    uint64_t interrupts;        // timer interrupts actually taken
+    uint64_t avoided;           // ticks a fixed 10 ms timer would have added
+    uint64_t elapsed_tsc;
+    uint64_t period_ns;         // programmed period of a periodic timer, 0 when one-shot
+    uint64_t lapic_hz;          // LAPIC timer rate at divide-by-16, 0 if it does not count
+};
+
+// lapic_ticks counts whole TIMER_TICK_NS periods of the calibrated TSC,
+// whichever timer is interrupting
+static inline uint64_t lapic_ticks_to_ns(uint64_t ticks) {
+    return ticks * TIMER_TICK_NS;
+}
+
+// rounded up, so a timeout in ticks never ends early
+static inline uint64_t ns_to_lapic_ticks(uint64_t ns) {
+    return (ns + TIMER_TICK_NS - 1) / TIMER_TICK_NS;
+}
+
+// The timer is tickless: it only fires for the earliest pending hrtimer
+// and is stopped while none is queued. lapic_ticks is brought up to date
+// from the TSC here, on every timer interrupt and on idle wakeups.
+uint64_t lapic_ticks_sync(void);
+
+// Arms the timer interrupt for an absolute TSC value, 0 disarms. False
+// when only a periodic timer (HPET or LAPIC) works: it keeps running and
+// expiries are noticed on the next tick.
+bool timer_program(uint64_t tsc_deadline);
+bool timer_running(void);
+// true when each expiry gets its own interrupt (TSC-deadline or a one-shot)
+bool timer_is_oneshot(void);
+const char *timer_mode_name(void);
+// recomputes the TSC to LAPIC / HPET count conversions after
+// tsc_frequency_hz changes from old_hz (0 when there was none); a LAPIC
+// rate measured against the TSC is rescaled with it
+void timer_tsc_freq_changed(uint64_t old_hz);
+void timer_get_stats(struct timer_stats *out);
 uint64_t timer_get_tsc(void);
 
 #endif
\ No newline at end of file
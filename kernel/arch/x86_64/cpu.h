@@ -0,0 +1,78 @@
+#ifndef ESTELLA_ARCH_X86_64_CPU_H
+#define ESTELLA_ARCH_X86_64_CPU_H
+
+#include <stdint.h>
+
+#define CR0_WP (1ULL << 16)
+
+#define RFLAGS_IF (1ULL << 9)
+
+static inline uint64_t read_cr0(void) {
+    uint64_t cr0;
+    asm volatile("mov %%cr0, %0" : "=r"(cr0));
+    return cr0;
+}
+
+static inline void write_cr0(uint64_t cr0) {
+    asm volatile("mov %0, %%cr0" : : "r"(cr0) : "memory");
+}
+
+static inline uint64_t rdtsc(void) {
+    uint32_t low, high;
+    asm volatile("rdtsc" : "=a"(low), "=d"(high));
+    return ((uint64_t)high << 32) | low;
+}
+
+// also returns IA32_TSC_AUX, which the kernel loads with the CPU number
+static inline uint64_t rdtscp(uint32_t *aux) {
+    uint32_t low, high;
+    asm volatile("rdtscp" : "=a"(low), "=d"(high), "=c"(*aux));
+    return ((uint64_t)high << 32) | low;
+}
+
+static inline uint64_t read_cr3(void) {
+    uint64_t cr3;
+    asm volatile("mov %%cr3, %0" : "=r"(cr3));
+    return cr3;
+}
+
+static inline void invlpg(uint64_t addr) {
+    asm volatile("invlpg (%0)" ::"r"(addr) : "memory");
+}
+
+// disables interrupts, returns the previous RFLAGS for irq_restore
+static inline uint64_t irq_save(void) {
+    uint64_t flags;
+    asm volatile("pushfq\n\tpop %0\n\tcli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+static inline void irq_restore(uint64_t flags) {
+    if (flags & RFLAGS_IF) {
+        asm volatile("sti" : : : "memory");
+    }
+}
+
+// Arms address monitoring on the cache line holding addr; a store to it
+// ends a following mwait.
+static inline void monitor(const volatile void *addr) {
+    asm volatile("monitor" : : "a"(addr), "c"(0), "d"(0) : "memory");
+}
+
+// sti's one-instruction interrupt shadow covers the hlt/mwait, so an
+// interrupt that is already pending wakes it instead of being taken before
+static inline void sti_hlt(void) {
+    asm volatile("sti\n\thlt" : : : "memory");
+}
+
+static inline void sti_mwait(uint32_t hint, uint32_t ext) {
+    asm volatile("sti\n\tmwait" : : "a"(hint), "c"(ext) : "memory");
+}
+
+// serializing instruction, required after modifying code that may already be prefetched
+static inline void sync_core(void) {
+    uint32_t eax = 0, ebx, ecx = 0, edx;
+    asm volatile("cpuid" : "+a"(eax), "=b"(ebx), "+c"(ecx), "=d"(edx) : : "memory");
+}
+
+#endif
@@ -0,0 +1,39 @@
+#include <arch/x86_64/cpufeature.h>
+#include <arch/x86_64/cpuid.h>
+#include <klib/printf.h>
+
+uint32_t cpu_feature_words[CPUID_WORDS];
+
+void cpu_features_init(void) {
+    uint32_t eax, ebx, ecx, edx;
+
+    cpuid(0, &eax, &ebx, &ecx, &edx);
+    uint32_t max_leaf = eax;
+
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    cpu_feature_words[CPUID_WORD_1_ECX] = ecx;
+    cpu_feature_words[CPUID_WORD_1_EDX] = edx;
+
+    if (max_leaf >= 7) {
+        cpuid(7, &eax, &ebx, &ecx, &edx);
+        cpu_feature_words[CPUID_WORD_7_EBX] = ebx;
+    }
+
+    cpuid(0x80000000, &eax, &ebx, &ecx, &edx);
+    uint32_t max_ext_leaf = eax;
+
+    if (max_ext_leaf >= 0x80000001) {
+        cpuid(0x80000001, &eax, &ebx, &ecx, &edx);
+        cpu_feature_words[CPUID_WORD_80000001_EDX] = edx;
+    }
+
+    if (max_ext_leaf >= 0x80000007) {
+        cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+        cpu_feature_words[CPUID_WORD_80000007_EDX] = edx;
+    }
+
+    kprintf("CPU features: x2apic %d, tsc-deadline %d, invariant tsc %d, monitor %d, erms %d, hypervisor %d\n",
+            cpu_has(X86_FEATURE_X2APIC), cpu_has(X86_FEATURE_TSC_DEADLINE),
+            cpu_has(X86_FEATURE_INVARIANT_TSC), cpu_has(X86_FEATURE_MONITOR),
+            cpu_has(X86_FEATURE_ERMS), cpu_has(X86_FEATURE_HYPERVISOR));
+}
@@ -0,0 +1,36 @@
+#ifndef ESTELLA_ARCH_X86_64_CPUFEATURE_H
+#define ESTELLA_ARCH_X86_64_CPUFEATURE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// feature = word * 32 + bit, words are filled by cpu_features_init()
+#define CPUID_WORD_1_ECX        0   // CPUID.1:ECX
+#define CPUID_WORD_1_EDX        1   // CPUID.1:EDX
+#define CPUID_WORD_7_EBX        2   // CPUID.(EAX=7,ECX=0):EBX
+#define CPUID_WORD_80000001_EDX 3
+#define CPUID_WORD_80000007_EDX 4
+#define CPUID_WORDS             5
+
+// macros rather than an enum so they can be stringified into asm
+#define X86_FEATURE_MONITOR       (0*32 + 3)
+#define X86_FEATURE_X2APIC        (0*32 + 21)
+#define X86_FEATURE_TSC_DEADLINE  (0*32 + 24)
+#define X86_FEATURE_HYPERVISOR    (0*32 + 31)
+#define X86_FEATURE_TSC           (1*32 + 4)
+#define X86_FEATURE_MSR           (1*32 + 5)
+#define X86_FEATURE_APIC          (1*32 + 9)
+#define X86_FEATURE_ERMS          (2*32 + 9)
+#define X86_FEATURE_NX            (3*32 + 20)
+#define X86_FEATURE_RDTSCP        (3*32 + 27)
+#define X86_FEATURE_INVARIANT_TSC (4*32 + 8)
+
+extern uint32_t cpu_feature_words[CPUID_WORDS];
+
+void cpu_features_init(void);
+
+static inline bool cpu_has(uint16_t feature) {
+    return (cpu_feature_words[feature / 32] >> (feature % 32)) & 1;
+}
+
+#endif
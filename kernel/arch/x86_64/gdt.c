@@ -1,5 +1,8 @@
+#define KLOG_TAG "gdt"
+
 #include <arch/x86_64/gdt.h>
-#include <drivers/serial.h>
+#include <log/klog.h>
+#include <colors.h>
 
 #define GDT_ENTRIES 7
 
@@ -95,5 +98,5 @@ void gdt_init(void) {
     uint16_t tss_sel = 0x28;
     asm volatile ("ltr %0" : : "r"(tss_sel) : "memory");
 
-    serial_puts("GDT with TSS initialized\n");
+    klog_color(KLOG_INFO, COL_SUCCESS_INIT, "GDT with TSS initialized");
 }
\ No newline at end of file
@@ -1,12 +1,17 @@
 #include <arch/x86_64/hpet.h>
 #include <arch/x86_64/acpi.h>
+#include <arch/x86_64/apic.h>
 #include <mm/vmm.h>
 #include <drivers/serial.h>
 #include <klib/string.h>
+#include <klib/printf.h>
 
 uint64_t hpet_va = 0;
 uint64_t hpet_frequency_hz = 0;
 
+static uint64_t timer_cfg = 0;      // comparator 0 config as last written
+static uint32_t timer_gsi = 0;
+
 extern uint64_t hhdm_offset;
 
 inline uint64_t hpet_read(uint64_t offset) {
@@ -39,9 +44,81 @@ void hpet_init(void *rsdp_ptr) {
 
     hpet_write(HPET_CONFIG, hpet_read(HPET_CONFIG) | HPET_CFG_ENABLE);
 
-    serial_puts("HPET initialized at freq: ");
-    char buf[32];
-    u64_to_dec(hpet_frequency_hz, buf);
-    serial_puts(buf);
-    serial_puts(" Hz\n");
-}
\ No newline at end of file
+    kprintf("HPET initialized at freq: %lu Hz\n", hpet_frequency_hz);
+}
+
+static bool gsi_on_ioapic(uint32_t gsi) {
+    for (size_t i = 0; i < ioapic_count; i++) {
+        if (gsi >= ioapics[i].gsi_base && gsi <= ioapics[i].gsi_base + ioapics[i].max_redirection)
+            return true;
+    }
+    return false;
+}
+
+bool hpet_timer_init(void) {
+    if (!hpet_frequency_hz) return false;
+
+    uint64_t cfg = hpet_read(HPET_TIMER_CONFIG(0));
+    uint32_t routes = HPET_TN_ROUTE_CAP(cfg);
+
+    // ISA inputs belong to the PIT, keyboard and COM ports
+    uint32_t gsi = 16;
+    while (gsi < 32 && (!(routes & (1U << gsi)) || !gsi_on_ioapic(gsi))) gsi++;
+    if (gsi == 32) {
+        serial_puts("HPET: no IOAPIC route for comparator 0\n");
+        return false;
+    }
+
+    // edge triggered, disabled until armed; a 32-bit comparator wraps the
+    // same way on any counter width
+    timer_cfg = (cfg & ~(HPET_TN_LEVEL | HPET_TN_ENABLE | HPET_TN_PERIODIC | HPET_TN_ROUTE_MASK))
+                | HPET_TN_32BIT | ((uint64_t)gsi << HPET_TN_ROUTE_SHIFT);
+    hpet_write(HPET_TIMER_CONFIG(0), timer_cfg);
+
+    timer_gsi = gsi;
+    return true;
+}
+
+void hpet_timer_route(irq_handler_t handler) {
+    request_irq(timer_gsi, handler, NULL);
+}
+
+bool hpet_timer_can_periodic(void) {
+    return timer_cfg & HPET_TN_PERIODIC_CAP;
+}
+
+void hpet_timer_oneshot(uint64_t delta) {
+    if (delta < HPET_MIN_DELTA) delta = HPET_MIN_DELTA;
+    if (delta > INT32_MAX) delta = INT32_MAX;
+
+    if (!(timer_cfg & HPET_TN_ENABLE)) {
+        timer_cfg |= HPET_TN_ENABLE;
+        hpet_write(HPET_TIMER_CONFIG(0), timer_cfg);
+    }
+
+    for (;;) {
+        uint32_t cmp = (uint32_t)hpet_read(HPET_MAIN_COUNTER) + (uint32_t)delta;
+        hpet_write(HPET_TIMER_COMPARATOR(0), cmp);
+        // the comparator only fires on an exact match; once the counter is
+        // past it the interrupt would be a whole wrap away
+        if ((int32_t)(cmp - (uint32_t)hpet_read(HPET_MAIN_COUNTER)) > 0) return;
+        delta *= 2;
+    }
+}
+
+void hpet_timer_periodic(uint64_t period) {
+    if (period > UINT32_MAX) period = UINT32_MAX;
+
+    timer_cfg |= HPET_TN_ENABLE | HPET_TN_PERIODIC;
+    // SETVAL lets the next comparator write set the accumulator: the first
+    // write is the first expiry, the second the period
+    hpet_write(HPET_TIMER_CONFIG(0), timer_cfg | HPET_TN_SETVAL);
+    hpet_write(HPET_TIMER_COMPARATOR(0), (uint32_t)hpet_read(HPET_MAIN_COUNTER) + (uint32_t)period);
+    hpet_write(HPET_TIMER_COMPARATOR(0), period);
+}
+
+void hpet_timer_stop(void) {
+    if (!(timer_cfg & HPET_TN_ENABLE)) return;
+    timer_cfg &= ~(HPET_TN_ENABLE | HPET_TN_PERIODIC);
+    hpet_write(HPET_TIMER_CONFIG(0), timer_cfg);
+}
@@ -2,6 +2,13 @@
 #define ESTELLA_ARCH_X86_64_HPET_H
 
 #include <stdint.h>
+#include <stdbool.h>
+
+#include <arch/x86_64/irq.h>
+
+// a comparator closer than this to the counter may already be behind it
+// by the time the write lands
+#define HPET_MIN_DELTA      64
 
 extern uint64_t hpet_va;
 extern uint64_t hpet_frequency_hz;
@@ -10,4 +17,16 @@ void hpet_init(void *rsdp_ptr);
 uint64_t hpet_read(uint64_t offset);
 void hpet_write(uint64_t offset, uint64_t value);
 
-#endif
\ No newline at end of file
+// Comparator 0 as an event timer, routed through the IOAPIC. The input is
+// picked from the comparator's allowed IOAPIC inputs, above the ISA range.
+// False if there is no HPET or no usable route.
+bool hpet_timer_init(void);
+// requests the comparator's GSI once it is chosen as the timer
+void hpet_timer_route(irq_handler_t handler);
+bool hpet_timer_can_periodic(void);
+// interrupt after delta counter ticks (at least HPET_MIN_DELTA)
+void hpet_timer_oneshot(uint64_t delta);
+void hpet_timer_periodic(uint64_t period);
+void hpet_timer_stop(void);
+
+#endif
@@ -0,0 +1,116 @@
+#define KLOG_TAG "idle"
+
+#include <arch/x86_64/idle.h>
+#include <arch/x86_64/cpu.h>
+#include <arch/x86_64/cpufeature.h>
+#include <arch/x86_64/alternative.h>
+#include <arch/x86_64/apic.h>
+#include <log/klog.h>
+
+// MWAIT hint 0 = C1; deeper states would need CPUID leaf 5 and a reason
+#define MWAIT_HINT_C1 0
+
+// The wakeup word gets a cache line of its own: monitor watches the whole
+// line, and an unrelated store next to it would end every mwait early.
+struct wakeup {
+    volatile uint32_t pending;      // IDLE_WAKE_* bits
+    volatile uint64_t tsc;          // when the first pending bit was set
+} __attribute__((aligned(64)));
+
+static struct wakeup g_wake;
+static enum idle_mode g_mode = IDLE_HLT;
+static struct idle_stats g_stats;
+
+static const char *const mode_names[] = { "poll", "hlt", "mwait" };
+
+void idle_init(void) {
+    idle_reset_stats();
+    g_mode = cpu_has(X86_FEATURE_MONITOR) ? IDLE_MWAIT : IDLE_HLT;
+    klog_info("using %s", mode_names[g_mode]);
+}
+
+bool idle_set_mode(enum idle_mode mode) {
+    if (mode > IDLE_MWAIT) return false;
+    if (mode == IDLE_MWAIT && !cpu_has(X86_FEATURE_MONITOR)) return false;
+    g_mode = mode;
+    return true;
+}
+
+const char *idle_mode_name(enum idle_mode mode) {
+    return mode <= IDLE_MWAIT ? mode_names[mode] : "?";
+}
+
+void idle_wake(uint32_t source) {
+    uint64_t flags = irq_save();
+    if (!g_wake.pending) g_wake.tsc = rdtsc();
+    // the store is what ends an mwait on another CPU
+    __atomic_or_fetch(&g_wake.pending, source, __ATOMIC_RELEASE);
+    irq_restore(flags);
+}
+
+static void sleep_once(void) {
+    switch (g_mode) {
+    case IDLE_MWAIT:
+        monitor(&g_wake.pending);
+        // a wakeup between the check in idle_wait() and monitor would not
+        // trigger the monitor, so look once more after arming it
+        if (g_wake.pending) return;
+        sti_mwait(MWAIT_HINT_C1, 0);
+        break;
+    case IDLE_HLT:
+        sti_hlt();
+        break;
+    case IDLE_POLL:
+        asm volatile("sti\n\tpause" : : : "memory");
+        break;
+    }
+    asm volatile("cli" : : : "memory");
+}
+
+uint32_t idle_wait(void) {
+    uint64_t flags = irq_save();
+    bool slept = false;
+
+    while (!g_wake.pending) {
+        uint64_t start = rdtsc();
+        sleep_once();
+        g_stats.idle_tsc += rdtsc() - start;
+        g_stats.sleeps++;
+        if (!g_wake.pending) g_stats.spurious++;
+        slept = true;
+    }
+
+    uint32_t pending = __atomic_exchange_n(&g_wake.pending, 0, __ATOMIC_ACQUIRE);
+    uint64_t woken = g_wake.tsc;
+    irq_restore(flags);
+
+    // no tick ran while asleep; catch the jiffies up
+    if (slept) lapic_ticks_sync();
+
+    for (int i = 0; i < IDLE_WAKE_SOURCES; i++) {
+        if (pending & (1u << i)) g_stats.wakeups[i]++;
+    }
+
+    // only wakeups that ended a sleep say anything about wakeup latency;
+    // bits set while the loop was busy measure the loop instead
+    if (slept) {
+        uint64_t latency = rdtsc() - woken;
+        if (!g_stats.latency_count || latency < g_stats.latency_min_tsc) g_stats.latency_min_tsc = latency;
+        if (latency > g_stats.latency_max_tsc) g_stats.latency_max_tsc = latency;
+        g_stats.latency_total_tsc += latency;
+        g_stats.latency_count++;
+    }
+
+    return pending;
+}
+
+void idle_get_stats(struct idle_stats *out) {
+    *out = g_stats;
+    out->mode = g_mode;
+}
+
+void idle_reset_stats(void) {
+    uint64_t flags = irq_save();
+    g_stats = (struct idle_stats){ .since_tsc = rdtsc() };
+    irq_restore(flags);
+}
@@ -0,0 +1,52 @@
+#ifndef ESTELLA_ARCH_X86_64_IDLE_H
+#define ESTELLA_ARCH_X86_64_IDLE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Idle loop support. Interrupt handlers that produce work for the main loop
+// set a bit in the wakeup word with idle_wake(); idle_wait() sleeps until
+// one is set. Other interrupts (UART transmit, a timer tick nobody asked
+// for) still wake the CPU but put it straight back to sleep.
+
+#define IDLE_WAKE_KEYBOARD  (1u << 0)
+#define IDLE_WAKE_TIMER     (1u << 1)
+#define IDLE_WAKE_SERIAL    (1u << 2)
+#define IDLE_WAKE_LOG       (1u << 3)   // a record was queued in the log ring
+#define IDLE_WAKE_SOURCES   4
+
+enum idle_mode {
+    IDLE_POLL,      // pause loop, for comparison
+    IDLE_HLT,       // sti; hlt
+    IDLE_MWAIT,     // monitor the wakeup word, sti; mwait
+};
+
+struct idle_stats {
+    enum idle_mode mode;
+    uint64_t since_tsc;             // start of the accounting period
+    uint64_t idle_tsc;              // time spent in hlt/mwait (handlers included)
+    uint64_t sleeps;                // times the CPU was put to sleep
+    uint64_t spurious;              // woken without a wakeup bit set
+    uint64_t wakeups[IDLE_WAKE_SOURCES];
+    uint64_t latency_min_tsc;       // idle_wake() to idle_wait() returning
+    uint64_t latency_max_tsc;
+    uint64_t latency_total_tsc;
+    uint64_t latency_count;
+};
+
+// picks mwait when CPUID has MONITOR/MWAIT, hlt otherwise
+void idle_init(void);
+// false if the CPU can't do the mode
+bool idle_set_mode(enum idle_mode mode);
+const char *idle_mode_name(enum idle_mode mode);
+
+// safe from interrupt handlers
+void idle_wake(uint32_t source);
+// Returns the wakeup bits set since the last call, sleeping first if there
+// are none. Call with interrupts enabled.
+uint32_t idle_wait(void);
+
+void idle_get_stats(struct idle_stats *out);
+void idle_reset_stats(void);
+
+#endif
@@ -1,8 +1,14 @@
+#define KLOG_TAG "idt"
+
 #include <arch/x86_64/idt.h>
+#include <arch/x86_64/irq.h>
 #include <klib/string.h>
 #include <klib/memory.h>
 #include <drivers/fbtext.h>
 #include <drivers/serial.h>
+#include <log/logring.h>
+#include <log/klog.h>
+#include <colors.h>
 
 #define IDT_ENTRIES 256
 #define IDT_INTERRUPT 0x8E
@@ -14,124 +20,42 @@ extern void isr0(void), isr1(void), isr2(void), isr3(void), isr4(void), isr5(voi
             isr10(void), isr11(void), isr12(void), isr13(void), isr14(void), isr15(void), isr16(void), isr17(void), isr18(void),
             isr19(void), isr20(void), isr21(void), isr22(void), isr23(void), isr24(void), isr25(void), isr26(void), isr27(void),  
             isr28(void), isr29(void), isr30(void), isr31(void);
-extern void lapic_timer_isr(void);
 extern void lapic_error_isr(void);
-extern void keyboard_isr(void);
+// isr.S, one generic stub per vector from IRQ_VECTOR_BASE
+extern void *const irq_stub_table[IDT_ENTRIES - IRQ_VECTOR_BASE];
 
 void exception_handler(uint64_t vector, uint64_t error_code, uint64_t rip, uint64_t cs,
                        uint64_t rflags, uint64_t rsp, uint64_t ss) {
-    fb_print("KERNEL PANIC!\n", 0xFF5555);
-    serial_puts("KERNEL PANIC!\n");
-
-    char buf[32];
-
-    fb_print("Vector : ", 0xAAAAAA);
-    fb_print_number(vector, 0xAAAAAA);
-    fb_print("   ", 0xAAAAAA);
-    if (vector < 32) {
-        fb_print("(exception)", 0xAAAAAA);
-        serial_puts("(exception)");
-    }
-    fb_print("\n", 0);
-    serial_puts("\n");
-
-    fb_print("Error  : ", 0xAAAAAA);
-    u64_to_hex(error_code, buf);
-    fb_print(buf, 0xFFFFFF);
-    fb_print("\n", 0);
-    serial_puts("Error  : ");
-    serial_puts(buf);
-    serial_puts("\n");
-
-    fb_print("RIP    : ", 0xAAAAAA);
-    u64_to_hex(rip, buf);
-    fb_print(buf, 0xFFFFFF);
-    fb_print("\n", 0);
-    serial_puts("RIP    : ");
-    serial_puts(buf);
-    serial_puts("\n");
-
-    fb_print("CS     : ", 0xAAAAAA);
-    u64_to_hex(cs, buf);
-    fb_print(buf, 0xFFFFFF);
-    fb_print("  (ring ", 0xAAAAAA);
-    fb_print_number(cs & 3, 0xAAAAAA);
-    fb_print(")\n", 0xAAAAAA);
-    serial_puts("CS     : ");
-    serial_puts(buf);
-    serial_puts("  (ring ");
-    u64_to_dec(cs & 3, buf);
-    serial_puts(buf);
-    serial_puts(")\n");
-
-    fb_print("RFLAGS : ", 0xAAAAAA);
-    u64_to_hex(rflags, buf);
-    fb_print(buf, 0xFFFFFF);
-    fb_print("\n", 0);
-    serial_puts("RFLAGS : ");
-    serial_puts(buf);
-    serial_puts("\n");
-
-    fb_print("RSP    : ", 0xAAAAAA);
-    u64_to_hex(rsp, buf);
-    fb_print(buf, 0xFFFFFF);
-    fb_print("\n", 0);
-    serial_puts("RSP    : ");
-    serial_puts(buf);
-    serial_puts("\n");
-
-    fb_print("SS     : ", 0xAAAAAA);
-    u64_to_hex(ss, buf);
-    fb_print(buf, 0xFFFFFF);
-    fb_print("\n", 0);
-    serial_puts("SS     : ");
-    serial_puts(buf);
-    serial_puts("\n");
+    serial_panic();
+    logring_panic();
+    // a benchmark may have muted the console
+    klog_mute("fb", false);
+
+    klog_color(KLOG_ERR, COL_PANIC, "KERNEL PANIC!");
+    klog_err("Vector : %lu   %s", vector, vector < 32 ? "(exception)" : "");
+    klog_err("Error  : %p", (void *)error_code);
+    klog_err("RIP    : %p", (void *)rip);
+    klog_err("CS     : %p  (ring %lu)", (void *)cs, cs & 3);
+    klog_err("RFLAGS : %p", (void *)rflags);
+    klog_err("RSP    : %p", (void *)rsp);
+    klog_err("SS     : %p", (void *)ss);
 
     if (vector == 14) {
         uint64_t cr2;
         asm volatile("mov %%cr2, %0" : "=r"(cr2));
-        
-        fb_print("CR2    : ", 0xAAAAAA);
-        u64_to_hex(cr2, buf);
-        fb_print(buf, 0xFF7777);
-        fb_print("  -> ", 0xAAAAAA);
-
-        serial_puts("CR2    : ");
-        serial_puts(buf);
-        serial_puts("  -> ");
-
-        if (error_code & 1) {
-            fb_print("page-protection violation", 0xFF7777);
-            serial_puts("page-protection violation");
-        } else {
-            fb_print("page not present", 0xFF7777);
-            serial_puts("page not present");
-        }
-
-        if (error_code & 2) {
-            fb_print(", write attempt", 0xFF7777);
-            serial_puts(", write attempt");
-        }
-        if (error_code & 4) {
-            fb_print(", user mode", 0xFF7777);
-            serial_puts(", user mode");
-        }
-        if (error_code & 8) {
-            fb_print(", reserved bit set", 0xFF7777);
-            serial_puts(", reserved bit set");
-        }
-        if (error_code & 16) {
-            fb_print(", instruction fetch", 0xFF7777);
-            serial_puts(", instruction fetch");
-        }
-
-        fb_print("\n", 0);
-        serial_puts("\n");
+
+        klog_err("CR2    : %p  -> %s%s%s%s%s", (void *)cr2,
+                 (error_code & 1) ? "page-protection violation" : "page not present",
+                 (error_code & 2) ? ", write attempt" : "",
+                 (error_code & 4) ? ", user mode" : "",
+                 (error_code & 8) ? ", reserved bit set" : "",
+                 (error_code & 16) ? ", instruction fetch" : "");
     }
 
-    fb_print("\nSystem halted.\n", 0xFF5555);
-    serial_puts("System halted.\n\n");
+    klog_color(KLOG_ERR, COL_PANIC, "System halted.");
+
+    // nothing will call fb_flush_tick() again
+    fb_flush();
 
     while (1) asm volatile("hlt");
 }
@@ -148,10 +72,6 @@ static void idt_set_gate(uint8_t n, void *handler, uint8_t ist) {
 }
 
 void idt_init(void) {
-    for (int i = 0; i < IDT_ENTRIES; i++) {
-        idt_set_gate(i, (void*)((uint64_t)&isr0 + i * 16), 0);
-    }
-
     idt_set_gate(0x00, isr0, 0);    // divide error
     idt_set_gate(0x01, isr1, 0);    // debug exception
     idt_set_gate(0x02, isr2, 2);    // non-maskable interrupt
@@ -185,14 +105,17 @@ void idt_init(void) {
     idt_set_gate(0x1E, isr30, 0);   // security exception
     idt_set_gate(0x1F, isr31, 0);   // reserved
     
-    idt_set_gate(0x20, lapic_timer_isr, 0);
-    idt_set_gate(0x21, keyboard_isr, 0);
+    // handlers are installed later with irq_set_handler() / request_irq()
+    for (int i = IRQ_VECTOR_BASE; i < IDT_ENTRIES; i++) {
+        idt_set_gate(i, irq_stub_table[i - IRQ_VECTOR_BASE], 0);
+    }
     idt_set_gate(0xFE, lapic_error_isr, 0);
+    irq_init();
 
     idtr.limit = sizeof(idt) - 1;
     idtr.base  = (uint64_t)&idt;
 
     asm volatile ("lidt %0" : : "m"(idtr));
 
-    serial_puts("IDT initialized\n");
+    klog_color(KLOG_INFO, COL_SUCCESS_INIT, "IDT initialized");
 }
\ No newline at end of file
@@ -0,0 +1,111 @@
+#define KLOG_TAG "irq"
+
+#include <arch/x86_64/irq.h>
+#include <arch/x86_64/apic.h>
+#include <arch/x86_64/cpu.h>
+#include <arch/x86_64/cpufeature.h>
+#include <arch/x86_64/alternative.h>
+#include <log/klog.h>
+
+struct irq_desc {
+    irq_handler_t handler;
+    void *ctx;
+    uint32_t gsi;
+};
+
+// Each CPU only writes its own row, so the counters need no atomics. The
+// row is picked by IA32_TSC_AUX (loaded by trace_init()), which rdtscp
+// returns together with the start timestamp.
+struct irq_cpu_stats {
+    struct irq_stats vec[IRQ_VECTOR_COUNT];
+} __attribute__((aligned(64)));
+
+static struct irq_desc g_desc[IRQ_VECTOR_COUNT];
+static struct irq_cpu_stats g_stats[IRQ_MAX_CPUS];
+static uint64_t g_used[IRQ_VECTOR_COUNT / 64];
+
+static void reserve_vector(uint8_t vector) {
+    __atomic_or_fetch(&g_used[vector / 64], 1ULL << (vector % 64), __ATOMIC_RELAXED);
+}
+
+void irq_init(void) {
+    for (int v = 0; v < IRQ_VECTOR_BASE; v++) reserve_vector(v);
+    reserve_vector(LAPIC_TIMER_VECTOR);
+    reserve_vector(LAPIC_ERROR_VECTOR);
+    reserve_vector(LAPIC_SPURIOUS_VECTOR);
+
+    for (int v = 0; v < IRQ_VECTOR_COUNT; v++) g_desc[v].gsi = IRQ_NO_GSI;
+}
+
+int irq_alloc_vector(void) {
+    for (int w = 0; w < IRQ_VECTOR_COUNT / 64; w++) {
+        uint64_t used = __atomic_load_n(&g_used[w], __ATOMIC_RELAXED);
+        while (~used) {
+            uint64_t bit = ~used & (used + 1);
+            // a concurrent allocation may take the same bit; look again
+            used = __atomic_fetch_or(&g_used[w], bit, __ATOMIC_RELAXED);
+            if (!(used & bit)) return w * 64 + __builtin_ctzll(bit);
+        }
+    }
+    return -1;
+}
+
+void irq_set_handler(uint8_t vector, irq_handler_t handler, void *ctx) {
+    reserve_vector(vector);
+    g_desc[vector].ctx = ctx;
+    __atomic_store_n(&g_desc[vector].handler, handler, __ATOMIC_RELEASE);
+}
+
+int request_irq(uint32_t gsi, irq_handler_t handler, void *ctx) {
+    int vector = irq_alloc_vector();
+    if (vector < 0) {
+        klog_err("no free vector for GSI %u", gsi);
+        return -1;
+    }
+
+    g_desc[vector].gsi = gsi;
+    irq_set_handler(vector, handler, ctx);
+    ioapic_set_irq(gsi, vector, false, false, IOREDTBL_DELMODE_FIXED, 0);
+
+    klog_debug("GSI %u on vector 0x%x", gsi, vector);
+    return vector;
+}
+
+void irq_dispatch(uint64_t vector) {
+    uint32_t cpu = 0;
+    uint64_t start;
+
+    if (static_cpu_has(X86_FEATURE_RDTSCP)) {
+        start = rdtscp(&cpu);
+        if (cpu >= IRQ_MAX_CPUS) cpu = 0;
+    } else {
+        start = rdtsc();
+    }
+
+    const struct irq_desc *d = &g_desc[vector];
+    irq_handler_t handler = __atomic_load_n(&d->handler, __ATOMIC_ACQUIRE);
+    if (handler) handler(d->ctx);
+
+    uint64_t cycles = rdtsc() - start;
+    struct irq_stats *st = &g_stats[cpu].vec[vector];
+    st->count++;
+    st->total_cycles += cycles;
+    if (cycles > st->max_cycles) st->max_cycles = cycles;
+
+    // a spurious interrupt was never in service
+    if (vector != LAPIC_SPURIOUS_VECTOR) lapic_eoi();
+}
+
+bool irq_get_stats(uint8_t vector, struct irq_stats *out, uint32_t *gsi) {
+    *out = (struct irq_stats){ 0 };
+    *gsi = g_desc[vector].gsi;
+
+    for (int cpu = 0; cpu < IRQ_MAX_CPUS; cpu++) {
+        const struct irq_stats *st = &g_stats[cpu].vec[vector];
+        out->count += st->count;
+        out->total_cycles += st->total_cycles;
+        if (st->max_cycles > out->max_cycles) out->max_cycles = st->max_cycles;
+    }
+    return __atomic_load_n(&g_desc[vector].handler, __ATOMIC_RELAXED) || out->count;
+}
+
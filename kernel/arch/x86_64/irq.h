@@ -0,0 +1,47 @@
+#ifndef ESTELLA_ARCH_X86_64_IRQ_H
+#define ESTELLA_ARCH_X86_64_IRQ_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Device interrupts. Every vector from IRQ_VECTOR_BASE up enters through
+// one generic stub (isr.S) that pushes its number and calls irq_dispatch();
+// dispatch is a table lookup and an indirect call, without locks, then the
+// LAPIC EOI. Handlers run with interrupts off and do not EOI themselves.
+//
+// Vectors are handed out by irq_alloc_vector(); only the LAPIC ones are
+// fixed (timer 0x20, error 0xFE, spurious 0xFF).
+
+#define IRQ_VECTOR_BASE     0x20
+#define IRQ_VECTOR_COUNT    256
+#define IRQ_MAX_CPUS        4
+#define IRQ_NO_GSI          UINT32_MAX  // vector not routed through an IOAPIC
+
+typedef void (*irq_handler_t)(void *ctx);
+
+struct irq_stats {
+    uint64_t count;
+    uint64_t total_cycles;
+    uint64_t max_cycles;
+};
+
+// marks the fixed LAPIC vectors as taken; before any request_irq()
+void irq_init(void);
+
+// lowest free vector, -1 when all are taken
+int irq_alloc_vector(void);
+// Installs handler on an allocated or fixed vector. ctx is visible to the
+// handler before the handler is visible to dispatch.
+void irq_set_handler(uint8_t vector, irq_handler_t handler, void *ctx);
+
+// Allocates a vector for gsi, installs handler and routes the GSI to it
+// (edge, active high, to the BSP). Returns the vector, -1 if none is free.
+int request_irq(uint32_t gsi, irq_handler_t handler, void *ctx);
+
+// called by the stubs with the vector number
+void irq_dispatch(uint64_t vector);
+
+// sums the per-CPU counters of vector; false if nothing is installed on it
+bool irq_get_stats(uint8_t vector, struct irq_stats *out, uint32_t *gsi);
+
+#endif
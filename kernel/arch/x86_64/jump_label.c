@@ -0,0 +1,50 @@
+#include <arch/x86_64/jump_label.h>
+#include <arch/x86_64/alternative.h>
+#include <arch/x86_64/cpu.h>
+#include <klib/memory.h>
+
+extern struct jump_entry __jump_table_start[];
+extern struct jump_entry __jump_table_end[];
+
+#define OPCODE_JMP_NEAR 0xE9
+
+static const uint8_t nop5[JUMP_LABEL_NOP_SIZE] = { 0x0F, 0x1F, 0x44, 0x00, 0x00 };
+
+static int jump_label_update(struct static_key *key, bool enable) {
+    int patched = 0;
+
+    for (struct jump_entry *e = __jump_table_start; e < __jump_table_end; e++) {
+        struct static_key *k = (struct static_key *)((uint8_t *)&e->key + e->key);
+        if (k != key) continue;
+
+        uint8_t *code = (uint8_t *)&e->code + e->code;
+        uint8_t *target = (uint8_t *)&e->target + e->target;
+        uint8_t insn[JUMP_LABEL_NOP_SIZE];
+
+        if (enable) {
+            int32_t disp = (int32_t)(target - (code + JUMP_LABEL_NOP_SIZE));
+            insn[0] = OPCODE_JMP_NEAR;
+            memcpy(insn + 1, &disp, sizeof(disp));
+        } else {
+            memcpy(insn, nop5, sizeof(insn));
+        }
+
+        text_poke(code, insn, sizeof(insn));
+        patched++;
+    }
+
+    sync_core();
+    return patched;
+}
+
+int static_key_enable(struct static_key *key) {
+    if (key->enabled) return 0;
+    key->enabled = true;
+    return jump_label_update(key, true);
+}
+
+int static_key_disable(struct static_key *key) {
+    if (!key->enabled) return 0;
+    key->enabled = false;
+    return jump_label_update(key, false);
+}
@@ -0,0 +1,46 @@
+#ifndef ESTELLA_ARCH_X86_64_JUMP_LABEL_H
+#define ESTELLA_ARCH_X86_64_JUMP_LABEL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Static keys: a branch that costs a 5-byte NOP while the key is off.
+// Turning the key on rewrites every site using it into a jmp to the
+// out-of-line block, through text_poke().
+struct static_key {
+    bool enabled;
+};
+
+// one branch site, emitted into .jump_table
+// offsets are relative to the field itself, like struct alt_instr
+struct jump_entry {
+    int32_t code;       // the 5-byte NOP / jmp
+    int32_t target;     // where the jmp goes when the key is on
+    int64_t key;        // struct static_key
+};
+
+#define JUMP_LABEL_NOP_SIZE 5
+
+static inline __attribute__((always_inline)) bool static_key_false(struct static_key *key) {
+    asm goto("1: .byte 0x0f, 0x1f, 0x44, 0x00, 0x00\n\t"
+             ".pushsection .jump_table, \"a\"\n\t"
+             ".balign 8\n\t"
+             ".long 1b - .\n\t"
+             ".long %l[l_yes] - .\n\t"
+             ".quad %c0 - .\n\t"
+             ".popsection\n\t"
+             : : "i"(key) : : l_yes);
+    return false;
+l_yes:
+    return true;
+}
+
+static inline bool static_key_enabled(const struct static_key *key) {
+    return key->enabled;
+}
+
+// patch every site of key; returns the number of sites rewritten
+int static_key_enable(struct static_key *key);
+int static_key_disable(struct static_key *key);
+
+#endif
@@ -0,0 +1,75 @@
+#define KLOG_TAG "pmtimer"
+
+#include <arch/x86_64/pmtimer.h>
+#include <arch/x86_64/acpi.h>
+#include <arch/x86_64/io.h>
+#include <mm/vmm.h>
+#include <log/klog.h>
+
+uint64_t pmtimer_mask = 0;
+
+static uint16_t pmtimer_port = 0;
+static volatile uint32_t *pmtimer_mmio = NULL;
+
+extern uint64_t hhdm_offset;
+
+uint64_t pmtimer_read(void) {
+    uint32_t value = pmtimer_mmio ? *pmtimer_mmio : inl(pmtimer_port);
+    return value & pmtimer_mask;
+}
+
+// X_PM_TMR_BLK wins when the table has it and it is usable, PM_TMR_BLK
+// (always I/O) otherwise
+static bool pmtimer_locate(struct fadt *fadt) {
+    if (FADT_HAS(fadt, x_pm_tmr_blk) && fadt->x_pm_tmr_blk.address) {
+        struct acpi_gas *gas = &fadt->x_pm_tmr_blk;
+
+        if (gas->address_space_id == ACPI_GAS_IO && gas->address <= 0xFFFF) {
+            pmtimer_port = (uint16_t)gas->address;
+            return true;
+        }
+        if (gas->address_space_id == ACPI_GAS_MEMORY) {
+            uint64_t phys = gas->address & ~0xFFFULL;
+            if (vmm_map(phys + hhdm_offset, phys, PTE_KERNEL_RW | PTE_PCD | PTE_PWT)) {
+                pmtimer_mmio = (volatile uint32_t *)(gas->address + hhdm_offset);
+                return true;
+            }
+            klog_warn("cannot map X_PM_TMR_BLK, trying PM_TMR_BLK");
+        }
+    }
+    if (fadt->pm_tmr_blk && fadt->pm_tmr_len == 4 && fadt->pm_tmr_blk <= 0xFFFF) {
+        pmtimer_port = (uint16_t)fadt->pm_tmr_blk;
+        return true;
+    }
+    return false;
+}
+
+bool pmtimer_init(void *rsdp_ptr) {
+    if (pmtimer_mask) return true;
+
+    struct fadt *fadt = acpi_get_fadt(rsdp_ptr);
+    if (!fadt) {
+        klog_warn("no FADT");
+        return false;
+    }
+    if (!pmtimer_locate(fadt)) {
+        klog_info("not present");
+        return false;
+    }
+
+    bool wide = FADT_HAS(fadt, flags) && (fadt->flags & FADT_TMR_VAL_EXT);
+    pmtimer_mask = wide ? UINT32_MAX : 0xFFFFFF;
+
+    // a block that is listed but not decoded reads back a constant
+    uint64_t first = pmtimer_read();
+    for (int i = 0; i < 1000; i++) {
+        if (pmtimer_read() != first) {
+            klog_info("%u-bit, %s", wide ? 32 : 24, pmtimer_mmio ? "memory mapped" : "port I/O");
+            return true;
+        }
+    }
+
+    klog_warn("counter does not move");
+    pmtimer_mask = 0;
+    return false;
+}
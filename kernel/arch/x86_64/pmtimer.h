@@ -0,0 +1,21 @@
+#ifndef ESTELLA_ARCH_X86_64_PMTIMER_H
+#define ESTELLA_ARCH_X86_64_PMTIMER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// ACPI PM timer: a free-running 3.579545 MHz up-counter, 24 or 32 bits
+// wide (FADT TMR_VAL_EXT), in I/O or memory space. Present on nearly every
+// PC and VM, HPET or not; slow to read, but never stops or changes rate.
+
+#define PMTIMER_HZ  3579545
+
+// 0 until pmtimer_init() found the timer, then the counter width
+extern uint64_t pmtimer_mask;
+
+// Locates the timer through the FADT; false if there is none.
+bool pmtimer_init(void *rsdp_ptr);
+// raw counter, wraps at pmtimer_mask
+uint64_t pmtimer_read(void);
+
+#endif
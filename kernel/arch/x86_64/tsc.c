@@ -0,0 +1,264 @@
+#define KLOG_TAG "tsc"
+
+#include <limine.h>
+
+#include <arch/x86_64/tsc.h>
+#include <arch/x86_64/apic.h>
+#include <arch/x86_64/acpi.h>
+#include <arch/x86_64/hpet.h>
+#include <arch/x86_64/pmtimer.h>
+#include <arch/x86_64/cpu.h>
+#include <arch/x86_64/cpuid.h>
+#include <arch/x86_64/io.h>
+#include <drivers/serial.h>
+#include <time/clocksource.h>
+#include <time/hrtimer.h>
+#include <log/klog.h>
+#include <klib/printf.h>
+
+#define PIT_HZ          1193182
+#define PIT_CH2_DATA    0x42
+#define PIT_COMMAND     0x43
+#define PIT_GATE_PORT   0x61    // bit 0 gates channel 2, bit 1 drives the speaker
+
+// a counter to measure the TSC against
+struct calib_ref {
+    const char *name;
+    uint64_t (*read)(void);
+    uint64_t mask;
+    uint64_t hz;
+};
+
+struct sample {
+    uint64_t tsc;       // middle of the TSC bracket around the reference read
+    uint64_t ref;
+    uint64_t spread;    // width of that bracket
+};
+
+static struct tsc_calibration g_cal;
+static const struct calib_ref *g_ref = NULL;
+static struct sample g_first;           // start of the background refinement
+static struct hrtimer g_refine_timer = { .index = -1 };
+
+static uint64_t hpet_ref_read(void) {
+    return hpet_read(HPET_MAIN_COUNTER);
+}
+
+// channel 2 counts down; turned around so every reference counts up
+static uint64_t pit_ref_read(void) {
+    outb(0x80, PIT_COMMAND);            // latch channel 2
+    uint8_t lo = inb(PIT_CH2_DATA);
+    uint8_t hi = inb(PIT_CH2_DATA);
+    return 0xFFFF - (((uint16_t)hi << 8) | lo);
+}
+
+static struct calib_ref g_hpet_ref = { .name = "hpet", .read = hpet_ref_read };
+static struct calib_ref g_pmtimer_ref = { .name = "pmtimer", .read = pmtimer_read, .hz = PMTIMER_HZ };
+static const struct calib_ref g_pit_ref = { .name = "pit", .read = pit_ref_read, .mask = 0xFFFF, .hz = PIT_HZ };
+
+// Mode 0 from 0xFFFF with the gate held high: after the terminal count
+// the counter keeps wrapping, which makes it a free-running 16-bit counter.
+static bool pit_setup(void) {
+    outb((inb(PIT_GATE_PORT) & ~0x02) | 0x01, PIT_GATE_PORT);
+    outb(0xB0, PIT_COMMAND);            // channel 2, lobyte/hibyte, mode 0, binary
+    outb(0xFF, PIT_CH2_DATA);
+    outb(0xFF, PIT_CH2_DATA);
+
+    // a missing PIT reads back a constant; one count is 0.84 us
+    uint64_t first = pit_ref_read();
+    for (int i = 0; i < 1000; i++) {
+        if (pit_ref_read() != first) return true;
+    }
+    return false;
+}
+
+static const struct calib_ref *pick_reference(void) {
+    if (!hpet_va) hpet_init(rsdp_request.response->address);
+    if (hpet_frequency_hz) {
+        g_hpet_ref.hz = hpet_frequency_hz;
+        g_hpet_ref.mask = (hpet_read(HPET_CAPABILITIES) & HPET_CAP_COUNT_64) ? UINT64_MAX : UINT32_MAX;
+        return &g_hpet_ref;
+    }
+    if (pmtimer_init(rsdp_request.response->address)) {
+        g_pmtimer_ref.mask = pmtimer_mask;
+        return &g_pmtimer_ref;
+    }
+    if (pit_setup()) return &g_pit_ref;
+    return NULL;
+}
+
+// the tightest of a few TSC brackets around a reference read
+static void take_sample(const struct calib_ref *ref, struct sample *s) {
+    s->spread = UINT64_MAX;
+    for (int i = 0; i < 3; i++) {
+        uint64_t t0 = rdtsc();
+        uint64_t value = ref->read();
+        uint64_t t1 = rdtsc();
+        if (t1 - t0 < s->spread) {
+            s->spread = t1 - t0;
+            s->tsc = t0 + (t1 - t0) / 2;
+            s->ref = value;
+        }
+    }
+}
+
+// TSC Hz between two samples; *err_ppm is what quantisation and read
+// uncertainty allow for
+static uint64_t estimate(const struct calib_ref *ref, const struct sample *a, const struct sample *b,
+                         uint64_t *err_ppm) {
+    uint64_t ref_delta = (b->ref - a->ref) & ref->mask;
+    uint64_t tsc_delta = b->tsc - a->tsc;
+
+    *err_ppm = 1000000 / ref_delta + (a->spread + b->spread) / 2 * 1000000 / tsc_delta;
+    return tsc_delta * ref->hz / ref_delta;
+}
+
+static uint64_t measure_window(const struct calib_ref *ref, uint64_t *err_ppm) {
+    uint64_t ticks = ref->hz * TSC_CALIB_WINDOW_MS / 1000;
+    struct sample a, b;
+
+    take_sample(ref, &a);
+    if (!g_first.tsc) g_first = a;
+    while (((ref->read() - a.ref) & ref->mask) < ticks) {
+        asm("pause");
+    }
+    take_sample(ref, &b);
+
+    return estimate(ref, &a, &b, err_ppm);
+}
+
+static uint64_t ppm_diff(uint64_t a, uint64_t b) {
+    return (a > b ? a - b : b - a) * 1000000 / b;
+}
+
+static bool cpuid_frequency(uint64_t *hz) {
+    uint32_t eax, ebx, ecx, edx;
+
+    cpuid(0, &eax, &ebx, &ecx, &edx);
+    uint32_t max_leaf = eax;
+
+    if (max_leaf >= 0x15) {
+        cpuid(0x15, &eax, &ebx, &ecx, &edx);
+        if (eax && ebx && ecx) {
+            *hz = ((uint64_t)ecx * ebx) / eax;
+            return true;
+        }
+    }
+    if (max_leaf >= 0x16) {
+        cpuid(0x16, &eax, &ebx, &ecx, &edx);
+        if (eax) {
+            *hz = (uint64_t)eax * 1000000ULL;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool tsc_calibrate(void) {
+    uint64_t start = rdtsc();
+    uint64_t hz = 0;
+
+    g_cal = (struct tsc_calibration){ 0 };
+
+    if (cpuid_frequency(&hz)) {
+        g_cal.source = "cpuid";
+    } else {
+        g_ref = pick_reference();
+        if (!g_ref) {
+            serial_puts("TSC calibration failed: no CPUID frequency, HPET, PM timer or PIT\n");
+            return false;
+        }
+        g_cal.source = g_ref->name;
+
+        uint64_t est[TSC_CALIB_MAX_WINDOWS];
+        uint64_t err[TSC_CALIB_MAX_WINDOWS];
+        uint32_t n = 0;
+        uint32_t agreeing = 0;
+
+        // stop after three windows in a row agree
+        while (n < TSC_CALIB_MAX_WINDOWS && agreeing < 2) {
+            est[n] = measure_window(g_ref, &err[n]);
+            if (n) {
+                uint64_t bound = err[n] + err[n - 1];
+                if (bound < TSC_CALIB_AGREE_PPM) bound = TSC_CALIB_AGREE_PPM;
+                agreeing = ppm_diff(est[n], est[n - 1]) <= bound ? agreeing + 1 : 0;
+            }
+            n++;
+        }
+
+        // median by insertion sort, then average what is near it
+        uint64_t sorted[TSC_CALIB_MAX_WINDOWS];
+        for (uint32_t i = 0; i < n; i++) {
+            uint32_t j = i;
+            for (; j && sorted[j - 1] > est[i]; j--) sorted[j] = sorted[j - 1];
+            sorted[j] = est[i];
+        }
+        uint64_t median = sorted[n / 2];
+
+        uint64_t sum = 0, max_err = 0;
+        uint32_t kept = 0;
+        for (uint32_t i = 0; i < n; i++) {
+            if (ppm_diff(est[i], median) > TSC_CALIB_OUTLIER_PPM) continue;
+            sum += est[i];
+            kept++;
+            if (err[i] > max_err) max_err = err[i];
+        }
+        hz = sum / kept;
+
+        uint64_t spread = 0;
+        for (uint32_t i = 0; i < n; i++) {
+            uint64_t d = ppm_diff(est[i], hz);
+            if (d <= TSC_CALIB_OUTLIER_PPM && d > spread) spread = d;
+        }
+
+        g_cal.windows = n;
+        g_cal.rejected = n - kept;
+        // the larger of the spread between windows and the per-window
+        // bound, which averaging shrinks
+        g_cal.error_ppm = spread > max_err / kept ? spread : max_err / kept;
+    }
+
+    tsc_frequency_hz = hz;
+    tsc_ticks_per_10ms = hz / 100;
+    g_cal.hz = hz;
+    g_cal.duration_tsc = rdtsc() - start;
+
+    kprintf("TSC calibrated via %s: %lu Hz, %u windows (%u rejected), +-%lu ppm, took %lu us\n",
+            g_cal.source, hz, g_cal.windows, g_cal.rejected, g_cal.error_ppm,
+            g_cal.duration_tsc / (hz / 1000000 ? hz / 1000000 : 1));
+    return true;
+}
+
+static void refine_fn(struct hrtimer *timer) {
+    struct sample end;
+    uint64_t err_ppm;
+
+    take_sample(g_ref, &end);
+    uint64_t hz = estimate(g_ref, &g_first, &end, &err_ppm);
+    uint64_t diff = ppm_diff(hz, g_cal.hz);
+
+    g_cal.refined_hz = hz;
+    klog_info("refined against %s: %lu Hz (%s%lu ppm from boot, +-%lu ppm)", g_ref->name, hz,
+              hz < g_cal.hz ? "-" : "+", diff, err_ppm);
+
+    uint64_t old_hz = tsc_frequency_hz;
+    tsc_frequency_hz = hz;
+    tsc_ticks_per_10ms = hz / 100;
+    timer_tsc_freq_changed(old_hz);
+    clocksource_set_freq("tsc", hz);
+}
+
+void tsc_refine_start(void) {
+    if (!g_ref || !g_first.tsc || !timer_running()) return;
+
+    // the reference may not wrap between the first boot sample and the end
+    uint64_t span_ms = (rdtsc() - g_first.tsc) / (tsc_frequency_hz / 1000) + TSC_REFINE_DELAY_MS;
+    if (g_ref->mask / g_ref->hz * 1000 <= span_ms) return;
+
+    hrtimer_setup(&g_refine_timer, refine_fn, NULL);
+    hrtimer_start(&g_refine_timer, rdtsc() + hrtimer_ns_to_tsc(TSC_REFINE_DELAY_MS * 1000000ULL));
+}
+
+void tsc_get_calibration(struct tsc_calibration *out) {
+    *out = g_cal;
+}
@@ -0,0 +1,37 @@
+#ifndef ESTELLA_ARCH_X86_64_TSC_H
+#define ESTELLA_ARCH_X86_64_TSC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// TSC frequency. CPUID leaf 0x15/0x16 is taken as is when present;
+// otherwise the TSC is measured against a reference counter (HPET, ACPI PM
+// timer or PIT channel 2, in that order) over several short windows.
+// Estimates too far from the median are thrown out, and measuring stops
+// as soon as consecutive windows agree.
+
+#define TSC_CALIB_WINDOW_MS     5
+#define TSC_CALIB_MAX_WINDOWS   16
+#define TSC_CALIB_AGREE_PPM     100     // consecutive windows this close end calibration
+#define TSC_CALIB_OUTLIER_PPM   1000    // windows further than this from the median are dropped
+#define TSC_REFINE_DELAY_MS     2000    // one long window after boot, if the reference allows
+
+struct tsc_calibration {
+    uint64_t hz;
+    const char *source;         // "cpuid", "hpet", "pmtimer", "pit"
+    uint32_t windows;
+    uint32_t rejected;
+    uint64_t error_ppm;         // spread of the accepted windows, or read uncertainty
+    uint64_t duration_tsc;
+    uint64_t refined_hz;        // 0 until the background refinement ran
+};
+
+// Sets tsc_frequency_hz and tsc_ticks_per_10ms; false if no reference
+// worked. Reports on serial.
+bool tsc_calibrate(void);
+// Re-measures over TSC_REFINE_DELAY_MS against the boot reference from an
+// hrtimer and moves the TSC clocksource to the result.
+void tsc_refine_start(void);
+void tsc_get_calibration(struct tsc_calibration *out);
+
+#endif
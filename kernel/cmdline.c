@@ -0,0 +1,70 @@
+#include <cmdline.h>
+#include <klib/string.h>
+
+#define CMDLINE_MAX 512
+
+static char g_cmdline[CMDLINE_MAX];
+
+void cmdline_init(const char *cmdline)
+{
+    size_t i = 0;
+
+    if (cmdline) {
+        for (; cmdline[i] && i < CMDLINE_MAX - 1; i++) {
+            g_cmdline[i] = cmdline[i];
+        }
+    }
+    g_cmdline[i] = '\0';
+}
+
+const char *cmdline_raw(void)
+{
+    return g_cmdline;
+}
+
+// start of the value for key, its length in *len, or NULL
+static const char *cmdline_find(const char *key, size_t *len)
+{
+    size_t key_len = strlen(key);
+    const char *p = g_cmdline;
+
+    while (*p) {
+        while (*p == ' ') p++;
+
+        const char *word = p;
+        while (*p && *p != ' ') p++;
+
+        size_t word_len = (size_t)(p - word);
+        if (word_len > key_len && word[key_len] == '=') {
+            size_t i = 0;
+            while (i < key_len && word[i] == key[i]) i++;
+            if (i == key_len) {
+                *len = word_len - key_len - 1;
+                return word + key_len + 1;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+bool cmdline_get_str(const char *key, char *buf, size_t size)
+{
+    size_t len;
+    const char *value = cmdline_find(key, &len);
+    if (!value || !size) return false;
+
+    if (len > size - 1) len = size - 1;
+    for (size_t i = 0; i < len; i++) {
+        buf[i] = value[i];
+    }
+    buf[len] = '\0';
+    return true;
+}
+
+bool cmdline_get_u64(const char *key, uint64_t *out)
+{
+    size_t len;
+    const char *value = cmdline_find(key, &len);
+    return value && str_to_u64(value, len, out);
+}
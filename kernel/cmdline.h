@@ -0,0 +1,19 @@
+#ifndef ESTELLA_CMDLINE_H
+#define ESTELLA_CMDLINE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Kernel command line from Limine ("cmdline:" in limine.conf): space
+// separated key=value pairs, e.g. "serial.baud=115200 serial.rxtrigger=8".
+
+void cmdline_init(const char *cmdline);
+const char *cmdline_raw(void);
+
+// copies the value of key into buf, false if key is absent
+bool cmdline_get_str(const char *key, char *buf, size_t size);
+// decimal or 0x-prefixed hex value of key, false if absent or malformed
+bool cmdline_get_u64(const char *key, uint64_t *out);
+
+#endif
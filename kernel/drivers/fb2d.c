@@ -0,0 +1,301 @@
+#define KLOG_TAG "fb2d"
+
+#include <drivers/fb2d.h>
+#include <arch/x86_64/alternative.h>
+#include <arch/x86_64/apic.h>
+#include <log/klog.h>
+#include <mm/pmm.h>
+#include <mm/vmm.h>
+
+// No SSE in the kernel, so the widest stores are 8 bytes. rep stos/movs move
+// whole cache lines internally, and with ERMS rep stosb/movsb are at least as
+// fast as the qword forms for the row sizes seen here.
+
+static inline void rep_stosb(uint8_t *dst, uint8_t value, size_t n)
+{
+    asm volatile("rep stosb" : "+D"(dst), "+c"(n) : "a"(value) : "memory");
+}
+
+static inline void rep_stosq(uint8_t *dst, uint64_t value, size_t n)
+{
+    asm volatile("rep stosq" : "+D"(dst), "+c"(n) : "a"(value) : "memory");
+}
+
+static inline void copy_forward(uint8_t *dst, const uint8_t *src, size_t n)
+{
+    if (static_cpu_has(X86_FEATURE_ERMS)) {
+        asm volatile("rep movsb" : "+D"(dst), "+S"(src), "+c"(n) : : "memory");
+        return;
+    }
+
+    size_t qwords = n / 8;
+    size_t bytes = n & 7;
+    asm volatile("rep movsq" : "+D"(dst), "+S"(src), "+c"(qwords) : : "memory");
+    asm volatile("rep movsb" : "+D"(dst), "+S"(src), "+c"(bytes) : : "memory");
+}
+
+// For a destination overlapping the end of its source on the same row.
+// Plain loads and stores: a backwards rep movs needs DF set, which the ISR
+// stubs do not expect, and is slow on most cores anyway.
+static void copy_backward(uint8_t *dst, const uint8_t *src, size_t n)
+{
+    while (n >= 8) {
+        n -= 8;
+        uint64_t v;
+        __builtin_memcpy(&v, src + n, 8);
+        __builtin_memcpy(dst + n, &v, 8);
+    }
+    while (n--) {
+        dst[n] = src[n];
+    }
+}
+
+static inline void store_pixel(uint8_t *p, uint32_t pixel, unsigned bpp)
+{
+    switch (bpp) {
+        case 4: *(uint32_t *)p = pixel; break;
+        case 3: p[0] = (uint8_t)pixel; p[1] = (uint8_t)(pixel >> 8); p[2] = (uint8_t)(pixel >> 16); break;
+        case 2: *(uint16_t *)p = (uint16_t)pixel; break;
+        default: *p = (uint8_t)pixel; break;
+    }
+}
+
+static void fill_row(uint8_t *p, size_t pixels, uint32_t pixel, unsigned bpp)
+{
+    size_t bytes = pixels * bpp;
+
+    // a pixel made of one repeated byte (black, white) is a byte fill
+    bool uniform = bpp == 1 ||
+                   (bpp == 2 && (pixel & 0xFF) == ((pixel >> 8) & 0xFF)) ||
+                   (bpp >= 3 && (pixel & 0xFFFFFF) == (pixel & 0xFF) * 0x010101u &&
+                    (bpp == 3 || (pixel >> 24) == (pixel & 0xFF)));
+    if (uniform) {
+        rep_stosb(p, (uint8_t)pixel, bytes);
+        return;
+    }
+
+    if (bpp == 3) {
+        for (size_t i = 0; i < pixels; i++, p += 3) {
+            store_pixel(p, pixel, 3);
+        }
+        return;
+    }
+
+    // head pixels up to 8-byte alignment, qwords, then the tail
+    while (bytes && ((uintptr_t)p & 7)) {
+        store_pixel(p, pixel, bpp);
+        p += bpp;
+        bytes -= bpp;
+    }
+
+    uint64_t pattern = bpp == 4 ? pixel * 0x0000000100000001ULL : (uint16_t)pixel * 0x0001000100010001ULL;
+    rep_stosq(p, pattern, bytes / 8);
+    p += bytes & ~(size_t)7;
+    bytes &= 7;
+
+    for (; bytes; bytes -= bpp, p += bpp) {
+        store_pixel(p, pixel, bpp);
+    }
+}
+
+void fb2d_surface_from_limine(struct fb_surface *s, const struct limine_framebuffer *fb)
+{
+    s->pixels = (uint8_t *)fb->address;
+    s->width = fb->width;
+    s->height = fb->height;
+    s->pitch = fb->pitch;
+    s->bytes_per_pixel = (uint8_t)((fb->bpp + 7) / 8);
+    s->red_size = fb->red_mask_size;
+    s->red_shift = fb->red_mask_shift;
+    s->green_size = fb->green_mask_size;
+    s->green_shift = fb->green_mask_shift;
+    s->blue_size = fb->blue_mask_size;
+    s->blue_shift = fb->blue_mask_shift;
+    s->xrgb8888 = s->bytes_per_pixel == 4 &&
+                  s->red_size == 8 && s->red_shift == 16 &&
+                  s->green_size == 8 && s->green_shift == 8 &&
+                  s->blue_size == 8 && s->blue_shift == 0;
+}
+
+void fb2d_surface_like(struct fb_surface *s, void *pixels, const struct fb_surface *like)
+{
+    *s = *like;
+    s->pixels = (uint8_t *)pixels;
+}
+
+static inline uint32_t scale_channel(uint32_t value, uint8_t size, uint8_t shift)
+{
+    if (!size) return 0;
+    return (size >= 8 ? value << (size - 8) : value >> (8 - size)) << shift;
+}
+
+uint32_t fb2d_map_rgb(const struct fb_surface *s, uint32_t rgb)
+{
+    if (s->xrgb8888) return rgb & 0xFFFFFF;
+
+    return scale_channel((rgb >> 16) & 0xFF, s->red_size, s->red_shift) |
+           scale_channel((rgb >> 8) & 0xFF, s->green_size, s->green_shift) |
+           scale_channel(rgb & 0xFF, s->blue_size, s->blue_shift);
+}
+
+// clips [x, x + w) x [y, y + h) to the surface, false if nothing is left
+static inline bool clip(const struct fb_surface *s, size_t x, size_t y, size_t *w, size_t *h)
+{
+    if (x >= s->width || y >= s->height) return false;
+    if (*w > s->width - x) *w = s->width - x;
+    if (*h > s->height - y) *h = s->height - y;
+    return *w && *h;
+}
+
+void fb2d_fill(const struct fb_surface *s, size_t x, size_t y, size_t width, size_t height, uint32_t pixel)
+{
+    if (!clip(s, x, y, &width, &height)) return;
+
+    unsigned bpp = s->bytes_per_pixel;
+    uint8_t *row = s->pixels + y * s->pitch + x * bpp;
+
+    for (size_t i = 0; i < height; i++, row += s->pitch) {
+        fill_row(row, width, pixel, bpp);
+    }
+}
+
+void fb2d_copy(const struct fb_surface *dst, size_t dx, size_t dy,
+               const struct fb_surface *src, size_t sx, size_t sy, size_t width, size_t height)
+{
+    if (!clip(dst, dx, dy, &width, &height)) return;
+    if (!clip(src, sx, sy, &width, &height)) return;
+
+    unsigned bpp = dst->bytes_per_pixel;
+    size_t bytes = width * bpp;
+    uint8_t *d = dst->pixels + dy * dst->pitch + dx * bpp;
+    const uint8_t *s = src->pixels + sy * src->pitch + sx * bpp;
+
+    bool same = dst->pixels == src->pixels;
+
+    // moving down within one surface: walk rows bottom-up so each source
+    // row is read before it is overwritten
+    if (same && dy > sy) {
+        d += (height - 1) * dst->pitch;
+        s += (height - 1) * src->pitch;
+        for (size_t i = 0; i < height; i++, d -= dst->pitch, s -= src->pitch) {
+            copy_forward(d, s, bytes);
+        }
+        return;
+    }
+
+    bool backward = same && dy == sy && dx > sx && dx < sx + width;
+
+    for (size_t i = 0; i < height; i++, d += dst->pitch, s += src->pitch) {
+        if (backward) {
+            copy_backward(d, s, bytes);
+        } else {
+            copy_forward(d, s, bytes);
+        }
+    }
+}
+
+void fb2d_blit(const struct fb_surface *dst, size_t x, size_t y,
+               const uint32_t *bitmap, size_t stride, size_t width, size_t height, uint32_t key)
+{
+    if (!clip(dst, x, y, &width, &height)) return;
+
+    unsigned bpp = dst->bytes_per_pixel;
+    uint8_t *row = dst->pixels + y * dst->pitch + x * bpp;
+
+    for (size_t i = 0; i < height; i++, row += dst->pitch, bitmap += stride) {
+        if (dst->xrgb8888) {
+            if (key == FB2D_NO_KEY) {
+                copy_forward(row, (const uint8_t *)bitmap, width * 4);
+                continue;
+            }
+
+            // copy each run of opaque pixels in one go
+            size_t j = 0;
+            while (j < width) {
+                while (j < width && bitmap[j] == key) j++;
+                size_t start = j;
+                while (j < width && bitmap[j] != key) j++;
+                if (j > start) {
+                    copy_forward(row + start * 4, (const uint8_t *)(bitmap + start), (j - start) * 4);
+                }
+            }
+            continue;
+        }
+
+        uint8_t *p = row;
+        for (size_t j = 0; j < width; j++, p += bpp) {
+            if (bitmap[j] != key) {
+                store_pixel(p, fb2d_map_rgb(dst, bitmap[j]), bpp);
+            }
+        }
+    }
+}
+
+#define BENCH_SPRITE 64
+
+static uint32_t g_bench_sprite[BENCH_SPRITE * BENCH_SPRITE];
+
+static uint64_t bench_mpixels(uint64_t pixels, uint64_t tsc)
+{
+    return tsc ? pixels * (tsc_frequency_hz / 1000000) / tsc : 0;
+}
+
+void fb2d_bench(const struct fb_surface *s)
+{
+    if (!tsc_frequency_hz || !s->width || !s->height) return;
+
+    size_t bytes = s->pitch * s->height;
+    size_t frames = (bytes + PAGE_SIZE - 1) / PAGE_SIZE;
+    void *phys = pmm_alloc_frames(frames);
+    if (!phys) {
+        klog_warn("bench: no memory for a %zu KiB surface", bytes / 1024);
+        return;
+    }
+
+    struct fb_surface off;
+    fb2d_surface_like(&off, (void *)phys_to_virt((uint64_t)phys), s);
+
+    // checkerboard sprite, a quarter of it transparent
+    for (size_t y = 0; y < BENCH_SPRITE; y++) {
+        for (size_t x = 0; x < BENCH_SPRITE; x++) {
+            bool hole = ((x / 8) & 1) && ((y / 8) & 1);
+            g_bench_sprite[y * BENCH_SPRITE + x] = hole ? 0xFF00FF : 0x203040 + (uint32_t)(x * 2 + y);
+        }
+    }
+
+    const size_t rounds = 16;
+    uint64_t area = (uint64_t)s->width * s->height * rounds;
+    uint32_t colors[2] = { fb2d_map_rgb(s, 0x102030), fb2d_map_rgb(s, 0x000000) };
+
+    uint64_t t0 = timer_get_tsc();
+    for (size_t i = 0; i < rounds; i++) {
+        fb2d_fill(&off, 0, 0, s->width, s->height, colors[i & 1]);
+    }
+    uint64_t t1 = timer_get_tsc();
+    for (size_t i = 0; i < rounds; i++) {
+        // scroll up by one text line, as a console would
+        fb2d_copy(&off, 0, 0, &off, 0, 24, s->width, s->height - 24);
+    }
+    uint64_t t2 = timer_get_tsc();
+    for (size_t i = 0; i < rounds; i++) {
+        for (size_t y = 0; y + BENCH_SPRITE <= s->height; y += BENCH_SPRITE) {
+            for (size_t x = 0; x + BENCH_SPRITE <= s->width; x += BENCH_SPRITE) {
+                fb2d_blit(&off, x, y, g_bench_sprite, BENCH_SPRITE, BENCH_SPRITE, BENCH_SPRITE, 0xFF00FF);
+            }
+        }
+    }
+    uint64_t t3 = timer_get_tsc();
+
+    uint64_t copied = (uint64_t)s->width * (s->height - 24) * rounds;
+    uint64_t blitted = (uint64_t)(s->width / BENCH_SPRITE) * (s->height / BENCH_SPRITE) *
+                       BENCH_SPRITE * BENCH_SPRITE * rounds;
+
+    uint64_t fill = bench_mpixels(area, t1 - t0);
+    uint64_t copy = bench_mpixels(copied, t2 - t1);
+    uint64_t blit = bench_mpixels(blitted, t3 - t2);
+
+    pmm_free_frames(phys, frames);
+
+    klog_info("bench: %zux%zu %u bpp, MPixels/s: fill %lu, copy %lu, keyed blit %lu",
+              s->width, s->height, s->bytes_per_pixel * 8, fill, copy, blit);
+}
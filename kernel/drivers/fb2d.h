@@ -0,0 +1,50 @@
+#ifndef ESTELLA_DRIVERS_FB2D_H
+#define ESTELLA_DRIVERS_FB2D_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include <limine.h>
+
+// A block of pixels in some framebuffer layout: any pitch, 8/16/24/32 bpp,
+// colour channels where the masks say. Rectangles passed to the fb2d_*
+// primitives are clipped to the surface.
+struct fb_surface {
+    uint8_t *pixels;
+    size_t width;
+    size_t height;
+    size_t pitch;               // bytes per row
+    uint8_t bytes_per_pixel;
+    uint8_t red_size, red_shift;
+    uint8_t green_size, green_shift;
+    uint8_t blue_size, blue_shift;
+    bool xrgb8888;              // 0x00RRGGBB is already the native pixel
+};
+
+// colour key value that never matches, for plain blits
+#define FB2D_NO_KEY 0xFFFFFFFFu
+
+void fb2d_surface_from_limine(struct fb_surface *s, const struct limine_framebuffer *fb);
+// same size and format as like, backed by pixels
+void fb2d_surface_like(struct fb_surface *s, void *pixels, const struct fb_surface *like);
+
+// 0xRRGGBB -> native pixel value
+uint32_t fb2d_map_rgb(const struct fb_surface *s, uint32_t rgb);
+
+// fill with a native pixel value
+void fb2d_fill(const struct fb_surface *s, size_t x, size_t y, size_t width, size_t height, uint32_t pixel);
+
+// Copy a rectangle between surfaces of the same format. dst and src may be
+// the same surface with overlapping rectangles, e.g. to scroll a region.
+void fb2d_copy(const struct fb_surface *dst, size_t dx, size_t dy,
+               const struct fb_surface *src, size_t sx, size_t sy, size_t width, size_t height);
+
+// Draw a 0xRRGGBB bitmap (stride in pixels), skipping pixels equal to key.
+void fb2d_blit(const struct fb_surface *dst, size_t x, size_t y,
+               const uint32_t *bitmap, size_t stride, size_t width, size_t height, uint32_t key);
+
+// runs each primitive on an off-screen surface shaped like s, reports MPixels/s
+void fb2d_bench(const struct fb_surface *s);
+
+#endif
@@ -1,177 +1,678 @@
 #include <drivers/fbtext.h>
 #include <drivers/font.h>
+#include <drivers/fb2d.h>
 #include <klib/string.h>
+#include <klib/printf.h>
+#include <mm/pmm.h>
+#include <mm/vmm.h>
+#include <arch/x86_64/apic.h>
 
 #define LEFT_MARGIN 20
+#define TOP_MARGIN 15
+#define BACKGROUND 0x00000000
 
 static struct limine_framebuffer *g_fb = NULL;
 static font_t *g_font = NULL;
-static size_t g_cursor_x = LEFT_MARGIN;
-static size_t g_cursor_y = 15;
-static bool overwrite = false;
-static size_t overwrite_pos = 0;
+
+// render target: the framebuffer itself, or the RAM back buffer once enabled
+static uint32_t *g_draw = NULL;
+static size_t g_draw_stride = 0;
+static uint32_t *g_backbuffer = NULL;
+static struct fb_surface g_screen;
+static struct fb_surface g_back;
+static const struct fb_surface *g_target = &g_screen;     // g_screen or g_back
+
+// pending region of the back buffer, [x0, x1) x [y0, y1), empty when x0 >= x1
+static size_t g_dirty_x0, g_dirty_y0, g_dirty_x1, g_dirty_y1;
+
+static uint64_t g_flush_interval_tsc = 0;
+static uint64_t g_last_flush_tsc = 0;
+static uint64_t g_flush_count = 0;
+
+// Glyphs expanded to one bit per pixel per row (bit n = column n), so drawing
+// is a walk over set bits instead of a PSF decode. Direct-mapped by glyph index.
+#define GLYPH_CACHE_SLOTS 256
+#define GLYPH_CACHE_MAX_HEIGHT 32
+
+struct glyph_cache_entry {
+    uint32_t glyph;
+    bool valid;
+    uint32_t rows[GLYPH_CACHE_MAX_HEIGHT];
+};
+
+static struct glyph_cache_entry g_glyph_cache[GLYPH_CACHE_SLOTS];
+static uint64_t g_glyph_cache_hits = 0;
+static uint64_t g_glyph_cache_misses = 0;
+
+// Text model: a ring of rows of character cells. The screen shows g_rows
+// consecutive ring rows starting at g_top. Scrolling moves g_top and empties
+// the new bottom row by resetting its length, both O(1); the pixels are
+// only redrawn when the next flush renders the rows marked as changed.
+// Older rows stay in the ring as scrollback.
+#define FBTEXT_MAX_COLS 320
+#define FBTEXT_MAX_ROWS 160
+#define FBTEXT_RING_ROWS 256
+
+struct fb_cell {
+    uint32_t codepoint;
+    uint32_t color;
+};
+
+static struct fb_cell g_ring[FBTEXT_RING_ROWS][FBTEXT_MAX_COLS];
+static uint16_t g_row_len[FBTEXT_RING_ROWS];    // cells past the length are blank
+
+static size_t g_cols = 0;
+static size_t g_rows = 0;
+static size_t g_top = 0;            // ring index of the first live screen row
+static size_t g_history = 0;        // rows above g_top that still hold scrollback
+static size_t g_view_offset = 0;    // rows scrolled back from the live view
+static size_t g_cursor_col = 0;
+static size_t g_cursor_row = 0;     // relative to the live view
+
+// per screen row span of cells to repaint, empty when lo >= hi
+static uint16_t g_row_dirty_lo[FBTEXT_MAX_ROWS];
+static uint16_t g_row_dirty_hi[FBTEXT_MAX_ROWS];
+static bool g_render_pending = false;
+
+// What the pixels of each screen cell currently show. Rendering compares the
+// model against it and only repaints cells that really changed, so rewriting
+// a status line with mostly the same text touches just the differing cells.
+#define FB_CELL_UNKNOWN 0xFFFFFFFFu
+
+static struct fb_cell g_shadow[FBTEXT_MAX_ROWS][FBTEXT_MAX_COLS];
+static size_t g_frame_cells = 0;
+static size_t g_last_frame_cells = 0;
+static uint64_t g_total_cells = 0;
+
+static uint64_t g_scrolled_lines = 0;
+
+static inline size_t ring_index(size_t ring_row)
+{
+    return ring_row % FBTEXT_RING_ROWS;
+}
+
+static void fb_mark_row(size_t screen_row, size_t lo, size_t hi)
+{
+    if (screen_row >= g_rows) return;
+
+    if (g_row_dirty_lo[screen_row] >= g_row_dirty_hi[screen_row]) {
+        g_row_dirty_lo[screen_row] = (uint16_t)lo;
+        g_row_dirty_hi[screen_row] = (uint16_t)hi;
+    } else {
+        if (lo < g_row_dirty_lo[screen_row]) g_row_dirty_lo[screen_row] = (uint16_t)lo;
+        if (hi > g_row_dirty_hi[screen_row]) g_row_dirty_hi[screen_row] = (uint16_t)hi;
+    }
+    g_render_pending = true;
+}
+
+static void fb_mark_all_rows(void)
+{
+    for (size_t r = 0; r < g_rows; r++) {
+        g_row_dirty_lo[r] = 0;
+        g_row_dirty_hi[r] = (uint16_t)g_cols;
+    }
+    g_render_pending = true;
+}
 
 void fbtext_init(struct limine_framebuffer *fb, font_t *font)
 {
     g_fb   = fb;
     g_font = font;
 
+    g_draw = (uint32_t *)fb->address;
+    g_draw_stride = fb->pitch / sizeof(uint32_t);
+    fb2d_surface_from_limine(&g_screen, fb);
+    g_target = &g_screen;
+
     if (!font || !font->glyphs || font->width == 0 || font->height == 0) {
         return;
     }
 
-    g_cursor_x = LEFT_MARGIN;
-    g_cursor_y = 15;
+    g_cols = fb->width > LEFT_MARGIN ? (fb->width - LEFT_MARGIN) / font->width : 0;
+    g_rows = fb->height >= TOP_MARGIN + font->height
+           ? (fb->height - TOP_MARGIN - font->height) / font->line_height + 1 : 0;
+    if (g_cols > FBTEXT_MAX_COLS) g_cols = FBTEXT_MAX_COLS;
+    if (g_rows > FBTEXT_MAX_ROWS) g_rows = FBTEXT_MAX_ROWS;
+
+    g_top = 0;
+    g_history = 0;
+    g_view_offset = 0;
+    g_cursor_col = 0;
+    g_cursor_row = 0;
+    for (size_t i = 0; i < FBTEXT_RING_ROWS; i++) {
+        g_row_len[i] = 0;
+    }
+    // the bootloader hands over a cleared screen
+    for (size_t r = 0; r < g_rows; r++) {
+        for (size_t c = 0; c < g_cols; c++) {
+            g_shadow[r][c].codepoint = ' ';
+            g_shadow[r][c].color = 0;
+        }
+    }
 }
 
-static inline void fb_newline(void)
+static void fb_render(void);
+static void fb_invalidate(void);
+static void fb_clear_area(size_t x, size_t y, size_t width, size_t height, uint32_t color);
+static void fb_draw_glyph(uint32_t glyph, size_t x, size_t y, uint32_t color);
+
+bool fbtext_enable_backbuffer(void)
 {
-    g_cursor_x = LEFT_MARGIN;
-    g_cursor_y += g_font->line_height;
+    if (!g_fb || g_backbuffer) return g_backbuffer != NULL;
+
+    size_t bytes = g_fb->pitch * g_fb->height;
+    size_t frames = (bytes + PAGE_SIZE - 1) / PAGE_SIZE;
+
+    void *phys = pmm_alloc_frames(frames);
+    if (!phys) {
+        kprintf("fbtext: no memory for a %zu KiB back buffer, drawing directly\n", bytes / 1024);
+        return false;
+    }
+
+    g_backbuffer = (uint32_t *)phys_to_virt((uint64_t)phys);
+
+    fb2d_surface_like(&g_back, g_backbuffer, &g_screen);
+
+    // one read of video memory so the back buffer starts with what is on screen
+    fb2d_copy(&g_back, 0, 0, &g_screen, 0, 0, g_screen.width, g_screen.height);
+
+    g_draw = g_backbuffer;
+    g_target = &g_back;
+    g_dirty_x0 = g_dirty_x1 = 0;
+
+    kprintf("fbtext: back buffer enabled (%zu KiB)\n", bytes / 1024);
+    return true;
 }
 
-static inline void fb_advance(size_t pixels)
+void fbtext_set_flush_interval(uint64_t tsc_ticks)
 {
-    g_cursor_x += pixels;
-    if (g_cursor_x + g_font->width > g_fb->width) {
-        fb_newline();
+    g_flush_interval_tsc = tsc_ticks;
+}
+
+uint64_t fbtext_get_flush_count(void)
+{
+    return g_flush_count;
+}
+
+static void fb_mark_dirty(size_t x, size_t y, size_t width, size_t height)
+{
+    if (!g_backbuffer) return;
+
+    size_t x1 = x + width;
+    size_t y1 = y + height;
+
+    if (g_dirty_x0 >= g_dirty_x1) {
+        g_dirty_x0 = x;
+        g_dirty_y0 = y;
+        g_dirty_x1 = x1;
+        g_dirty_y1 = y1;
+        return;
+    }
+
+    if (x < g_dirty_x0) g_dirty_x0 = x;
+    if (y < g_dirty_y0) g_dirty_y0 = y;
+    if (x1 > g_dirty_x1) g_dirty_x1 = x1;
+    if (y1 > g_dirty_y1) g_dirty_y1 = y1;
+}
+
+void fb_flush(void)
+{
+    fb_render();
+
+    if (!g_backbuffer || g_dirty_x0 >= g_dirty_x1) return;
+
+    fb2d_copy(&g_screen, g_dirty_x0, g_dirty_y0, &g_back, g_dirty_x0, g_dirty_y0,
+              g_dirty_x1 - g_dirty_x0, g_dirty_y1 - g_dirty_y0);
+
+    g_dirty_x0 = g_dirty_x1 = 0;
+    g_flush_count++;
+}
+
+void fb_flush_tick(void)
+{
+    if (!g_render_pending && (!g_backbuffer || g_dirty_x0 >= g_dirty_x1)) return;
+
+    uint64_t now = timer_get_tsc();
+    if (g_flush_interval_tsc && now - g_last_flush_tsc < g_flush_interval_tsc) {
+        return;
     }
+
+    fb_flush();
+    g_last_flush_tsc = now;
 }
 
 static void fb_clear_area(size_t x, size_t y, size_t width, size_t height, uint32_t color)
 {
     if (!g_fb || x >= g_fb->width || y >= g_fb->height) return;
 
-    uint32_t *pixels = (uint32_t *)g_fb->address;
-    size_t stride = g_fb->pitch / sizeof(uint32_t);
+    if (x + width > g_fb->width)   width  = g_fb->width - x;
+    if (y + height > g_fb->height) height = g_fb->height - y;
+    if (width == 0 || height == 0) return;
+
+    fb2d_fill(g_target, x, y, width, height, fb2d_map_rgb(g_target, color));
+    fb_mark_dirty(x, y, width, height);
+}
 
-    size_t max_x = g_fb->width;
-    size_t max_y = g_fb->height;
+static inline const uint8_t *fb_glyph_bitmap(uint32_t glyph)
+{
+    size_t glyph_bytes = g_font->is_psf2 ? g_font->hdr.psf2->charsize : g_font->height;
+    return g_font->glyphs + (size_t)glyph * glyph_bytes;
+}
 
-    if (x + width > max_x)  width  = max_x - x;
-    if (y + height > max_y) height = max_y - y;
-    if (width == 0 || height == 0) return;
+// reference path: decodes the PSF bitmap bit by bit and bounds-checks every
+// pixel; pixel is already in the framebuffer's channel layout
+static void fb_draw_glyph_uncached(uint32_t glyph, size_t x, size_t y, uint32_t pixel)
+{
+    uint32_t *fb_pixels = g_draw;
+    size_t fb_stride = g_draw_stride;
+
+    const uint8_t *bitmap = fb_glyph_bitmap(glyph);
+    uint32_t bytes_per_row = (g_font->width + 7) / 8;
 
-    for (size_t dy = 0; dy < height; dy++) {
-        size_t py = y + dy;
-        for (size_t dx = 0; dx < width; dx++) {
-            size_t px = x + dx;
-            pixels[py * stride + px] = color;
+    for (uint32_t row = 0; row < g_font->height; row++) {
+        for (uint32_t col = 0; col < g_font->width; col++) {
+            uint32_t byte_idx = row * bytes_per_row + (col / 8);
+            uint8_t bit_mask = 0x80 >> (col % 8);
+
+            if (bitmap[byte_idx] & bit_mask) {
+                size_t px = x + col;
+                size_t py = y + row;
+                if (px < g_fb->width && py < g_fb->height) {
+                    fb_pixels[py * fb_stride + px] = pixel;
+                }
+            }
         }
     }
 }
 
-void fb_put_char(uint32_t codepoint, uint32_t color)
+static inline bool fb_glyph_cacheable(void)
 {
-    if (!g_fb || !g_font || !g_font->glyphs) {
-        return;
+    return g_font->width <= 32 && g_font->height <= GLYPH_CACHE_MAX_HEIGHT;
+}
+
+// returns the expanded rows of a glyph, decoding it on first use
+static const uint32_t *fb_glyph_rows(uint32_t glyph)
+{
+    struct glyph_cache_entry *e = &g_glyph_cache[glyph % GLYPH_CACHE_SLOTS];
+    if (e->valid && e->glyph == glyph) {
+        g_glyph_cache_hits++;
+        return e->rows;
     }
 
-    if (codepoint > 255) {
-        codepoint = '?';
+    g_glyph_cache_misses++;
+
+    const uint8_t *bitmap = fb_glyph_bitmap(glyph);
+    uint32_t bytes_per_row = (g_font->width + 7) / 8;
+
+    for (uint32_t row = 0; row < g_font->height; row++) {
+        uint32_t mask = 0;
+        for (uint32_t col = 0; col < g_font->width; col++) {
+            if (bitmap[row * bytes_per_row + col / 8] & (0x80 >> (col % 8))) {
+                mask |= 1u << col;
+            }
+        }
+        e->rows[row] = mask;
     }
 
-    if (codepoint == '\n') {
-        fb_newline();
-        overwrite = false;
+    e->glyph = glyph;
+    e->valid = true;
+    return e->rows;
+}
+
+static void fb_draw_glyph(uint32_t glyph, size_t x, size_t y, uint32_t color)
+{
+    if (glyph >= g_font->glyph_count) return;
+
+    // 0xRRGGBB to whatever channel masks the framebuffer reports
+    uint32_t pixel = fb2d_map_rgb(g_target, color);
+
+    if (!fb_glyph_cacheable()) {
+        fb_draw_glyph_uncached(glyph, x, y, pixel);
         return;
     }
-    if (codepoint == '\r') {
-        g_cursor_x = LEFT_MARGIN;
-        overwrite = true;
-        overwrite_pos = LEFT_MARGIN;
-        return;
+
+    const uint32_t *rows = fb_glyph_rows(glyph);
+    uint32_t height = g_font->height;
+
+    // clip only cells that stick out of the screen
+    uint32_t clip = 0xFFFFFFFFu;
+    if (y + height > g_fb->height) {
+        height = y < g_fb->height ? (uint32_t)(g_fb->height - y) : 0;
+    }
+    if (x + g_font->width > g_fb->width) {
+        size_t visible = x < g_fb->width ? g_fb->width - x : 0;
+        clip = visible >= 32 ? 0xFFFFFFFFu : (1u << visible) - 1;
     }
 
-    if (g_cursor_x + g_font->width > g_fb->width) {
-        fb_newline();
-        overwrite = false;
+    uint32_t *line = g_draw + y * g_draw_stride + x;
+    for (uint32_t row = 0; row < height; row++, line += g_draw_stride) {
+        uint32_t mask = rows[row] & clip;
+        while (mask) {
+            line[__builtin_ctz(mask)] = pixel;
+            mask &= mask - 1;
+        }
+    }
+}
+
+void fb_bench_glyphs(size_t count)
+{
+    if (!g_fb || !g_font || !g_font->glyphs || !tsc_frequency_hz) return;
+
+    // draw into the bottom-right cell and wipe it afterwards
+    size_t x = g_fb->width - g_font->width;
+    size_t y = g_fb->height - g_font->height;
+    uint32_t glyphs = g_font->glyph_count < 256 ? g_font->glyph_count : 256;
+
+    uint64_t t0 = timer_get_tsc();
+    for (size_t i = 0; i < count; i++) {
+        fb_draw_glyph_uncached((uint32_t)(i % glyphs), x, y, fb2d_map_rgb(g_target, 0xFFFFFF));
+    }
+    uint64_t t1 = timer_get_tsc();
+    for (size_t i = 0; i < count; i++) {
+        fb_draw_glyph((uint32_t)(i % glyphs), x, y, 0xFFFFFF);
+    }
+    uint64_t t2 = timer_get_tsc();
+
+    fb_clear_area(x, y, g_font->width, g_font->height, 0x00000000);
+    fb_invalidate();
+
+    uint64_t uncached = (t1 - t0) ? count * tsc_frequency_hz / (t1 - t0) : 0;
+    uint64_t cached = (t2 - t1) ? count * tsc_frequency_hz / (t2 - t1) : 0;
+
+    kprintf("fbtext bench: %zu glyphs, uncached %lu glyphs/s, cached %lu glyphs/s (cache %lu hits, %lu misses)\n",
+            count, uncached, cached, g_glyph_cache_hits, g_glyph_cache_misses);
+    fb_printf(0xAAAAAA, "glyphs/s: uncached %lu, cached %lu\n", uncached, cached);
+}
+
+static void fb_scroll(void)
+{
+    g_top = ring_index(g_top + 1);
+    g_row_len[ring_index(g_top + g_rows - 1)] = 0;
+
+    if (g_history < FBTEXT_RING_ROWS - g_rows) {
+        g_history++;
+    }
+    // keep a scrolled-back view on the same text while output continues
+    if (g_view_offset && g_view_offset < g_history) {
+        g_view_offset++;
+    }
+
+    g_scrolled_lines++;
+    fb_mark_all_rows();
+}
+
+static inline void fb_newline(void)
+{
+    g_cursor_col = 0;
+    if (g_cursor_row + 1 < g_rows) {
+        g_cursor_row++;
+    } else {
+        fb_scroll();
     }
-    if (g_cursor_y + g_font->height > g_fb->height) {
+}
+
+static void fb_set_cell(size_t screen_row, size_t col, uint32_t codepoint, uint32_t color)
+{
+    size_t ring_row = ring_index(g_top + screen_row);
+    struct fb_cell *row = g_ring[ring_row];
+
+    // a space looks the same in every colour; keep it equal to a blank cell
+    if (codepoint == ' ') color = 0;
+
+    // cells between the old end of the row and col become blank
+    for (size_t c = g_row_len[ring_row]; c < col; c++) {
+        row[c].codepoint = ' ';
+        row[c].color = 0;
+    }
+    if (col >= g_row_len[ring_row]) {
+        g_row_len[ring_row] = (uint16_t)(col + 1);
+    } else if (row[col].codepoint == codepoint && row[col].color == color) {
         return;
     }
 
-    if(overwrite) {
-        fb_clear_area(
-            g_cursor_x,
-            g_cursor_y,
-            g_font->width,
-            g_font->height,
-            0x00000000
-        );
+    row[col].codepoint = codepoint;
+    row[col].color = color;
 
-        size_t new_right = g_cursor_x + g_font->width;
-        if (new_right > overwrite_pos) {
-            overwrite = new_right;
+    if (g_view_offset == 0) {
+        fb_mark_row(screen_row, col, col + 1);
+    }
+}
+
+static inline bool fb_cell_equal(const struct fb_cell *a, const struct fb_cell *b)
+{
+    return a->codepoint == b->codepoint && a->color == b->color;
+}
+
+// Repaints the cells in [lo, hi) of one screen row whose model content
+// differs from the shadow, one clear per run of changed cells.
+static void fb_render_row(size_t screen_row, size_t lo, size_t hi)
+{
+    size_t ring_row = ring_index(g_top + FBTEXT_RING_ROWS - g_view_offset + screen_row);
+    const struct fb_cell *row = g_ring[ring_row];
+    struct fb_cell *shadow = g_shadow[screen_row];
+    size_t len = g_row_len[ring_row];
+    size_t y = TOP_MARGIN + screen_row * g_font->line_height;
+    static const struct fb_cell blank = { ' ', 0 };
+
+    size_t c = lo;
+    while (c < hi) {
+        const struct fb_cell *want = c < len ? &row[c] : &blank;
+        if (fb_cell_equal(&shadow[c], want)) {
+            c++;
+            continue;
+        }
+
+        size_t run = c;
+        while (c < hi) {
+            want = c < len ? &row[c] : &blank;
+            if (fb_cell_equal(&shadow[c], want)) break;
+            shadow[c] = *want;
+            c++;
+        }
+
+        size_t x = LEFT_MARGIN + run * g_font->width;
+        fb_clear_area(x, y, (c - run) * g_font->width, g_font->line_height, BACKGROUND);
+
+        for (size_t i = run; i < c; i++, x += g_font->width) {
+            if (shadow[i].codepoint != ' ') {
+                fb_draw_glyph(font_glyph_index(g_font, shadow[i].codepoint), x, y, shadow[i].color);
+            }
+        }
+
+        g_frame_cells += c - run;
+    }
+}
+
+static void fb_render(void)
+{
+    if (!g_render_pending) return;
+
+    g_frame_cells = 0;
+
+    for (size_t r = 0; r < g_rows; r++) {
+        if (g_row_dirty_lo[r] < g_row_dirty_hi[r]) {
+            fb_render_row(r, g_row_dirty_lo[r], g_row_dirty_hi[r]);
+            g_row_dirty_lo[r] = g_row_dirty_hi[r] = 0;
+        }
+    }
+
+    g_last_frame_cells = g_frame_cells;
+    g_total_cells += g_frame_cells;
+    g_render_pending = false;
+}
+
+// forget what is on screen, e.g. after drawing over the text area directly
+static void fb_invalidate(void)
+{
+    for (size_t r = 0; r < g_rows; r++) {
+        for (size_t c = 0; c < g_cols; c++) {
+            g_shadow[r][c].codepoint = FB_CELL_UNKNOWN;
         }
     }
+    fb_mark_all_rows();
+}
 
-    uint32_t *fb_pixels = (uint32_t *)g_fb->address;
-    size_t fb_stride = g_fb->pitch / sizeof(uint32_t);
+size_t fbtext_get_frame_cells(void)
+{
+    return g_last_frame_cells;
+}
 
-    size_t glyph_offset;
-    if (g_font->is_psf2) {
-        glyph_offset = (size_t)codepoint * g_font->hdr.psf2->charsize;
+uint64_t fbtext_get_total_cells(void)
+{
+    return g_total_cells;
+}
+
+void fb_scroll_view(int lines)
+{
+    if (!g_rows) return;
+
+    size_t offset = g_view_offset;
+    if (lines > 0) {
+        offset += (size_t)lines;
+        if (offset > g_history) offset = g_history;
     } else {
-        glyph_offset = (size_t)codepoint * g_font->height;
+        size_t back = (size_t)-lines;
+        offset = back > offset ? 0 : offset - back;
     }
 
-    const uint8_t *glyph = g_font->glyphs + glyph_offset;
-    uint32_t bytes_per_row = (g_font->width + 7) / 8;
+    if (offset != g_view_offset) {
+        g_view_offset = offset;
+        fb_mark_all_rows();
+        fb_flush();
+    }
+}
 
-    for (uint32_t row = 0; row < g_font->height; row++) {
-        for (uint32_t col = 0; col < g_font->width; col++) {
-            uint32_t byte_idx = row * bytes_per_row + (col / 8);
-            uint8_t bit_mask = 0x80 >> (col % 8);
+void fb_bench_console(size_t lines)
+{
+    if (!g_rows || !tsc_frequency_hz) return;
 
-            if (glyph[byte_idx] & bit_mask) {
-                size_t px = g_cursor_x + col;
-                size_t py = g_cursor_y + row;
-                if (px < g_fb->width && py < g_fb->height) {
-                    fb_pixels[py * fb_stride + px] = color;
-                }
-            }
+    uint64_t scrolled = g_scrolled_lines;
+    uint64_t flushes = g_flush_count;
+    uint64_t cells = g_total_cells;
+
+    uint64_t t0 = timer_get_tsc();
+    for (size_t i = 0; i < lines; i++) {
+        fb_printf(0x808080, "console bench line %zu of %zu: the quick brown fox jumps over the lazy dog\n",
+                  i + 1, lines);
+    }
+    fb_flush();
+    uint64_t t1 = timer_get_tsc();
+
+    uint64_t rate = (t1 - t0) ? lines * tsc_frequency_hz / (t1 - t0) : 0;
+
+    kprintf("fbtext bench: %zu lines in %lu us, %lu lines/s (%lu scrolls, %lu flushes, %lu cells repainted)\n",
+            lines, (t1 - t0) * 1000000 / tsc_frequency_hz, rate,
+            g_scrolled_lines - scrolled, g_flush_count - flushes, g_total_cells - cells);
+    fb_printf(0xAAAAAA, "lines/s: %lu\n", rate);
+}
+
+size_t fbtext_get_rows(void)
+{
+    return g_rows;
+}
+
+uint64_t fbtext_get_scrolled_lines(void)
+{
+    return g_scrolled_lines;
+}
+
+void fb_put_char(uint32_t codepoint, uint32_t color)
+{
+    if (!g_fb || !g_font || !g_font->glyphs || !g_rows || !g_cols) {
+        return;
+    }
+
+    if (codepoint == '\n') {
+        fb_newline();
+        return;
+    }
+    if (codepoint == '\r') {
+        // following characters overwrite the line in place
+        g_cursor_col = 0;
+        return;
+    }
+
+    // cells only ever hold codepoints the font can draw (spaces are never drawn)
+    if (codepoint != ' ' && font_glyph_index(g_font, codepoint) == FONT_NO_GLYPH) {
+        codepoint = font_glyph_index(g_font, UTF8_REPLACEMENT) != FONT_NO_GLYPH ? UTF8_REPLACEMENT : '?';
+    }
+
+    if (g_cursor_col >= g_cols) {
+        fb_newline();
+    }
+
+    // new output snaps a scrolled-back view to the live screen
+    if (g_view_offset) {
+        g_view_offset = 0;
+        fb_mark_all_rows();
+    }
+
+    fb_set_cell(g_cursor_row, g_cursor_col, codepoint, color);
+    g_cursor_col++;
+}
+
+void fb_write(const char *str, size_t len, uint32_t color)
+{
+    const char *end = str + len;
+
+    while (str < end) {
+        uint8_t c = (uint8_t)*str;
+        if (c < 0x80) {
+            str++;
+            fb_put_char(c, color);
+            continue;
         }
+
+        uint32_t codepoint = utf8_decode(&str, end);
+        fb_put_char(codepoint == UTF8_INVALID ? UTF8_REPLACEMENT : codepoint, color);
     }
 
-    fb_advance(g_font->width);
+    fb_flush_tick();
 }
 
 void fb_print(const char *str, uint32_t color)
 {
     if (!str) return;
 
-    while (*str) {
-        fb_put_char((uint8_t)*str++, color);
-    }
+    fb_write(str, strlen(str), color);
 }
 
 void fb_print_at(const char *str, uint32_t color, int x, int y)
 {
-    if (x < 0 || y < 0) return;
+    if (x < 0 || y < 0 || !g_font || !g_font->width) return;
 
-    size_t old_x = g_cursor_x;
-    size_t old_y = g_cursor_y;
+    size_t old_col = g_cursor_col;
+    size_t old_row = g_cursor_row;
 
-    g_cursor_x = (size_t)x;
-    g_cursor_y = (size_t)y;
+    g_cursor_col = (size_t)x > LEFT_MARGIN ? ((size_t)x - LEFT_MARGIN) / g_font->width : 0;
+    g_cursor_row = (size_t)y > TOP_MARGIN ? ((size_t)y - TOP_MARGIN) / g_font->line_height : 0;
+    if (g_cursor_row >= g_rows) {
+        g_cursor_col = old_col;
+        g_cursor_row = old_row;
+        return;
+    }
 
     fb_print(str, color);
 
-    g_cursor_x = old_x;
-    g_cursor_y = old_y;
+    g_cursor_col = old_col;
+    g_cursor_row = old_row;
 }
 
 void fb_print_number(uint64_t n, uint32_t color)
 {
-    char buf[32];
-    char *p = buf + sizeof(buf);
-    *--p = '\0';
+    char buf[24];
+    u64_to_dec(n, buf);
+    fb_print(buf, color);
+}
+
+void fb_printf(uint32_t color, const char *fmt, ...)
+{
+    char buf[KPRINTF_BUF_SIZE];
 
-    do {
-        *--p = '0' + (n % 10);
-        n /= 10;
-    } while (n != 0);
+    va_list ap;
+    va_start(ap, fmt);
+    kvsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
 
-    fb_print(p, color);
-}
\ No newline at end of file
+    fb_print(buf, color);
+}
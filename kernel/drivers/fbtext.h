@@ -11,7 +11,35 @@
 void fbtext_init(struct limine_framebuffer *fb, font_t *font);
 void fb_put_char(uint32_t codepoint, uint32_t color);
 void fb_print(const char *str, uint32_t color);
+void fb_write(const char *str, size_t len, uint32_t color);
 void fb_print_at(const char *str, uint32_t color, int x, int y);
 void fb_print_number(uint64_t, uint32_t color);
+void fb_printf(uint32_t color, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+// Render into a RAM copy of the framebuffer and copy only the dirty
+// rectangle to video memory. Needs the PMM; returns false if it could not
+// allocate, in which case drawing stays direct.
+bool fbtext_enable_backbuffer(void);
+// minimum TSC ticks between automatic flushes, 0 = flush after every print
+void fbtext_set_flush_interval(uint64_t tsc_ticks);
+// copy pending changes to the framebuffer now
+void fb_flush(void);
+// flush if something is pending and the flush interval has passed
+void fb_flush_tick(void);
+uint64_t fbtext_get_flush_count(void);
+
+// Scroll the view into the scrollback history, positive = older lines.
+// Any new output returns the view to the live screen.
+void fb_scroll_view(int lines);
+size_t fbtext_get_rows(void);
+uint64_t fbtext_get_scrolled_lines(void);
+// cells whose pixels changed in the most recent render, and since boot
+size_t fbtext_get_frame_cells(void);
+uint64_t fbtext_get_total_cells(void);
+
+// renders count glyphs with and without the glyph cache, reports glyphs/s
+void fb_bench_glyphs(size_t count);
+// prints lines through the full console path (scrolling included), reports lines/s
+void fb_bench_console(size_t lines);
 
 #endif
\ No newline at end of file
@@ -1,4 +1,6 @@
 #include <drivers/font.h>
+#include <klib/string.h>
+#include <klib/printf.h>
 
 struct psf1_header* load_psf1_font(struct limine_module_request module_request, struct limine_file **out_glyphs) {
     if (!module_request.response) return NULL;
@@ -33,4 +35,75 @@ struct psf2_header* load_psf2_font(struct limine_module_request module_request,
         }
     }
     return NULL;
-}
\ No newline at end of file
+}
+
+static struct font_unicode_map g_unicode_map;
+
+static bool unicode_map_add(struct font_unicode_map *map, uint32_t codepoint, uint32_t glyph) {
+    if (codepoint < FONT_UNICODE_DIRECT) {
+        // the first glyph listed for a codepoint wins
+        if (map->direct[codepoint] == FONT_NO_GLYPH) {
+            map->direct[codepoint] = (uint16_t)glyph;
+            map->entries++;
+        }
+        return true;
+    }
+
+    // keep the table at most 3/4 full so probe chains stay short
+    if (map->hashed >= FONT_UNICODE_HASH_SLOTS / 4 * 3) {
+        return false;
+    }
+
+    for (uint32_t i = font_unicode_hash(codepoint);; i = (i + 1) & (FONT_UNICODE_HASH_SLOTS - 1)) {
+        if (map->hash[i].codepoint == codepoint) return true;
+        if (map->hash[i].codepoint == 0) {
+            map->hash[i].codepoint = codepoint;
+            map->hash[i].glyph = (uint16_t)glyph;
+            map->hashed++;
+            map->entries++;
+            return true;
+        }
+    }
+}
+
+bool font_load_unicode(font_t *font, const struct limine_file *module) {
+    if (!font->is_psf2 || !(font->hdr.psf2->flags & PSF2_HAS_UNICODE_TABLE)) return false;
+    if (font->glyph_count > FONT_NO_GLYPH) return false;
+
+    const struct psf2_header *hdr = font->hdr.psf2;
+    const char *p = (const char *)module->address + hdr->headersize + (size_t)hdr->length * hdr->charsize;
+    const char *end = (const char *)module->address + module->size;
+
+    struct font_unicode_map *map = &g_unicode_map;
+    for (size_t i = 0; i < FONT_UNICODE_DIRECT; i++) {
+        map->direct[i] = FONT_NO_GLYPH;
+    }
+    map->entries = 0;
+    map->hashed = 0;
+    size_t overflow = 0;
+
+    // each glyph lists single codepoints, then optional 0xFE-prefixed
+    // combining sequences, terminated by 0xFF; sequences are not rendered
+    for (uint32_t glyph = 0; glyph < font->glyph_count && p < end; glyph++) {
+        bool in_sequence = false;
+
+        while (p < end && (uint8_t)*p != PSF2_UNICODE_SEP) {
+            if ((uint8_t)*p == PSF2_UNICODE_SEQ_START) {
+                in_sequence = true;
+                p++;
+                continue;
+            }
+
+            uint32_t codepoint = utf8_decode(&p, end);
+            if (!in_sequence && codepoint != UTF8_INVALID && !unicode_map_add(map, codepoint, glyph)) {
+                overflow++;
+            }
+        }
+        p++;
+    }
+
+    font->unicode = map;
+    kprintf("font: unicode table with %zu codepoints (%zu hashed, %zu did not fit)\n",
+            map->entries, map->hashed, overflow);
+    return true;
+}
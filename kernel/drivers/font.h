@@ -6,6 +6,25 @@
 #include <stddef.h>
 #include <limine.h>
 
+// Codepoint -> glyph index, built once from the PSF2 unicode table.
+// Codepoints below FONT_UNICODE_DIRECT index an array; the rest go through
+// an open-addressed hash table. Both are a handful of instructions per lookup.
+#define FONT_UNICODE_DIRECT 0x3000      // Latin, Greek, Cyrillic, punctuation, box drawing
+#define FONT_UNICODE_HASH_SLOTS 2048    // power of two
+#define FONT_NO_GLYPH 0xFFFF
+
+struct font_unicode_slot {
+    uint32_t codepoint;     // 0 = empty, U+0000 always lives in the direct array
+    uint16_t glyph;
+};
+
+struct font_unicode_map {
+    uint16_t direct[FONT_UNICODE_DIRECT];
+    struct font_unicode_slot hash[FONT_UNICODE_HASH_SLOTS];
+    size_t entries;
+    size_t hashed;
+};
+
 typedef struct {
     bool is_psf2;
     union {
@@ -17,6 +36,7 @@ typedef struct {
     uint32_t height;
     uint32_t line_height;
     uint32_t glyph_count;
+    const struct font_unicode_map *unicode;    // NULL: glyph index == codepoint
 } font_t;
 
 
@@ -31,6 +51,11 @@ struct psf1_header {
 
 
 #define PSF2_MAGIC 0x864AB572
+#define PSF2_HAS_UNICODE_TABLE 0x01
+
+// separators inside a glyph's unicode table entry
+#define PSF2_UNICODE_SEQ_START 0xFE
+#define PSF2_UNICODE_SEP       0xFF
 
 struct psf2_header {
     uint32_t magic;
@@ -46,4 +71,31 @@ struct psf2_header {
 struct psf1_header* load_psf1_font(struct limine_module_request module_request, struct limine_file **out_glyphs);
 struct psf2_header* load_psf2_font(struct limine_module_request module_request, struct limine_file **out_glyphs);
 
+// Builds font->unicode from the table after the glyphs, if the font has one.
+// Returns false and leaves the identity mapping in place otherwise.
+bool font_load_unicode(font_t *font, const struct limine_file *module);
+
+static inline uint32_t font_unicode_hash(uint32_t codepoint) {
+    return (codepoint * 2654435761u) >> (32 - 11);
+}
+
+_Static_assert(FONT_UNICODE_HASH_SLOTS == 1u << 11, "font_unicode_hash() assumes 2048 slots");
+
+// glyph index for codepoint, or FONT_NO_GLYPH
+static inline uint32_t font_glyph_index(const font_t *font, uint32_t codepoint) {
+    const struct font_unicode_map *map = font->unicode;
+
+    if (!map) {
+        return codepoint < font->glyph_count ? codepoint : FONT_NO_GLYPH;
+    }
+    if (codepoint < FONT_UNICODE_DIRECT) {
+        return map->direct[codepoint];
+    }
+
+    for (uint32_t i = font_unicode_hash(codepoint);; i = (i + 1) & (FONT_UNICODE_HASH_SLOTS - 1)) {
+        if (map->hash[i].codepoint == codepoint) return map->hash[i].glyph;
+        if (map->hash[i].codepoint == 0) return FONT_NO_GLYPH;
+    }
+}
+
 #endif
\ No newline at end of file
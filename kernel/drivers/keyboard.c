@@ -1,7 +1,13 @@
+#define KLOG_TAG "kbd"
+
 #include <drivers/keyboard.h>
-#include <arch/x86_64/apic.h>
+#include <arch/x86_64/irq.h>
 #include <arch/x86_64/io.h>
-#include <drivers/serial.h>
+#include <arch/x86_64/cpu.h>
+#include <arch/x86_64/idle.h>
+#include <log/klog.h>
+#include <log/trace.h>
+#include <colors.h>
 
 static const char ascii_base[128] = {
     0,   0,   '1',  '2',  '3',  '4',  '5',  '6',  '7',  '8',  '9',  '0',  '-',  '=',  '\b', '\t',
@@ -25,114 +31,168 @@ static const char ascii_shift[128] = {
     0,   0,   0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0
 };
 
-static volatile bool     key_pressed    = false;
-static volatile uint8_t  last_scancode  = 0;
-static volatile bool     left_shift     = false;
-static volatile bool     right_shift    = false;
-static volatile bool     caps_lock      = false;
+// set 1 make codes
+#define SC_LSHIFT   0x2A
+#define SC_RSHIFT   0x36
+#define SC_CTRL     0x1D    // right ctrl with 0xE0
+#define SC_ALT      0x38    // right alt with 0xE0
+#define SC_CAPS     0x3A
+#define SC_BREAK    0x80
+#define SC_EXTENDED 0xE0
+#define SC_PAUSE    0xE1    // E1 1D 45 E1 9D C5, no break code
 
-static inline bool is_shift_pressed(void) {
-    return left_shift || right_shift;
-}
+#define KBD_RING_MASK (KBD_RING_SIZE - 1)
+
+_Static_assert((KBD_RING_SIZE & KBD_RING_MASK) == 0, "KBD_RING_SIZE must be a power of two");
+
+// head is only written by the IRQ handler, tail only by the reader
+static struct key_event g_ring[KBD_RING_SIZE];
+static uint32_t g_head = 0;
+static uint32_t g_tail = 0;
+
+static uint8_t g_modifiers = 0;
+static bool g_extended = false;     // last byte was 0xE0
+static uint8_t g_pause_skip = 0;    // bytes left of the Pause sequence
 
-static char get_char_from_scancode(uint8_t code) {
-    const char* table = ascii_base;
+static struct keyboard_stats g_stats;
 
-    if (is_shift_pressed()) {
-        table = ascii_shift;
+static char get_char_from_scancode(uint16_t scancode, uint8_t mods) {
+    bool shift = (mods & KBD_MOD_SHIFT) != 0;
+
+    if (scancode & 0xFF00) {
+        // keypad Enter and '/' are the only extended keys with a character
+        if (scancode == KBD_EXT(0x1C)) return '\n';
+        if (scancode == KBD_EXT(0x35)) return '/';
+        return 0;
     }
 
-    char ch = (code < 128) ? table[code] : 0;
+    char ch = (shift ? ascii_shift : ascii_base)[scancode & 0x7F];
 
-    if (caps_lock && ch >= 'a' && ch <= 'z') {
+    if ((mods & KBD_MOD_CAPS) && ch >= 'a' && ch <= 'z') {
         ch -= 32;
     }
-    else if (caps_lock && ch >= 'A' && ch <= 'Z' && is_shift_pressed()) {
+    else if ((mods & KBD_MOD_CAPS) && ch >= 'A' && ch <= 'Z' && shift) {
         ch += 32;
     }
 
     return ch;
 }
 
-void keyboard_handler(void) {
-    uint8_t scancode = inb(0x60);
+static uint8_t modifier_bit(uint16_t scancode) {
+    switch (scancode) {
+        case SC_LSHIFT: return KBD_MOD_LSHIFT;
+        case SC_RSHIFT: return KBD_MOD_RSHIFT;
+        case SC_CTRL: return KBD_MOD_LCTRL;
+        case KBD_EXT(SC_CTRL): return KBD_MOD_RCTRL;
+        case SC_ALT: return KBD_MOD_LALT;
+        case KBD_EXT(SC_ALT): return KBD_MOD_RALT;
+        default: return 0;
+    }
+}
 
-    bool is_break = (scancode & 0x80) != 0;
-    uint8_t code = scancode & 0x7F;
+static void push_event(uint64_t tsc, uint16_t scancode, bool released) {
+    uint32_t head = g_head;
 
-    if (is_break) {
-        switch (code) {
-            case 0x2A:
-                left_shift = false;
-                break;
-            case 0x36:
-                right_shift = false;
-                break;
-        }
-    }
-    else {
-        switch (code) {
-            case 0x2A:
-                left_shift = true;
-                break;
-            case 0x36:
-                right_shift = true;
-                break;
-
-            case 0x3A:
-                caps_lock = !caps_lock;
-                break;
-
-            default:
-                last_scancode = scancode;
-                key_pressed = true;
-                break;
-        }
+    if (head - __atomic_load_n(&g_tail, __ATOMIC_ACQUIRE) == KBD_RING_SIZE) {
+        g_stats.dropped++;
+        return;
     }
 
-    lapic_eoi();
+    struct key_event *ev = &g_ring[head & KBD_RING_MASK];
+    ev->tsc = tsc;
+    ev->scancode = scancode;
+    ev->modifiers = g_modifiers;
+    ev->released = released;
+    ev->ch = released ? 0 : get_char_from_scancode(scancode, g_modifiers);
+
+    __atomic_store_n(&g_head, head + 1, __ATOMIC_RELEASE);
+    g_stats.events++;
+    idle_wake(IDLE_WAKE_KEYBOARD);
 }
 
-extern void keyboard_isr(void);
+static void keyboard_irq(void *ctx) {
+    uint64_t tsc = rdtsc();
+    uint8_t byte = inb(0x60);
+    trace(TRACE_KEYBOARD, byte, g_extended);
 
-void keyboard_init(void) {
-    ioapic_set_irq(
-        1,
-        0x21,
-        false,
-        false,
-        IOREDTBL_DELMODE_FIXED,
-        0
-    );
-    serial_puts("PS/2 keyboard driver initialized\n");
+    if (g_pause_skip) {
+        g_pause_skip--;
+    }
+    else if (byte == SC_EXTENDED) {
+        g_extended = true;
+    }
+    else if (byte == SC_PAUSE) {
+        g_pause_skip = 5;
+    }
+    else {
+        bool released = (byte & SC_BREAK) != 0;
+        uint16_t scancode = byte & 0x7F;
+        if (g_extended) scancode = KBD_EXT(scancode);
+        g_extended = false;
+
+        // E0 2A / E0 36 are fake shifts around PrtSc and the navigation keys
+        bool fake_shift = scancode == KBD_EXT(SC_LSHIFT) || scancode == KBD_EXT(SC_RSHIFT);
+        uint8_t mod = modifier_bit(scancode);
+
+        if (mod) {
+            if (released) g_modifiers &= ~mod;
+            else g_modifiers |= mod;
+        }
+        else if (scancode == SC_CAPS && !released) {
+            g_modifiers ^= KBD_MOD_CAPS;
+        }
+
+        if (!fake_shift) {
+            push_event(tsc, scancode, released);
+        }
+    }
 }
 
-bool keyboard_has_data(void) {
-    return key_pressed;
+void keyboard_init(void) {
+    request_irq(1, keyboard_irq, NULL);
+    g_stats.latency_min_tsc = UINT64_MAX;
+    klog_color(KLOG_INFO, COL_SUCCESS_INIT, "PS/2 keyboard driver initialized");
 }
 
-uint8_t keyboard_get_scancode(void) {
-    key_pressed = false;
-    return last_scancode;
+bool keyboard_has_event(void) {
+    return __atomic_load_n(&g_head, __ATOMIC_ACQUIRE) != g_tail;
 }
 
-char keyboard_get_char(void) {
-    if (!key_pressed) {
-        return 0;
+bool keyboard_read_event(struct key_event *ev) {
+    uint32_t tail = g_tail;
+    if (__atomic_load_n(&g_head, __ATOMIC_ACQUIRE) == tail) {
+        return false;
     }
 
-    uint8_t sc = last_scancode;
-    bool is_make = (sc < 0x80);
+    *ev = g_ring[tail & KBD_RING_MASK];
+    __atomic_store_n(&g_tail, tail + 1, __ATOMIC_RELEASE);
 
-    if (!is_make) {
-        key_pressed = false;
-        return 0;
-    }
+    uint64_t latency = rdtsc() - ev->tsc;
+    g_stats.handled++;
+    g_stats.latency_total_tsc += latency;
+    if (latency < g_stats.latency_min_tsc) g_stats.latency_min_tsc = latency;
+    if (latency > g_stats.latency_max_tsc) g_stats.latency_max_tsc = latency;
 
-    uint8_t code = sc & 0x7F;
-    char ch = get_char_from_scancode(code);
+    return true;
+}
 
-    key_pressed = false;
+void keyboard_wait_event(struct key_event *ev) {
+    for (;;) {
+        uint64_t flags = irq_save();
+        if (keyboard_read_event(ev)) {
+            irq_restore(flags);
+            return;
+        }
+        // sti takes effect after the next instruction, so an IRQ arriving
+        // now is taken in the hlt and wakes it
+        sti_hlt();
+        irq_restore(flags);
+    }
+}
 
-    return ch;
-}
\ No newline at end of file
+void keyboard_get_stats(struct keyboard_stats *out) {
+    uint64_t flags = irq_save();
+    *out = g_stats;
+    irq_restore(flags);
+    if (!out->handled) out->latency_min_tsc = 0;
+}
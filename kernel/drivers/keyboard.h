@@ -4,9 +4,64 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+// PS/2 set 1 keyboard. The IRQ handler decodes every byte into a key event
+// and pushes it into a single-producer/single-consumer ring; nothing is
+// lost unless the ring fills up, which is counted.
+
+#define KBD_RING_SIZE 128       // events, power of two
+
+// modifier state at the time of the event
+#define KBD_MOD_LSHIFT  (1u << 0)
+#define KBD_MOD_RSHIFT  (1u << 1)
+#define KBD_MOD_LCTRL   (1u << 2)
+#define KBD_MOD_RCTRL   (1u << 3)
+#define KBD_MOD_LALT    (1u << 4)
+#define KBD_MOD_RALT    (1u << 5)
+#define KBD_MOD_CAPS    (1u << 6)
+#define KBD_MOD_SHIFT   (KBD_MOD_LSHIFT | KBD_MOD_RSHIFT)
+#define KBD_MOD_CTRL    (KBD_MOD_LCTRL | KBD_MOD_RCTRL)
+#define KBD_MOD_ALT     (KBD_MOD_LALT | KBD_MOD_RALT)
+
+// scancodes of extended keys carry the 0xE0 prefix in the high byte
+#define KBD_EXT(code)   (0xE000 | (code))
+#define KEY_UP          KBD_EXT(0x48)
+#define KEY_DOWN        KBD_EXT(0x50)
+#define KEY_LEFT        KBD_EXT(0x4B)
+#define KEY_RIGHT       KBD_EXT(0x4D)
+#define KEY_HOME        KBD_EXT(0x47)
+#define KEY_END         KBD_EXT(0x4F)
+#define KEY_PAGE_UP     KBD_EXT(0x49)
+#define KEY_PAGE_DOWN   KBD_EXT(0x51)
+#define KEY_INSERT      KBD_EXT(0x52)
+#define KEY_DELETE      KBD_EXT(0x53)
+
+struct key_event {
+    uint64_t tsc;           // read in the interrupt handler
+    uint16_t scancode;      // make code, KBD_EXT() for 0xE0 keys
+    char ch;                // ASCII, 0 for keys without one and for releases
+    uint8_t modifiers;      // KBD_MOD_*
+    bool released;
+};
+
+struct keyboard_stats {
+    uint64_t events;
+    uint64_t dropped;           // ring full
+    uint64_t handled;           // events taken by a reader
+    uint64_t latency_min_tsc;   // interrupt to keyboard_read_event()
+    uint64_t latency_max_tsc;
+    uint64_t latency_total_tsc;
+};
+
 void keyboard_init(void);
-bool keyboard_has_data(void);
-uint8_t keyboard_get_scancode(void);
-char keyboard_get_char(void);
 
-#endif
\ No newline at end of file
+// non-blocking: false when no event is queued
+bool keyboard_read_event(struct key_event *ev);
+// Sleeps with hlt until an event arrives. Any interrupt wakes the CPU; the
+// ring is rechecked with interrupts off before sleeping again, so a key
+// pressed between the check and the hlt is not missed.
+void keyboard_wait_event(struct key_event *ev);
+bool keyboard_has_event(void);
+
+void keyboard_get_stats(struct keyboard_stats *out);
+
+#endif
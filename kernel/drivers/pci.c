@@ -0,0 +1,139 @@
+#include <drivers/pci.h>
+#include <arch/x86_64/io.h>
+#include <klib/printf.h>
+
+#define PCI_CONFIG_ADDRESS 0xCF8
+#define PCI_CONFIG_DATA    0xCFC
+
+static struct pci_device g_devices[PCI_MAX_DEVICES];
+static size_t g_device_count = 0;
+static bool g_scanned = false;
+
+static inline uint32_t pci_address(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset)
+{
+    return (1u << 31) | ((uint32_t)bus << 16) | ((uint32_t)slot << 11) |
+           ((uint32_t)func << 8) | (offset & 0xFC);
+}
+
+static uint32_t pci_read32_bdf(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset)
+{
+    outl(pci_address(bus, slot, func, offset), PCI_CONFIG_ADDRESS);
+    return inl(PCI_CONFIG_DATA);
+}
+
+uint32_t pci_read32(const struct pci_device *dev, uint8_t offset)
+{
+    return pci_read32_bdf(dev->bus, dev->slot, dev->func, offset);
+}
+
+uint16_t pci_read16(const struct pci_device *dev, uint8_t offset)
+{
+    return (uint16_t)(pci_read32(dev, offset) >> ((offset & 2) * 8));
+}
+
+uint8_t pci_read8(const struct pci_device *dev, uint8_t offset)
+{
+    return (uint8_t)(pci_read32(dev, offset) >> ((offset & 3) * 8));
+}
+
+void pci_write32(const struct pci_device *dev, uint8_t offset, uint32_t value)
+{
+    outl(pci_address(dev->bus, dev->slot, dev->func, offset), PCI_CONFIG_ADDRESS);
+    outl(value, PCI_CONFIG_DATA);
+}
+
+void pci_write16(const struct pci_device *dev, uint8_t offset, uint16_t value)
+{
+    uint32_t old = pci_read32(dev, offset);
+    uint32_t shift = (offset & 2) * 8;
+    pci_write32(dev, offset, (old & ~(0xFFFFu << shift)) | ((uint32_t)value << shift));
+}
+
+static void pci_add(uint8_t bus, uint8_t slot, uint8_t func, uint32_t id)
+{
+    if (g_device_count == PCI_MAX_DEVICES) return;
+
+    struct pci_device *dev = &g_devices[g_device_count++];
+    dev->bus = bus;
+    dev->slot = slot;
+    dev->func = func;
+    dev->vendor = (uint16_t)id;
+    dev->device = (uint16_t)(id >> 16);
+
+    uint32_t class = pci_read32(dev, PCI_CLASS_REVISION);
+    dev->class_code = (uint8_t)(class >> 24);
+    dev->subclass = (uint8_t)(class >> 16);
+    dev->prog_if = (uint8_t)(class >> 8);
+}
+
+void pci_init(void)
+{
+    if (g_scanned) return;
+    g_scanned = true;
+
+    for (unsigned bus = 0; bus < 256; bus++) {
+        for (uint8_t slot = 0; slot < 32; slot++) {
+            uint32_t id = pci_read32_bdf((uint8_t)bus, slot, 0, PCI_VENDOR_ID);
+            if ((id & 0xFFFF) == 0xFFFF) continue;
+
+            pci_add((uint8_t)bus, slot, 0, id);
+
+            uint8_t header = (uint8_t)(pci_read32_bdf((uint8_t)bus, slot, 0, 0x0C) >> 16);
+            if (!(header & 0x80)) continue;
+
+            for (uint8_t func = 1; func < 8; func++) {
+                id = pci_read32_bdf((uint8_t)bus, slot, func, PCI_VENDOR_ID);
+                if ((id & 0xFFFF) != 0xFFFF) {
+                    pci_add((uint8_t)bus, slot, func, id);
+                }
+            }
+        }
+    }
+
+    kprintf("pci: %zu functions\n", g_device_count);
+    for (size_t i = 0; i < g_device_count; i++) {
+        const struct pci_device *d = &g_devices[i];
+        kprintf("pci: %02x:%02x.%x %04x:%04x class %02x.%02x\n",
+                d->bus, d->slot, d->func, d->vendor, d->device, d->class_code, d->subclass);
+    }
+}
+
+size_t pci_device_count(void)
+{
+    return g_device_count;
+}
+
+const struct pci_device *pci_get_device(size_t index)
+{
+    return index < g_device_count ? &g_devices[index] : NULL;
+}
+
+const struct pci_device *pci_find_device(uint16_t vendor, uint16_t device)
+{
+    for (size_t i = 0; i < g_device_count; i++) {
+        if (g_devices[i].vendor == vendor && g_devices[i].device == device) {
+            return &g_devices[i];
+        }
+    }
+    return NULL;
+}
+
+uint64_t pci_bar_address(const struct pci_device *dev, uint8_t bar)
+{
+    if (bar > 5) return 0;
+
+    uint32_t low = pci_read32(dev, PCI_BAR0 + bar * 4);
+    if (low & 1) return 0;
+
+    uint64_t addr = low & ~0xFULL;
+    if (((low >> 1) & 3) == 2 && bar < 5) {
+        addr |= (uint64_t)pci_read32(dev, PCI_BAR0 + (bar + 1) * 4) << 32;
+    }
+    return addr;
+}
+
+void pci_enable_bus_master(const struct pci_device *dev)
+{
+    uint16_t cmd = pci_read16(dev, PCI_COMMAND);
+    pci_write16(dev, PCI_COMMAND, cmd | PCI_COMMAND_MEMORY | PCI_COMMAND_MASTER);
+}
@@ -0,0 +1,57 @@
+#ifndef ESTELLA_DRIVERS_PCI_H
+#define ESTELLA_DRIVERS_PCI_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+// PCI configuration access through the legacy 0xCF8/0xCFC ports, which
+// every PC chipset (and QEMU i440fx/q35) provides.
+
+#define PCI_MAX_DEVICES 64
+
+#define PCI_VENDOR_ID      0x00
+#define PCI_DEVICE_ID      0x02
+#define PCI_COMMAND        0x04
+#define PCI_STATUS         0x06
+#define PCI_CLASS_REVISION 0x08
+#define PCI_HEADER_TYPE    0x0E
+#define PCI_BAR0           0x10
+#define PCI_CAP_PTR        0x34
+
+#define PCI_COMMAND_IO     0x0001
+#define PCI_COMMAND_MEMORY 0x0002
+#define PCI_COMMAND_MASTER 0x0004
+
+#define PCI_STATUS_CAP_LIST 0x0010
+
+#define PCI_CAP_ID_VENDOR  0x09
+
+struct pci_device {
+    uint8_t bus;
+    uint8_t slot;
+    uint8_t func;
+    uint16_t vendor;
+    uint16_t device;
+    uint8_t class_code;
+    uint8_t subclass;
+    uint8_t prog_if;
+};
+
+uint32_t pci_read32(const struct pci_device *dev, uint8_t offset);
+uint16_t pci_read16(const struct pci_device *dev, uint8_t offset);
+uint8_t pci_read8(const struct pci_device *dev, uint8_t offset);
+void pci_write32(const struct pci_device *dev, uint8_t offset, uint32_t value);
+void pci_write16(const struct pci_device *dev, uint8_t offset, uint16_t value);
+
+// scans every bus once, later calls return the cached list
+void pci_init(void);
+size_t pci_device_count(void);
+const struct pci_device *pci_get_device(size_t index);
+const struct pci_device *pci_find_device(uint16_t vendor, uint16_t device);
+
+// physical address of a memory BAR (64-bit BARs span two slots), 0 for I/O BARs
+uint64_t pci_bar_address(const struct pci_device *dev, uint8_t bar);
+void pci_enable_bus_master(const struct pci_device *dev);
+
+#endif
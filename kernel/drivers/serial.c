@@ -1,7 +1,78 @@
 #include <drivers/serial.h>
+#include <log/logring.h>
+#include <arch/x86_64/irq.h>
+#include <arch/x86_64/cpu.h>
+#include <arch/x86_64/idle.h>
+#include <klib/printf.h>
 #include <stdint.h>
 
 #define COM1_PORT 0x3F8
+#define COM1_IRQ  4
+
+#define UART_THR 0      // transmit holding register (write)
+#define UART_RBR 0      // receive buffer (read)
+#define UART_DLL 0      // divisor latch, with LCR.DLAB set
+#define UART_DLM 1
+#define UART_IER 1      // interrupt enable
+#define UART_IIR 2      // interrupt identification (read)
+#define UART_FCR 2      // FIFO control (write)
+#define UART_LCR 3
+#define UART_MCR 4
+#define UART_LSR 5
+#define UART_MSR 6
+
+#define IER_RDI       0x01    // received data available / character timeout
+#define IER_THRI      0x02    // interrupt when the transmitter is empty
+#define IER_RLSI      0x04    // receiver line status
+#define IIR_NO_INT    0x01
+#define IIR_ID_MASK   0x0E
+#define IIR_MSI       0x00
+#define IIR_THRE      0x02
+#define IIR_RDI       0x04
+#define IIR_RLSI      0x06
+#define IIR_TIMEOUT   0x0C    // bytes below the trigger level sat in the FIFO for 4 char times
+#define LCR_8N1       0x03
+#define LCR_DLAB      0x80
+#define FCR_ENABLE    0x01
+#define FCR_CLEAR     0x06    // reset both FIFOs
+#define MCR_DTR_RTS_OUT2 0x0B // OUT2 gates the UART interrupt line on PCs
+#define LSR_DR        0x01
+#define LSR_OE        0x02
+#define LSR_THRE      0x20
+#define LSR_TEMT      0x40
+
+#define UART_CLOCK_BAUD 115200  // divisor 1
+
+#define UART_FIFO_SIZE 16
+
+// Bytes waiting for the UART. Filled by serial_write() with interrupts off,
+// emptied FIFO-sized chunks at a time by the THRE interrupt.
+#define SERIAL_TX_SIZE 4096
+
+static uint8_t g_tx_ring[SERIAL_TX_SIZE];
+static size_t g_tx_head = 0;    // next byte to queue
+static size_t g_tx_tail = 0;    // next byte to send
+static bool g_tx_irq = false;   // interrupt-driven; false = poll every byte
+static bool g_tx_active = false;
+
+static struct serial_stats g_stats;
+
+static uint32_t g_baud = SERIAL_DEFAULT_BAUD;
+static uint8_t g_rx_trigger = 14;
+static uint8_t g_ier = 0;       // RX bits, plus THRI while transmitting
+
+// Received bytes, filled by the interrupt handler and consumed by
+// serial_read() / serial_poll_line() outside interrupt context.
+#define SERIAL_RX_SIZE 1024
+
+static uint8_t g_rx_ring[SERIAL_RX_SIZE];
+static volatile size_t g_rx_head = 0;
+static volatile size_t g_rx_tail = 0;
+
+// line discipline state for serial_poll_line()
+static char g_line[SERIAL_LINE_MAX];
+static size_t g_line_len = 0;
+static bool g_line_echo = true;
 
 static void outb(uint16_t port, uint8_t val) {
     asm volatile("outb %0, %1" : : "a"(val), "Nd"(port) : "memory");
@@ -13,24 +84,290 @@ static uint8_t inb(uint16_t port) {
     return ret;
 }
 
+
+void serial_putc(char c) {
+    while (!(inb(COM1_PORT + UART_LSR) & LSR_THRE));
+    outb(COM1_PORT + UART_THR, c);
+}
+
+static inline size_t tx_used(void) {
+    return g_tx_head - g_tx_tail;
+}
+
+// Moves up to one FIFO load from the ring to the UART. The FIFO is empty
+// whenever THRE is set, so no per-byte status poll is needed.
+static size_t tx_fill_fifo(void) {
+    if (!(inb(COM1_PORT + UART_LSR) & LSR_THRE)) return 0;
+
+    size_t n = tx_used();
+    if (n > UART_FIFO_SIZE) n = UART_FIFO_SIZE;
+
+    for (size_t i = 0; i < n; i++) {
+        outb(COM1_PORT + UART_THR, g_tx_ring[(g_tx_tail + i) % SERIAL_TX_SIZE]);
+    }
+    g_tx_tail += n;
+    return n;
+}
+
+static void tx_stop(void) {
+    g_tx_active = false;
+    outb(COM1_PORT + UART_IER, g_ier);
+}
+
+static uint8_t fcr_trigger_bits(uint8_t level) {
+    switch (level) {
+        case 1:  return 0x00;
+        case 4:  return 0x40;
+        case 8:  return 0x80;
+        default: return 0xC0;
+    }
+}
+
+static void uart_program(void) {
+    uint16_t divisor = (uint16_t)(UART_CLOCK_BAUD / g_baud);
+
+    outb(COM1_PORT + UART_IER, 0x00);
+    outb(COM1_PORT + UART_LCR, LCR_DLAB);
+    outb(COM1_PORT + UART_DLL, (uint8_t)divisor);
+    outb(COM1_PORT + UART_DLM, (uint8_t)(divisor >> 8));
+    outb(COM1_PORT + UART_LCR, LCR_8N1);
+    outb(COM1_PORT + UART_FCR, FCR_ENABLE | FCR_CLEAR | fcr_trigger_bits(g_rx_trigger));
+    outb(COM1_PORT + UART_MCR, MCR_DTR_RTS_OUT2);
+    outb(COM1_PORT + UART_IER, g_ier);
+}
+
 void serial_init(void) {
-    outb(COM1_PORT + 1, 0x00);
-    outb(COM1_PORT + 3, 0x80);
-    outb(COM1_PORT + 0, 0x03);
-    outb(COM1_PORT + 1, 0x00);
-    outb(COM1_PORT + 3, 0x03);
-    outb(COM1_PORT + 2, 0xC7);
-    outb(COM1_PORT + 4, 0x0B);
+    uart_program();
 }
 
-void serial_putc(char c) {
-    while (!(inb(COM1_PORT + 5) & 0x20));
-    outb(COM1_PORT, c);
+bool serial_configure(uint32_t baud, uint8_t rx_trigger) {
+    if (!baud || baud > UART_CLOCK_BAUD || UART_CLOCK_BAUD % baud) return false;
+    if (rx_trigger != 1 && rx_trigger != 4 && rx_trigger != 8 && rx_trigger != 14) return false;
+
+    uint64_t flags = irq_save();
+
+    // let the shift register empty so nothing goes out at a half-set rate
+    while (tx_used() && g_tx_irq) {
+        while (!(inb(COM1_PORT + UART_LSR) & LSR_THRE));
+        tx_fill_fifo();
+    }
+    while (!(inb(COM1_PORT + UART_LSR) & LSR_TEMT));
+
+    g_baud = baud;
+    g_rx_trigger = rx_trigger;
+    uart_program();
+    g_tx_active = false;
+
+    irq_restore(flags);
+    return true;
 }
 
-void serial_puts(const char *s) {
-    while (*s) {
-        if (*s == '\n') serial_putc('\r');
-        serial_putc(*s++);
+uint32_t serial_get_baud(void) {
+    return g_baud;
+}
+
+uint8_t serial_get_rx_trigger(void) {
+    return g_rx_trigger;
+}
+
+static void rx_drain_fifo(void) {
+    uint8_t lsr;
+    size_t n = 0;
+
+    while ((lsr = inb(COM1_PORT + UART_LSR)) & LSR_DR) {
+        uint8_t c = inb(COM1_PORT + UART_RBR);
+        n++;
+
+        if (lsr & LSR_OE) g_stats.rx_overruns++;
+
+        if (g_rx_head - g_rx_tail == SERIAL_RX_SIZE) {
+            g_stats.rx_dropped++;
+            continue;
+        }
+        g_rx_ring[g_rx_head % SERIAL_RX_SIZE] = c;
+        g_rx_head++;
+    }
+
+    g_stats.rx_bytes += n;
+    if (n > g_stats.rx_batch_max) g_stats.rx_batch_max = n;
+}
+
+static void serial_irq(void *ctx) {
+    uint8_t iir;
+
+    while (!((iir = inb(COM1_PORT + UART_IIR)) & IIR_NO_INT)) {
+        switch (iir & IIR_ID_MASK) {
+            case IIR_RDI:
+            case IIR_TIMEOUT:
+                g_stats.rx_interrupts++;
+                rx_drain_fifo();
+                idle_wake(IDLE_WAKE_SERIAL);
+                continue;
+            case IIR_RLSI:
+                if (inb(COM1_PORT + UART_LSR) & LSR_OE) g_stats.rx_overruns++;
+                continue;
+            case IIR_MSI:
+                inb(COM1_PORT + UART_MSR);
+                continue;
+        }
+
+        size_t n = tx_fill_fifo();
+        g_stats.tx_interrupts++;
+        g_stats.tx_irq_bytes += n;
+        if (n > g_stats.tx_batch_max) g_stats.tx_batch_max = n;
+
+        if (!tx_used()) {
+            tx_stop();
+            // a log drain that stopped on a full ring can go on
+            idle_wake(IDLE_WAKE_SERIAL);
+        }
+    }
+}
+
+static inline void tx_queue(uint8_t c) {
+    if (tx_used() == SERIAL_TX_SIZE) {
+        g_stats.tx_dropped++;
+        return;
+    }
+    g_tx_ring[g_tx_head++ % SERIAL_TX_SIZE] = c;
+    g_stats.tx_queued++;
+}
+
+void serial_write(const char *s, size_t len) {
+    if (!g_tx_irq) {
+        for (size_t i = 0; i < len; i++) {
+            if (s[i] == '\n') serial_putc('\r');
+            serial_putc(s[i]);
+        }
+        g_stats.tx_polled += len;
+        return;
+    }
+
+    uint64_t flags = irq_save();
+
+    for (size_t i = 0; i < len; i++) {
+        if (s[i] == '\n') tx_queue('\r');
+        tx_queue((uint8_t)s[i]);
+    }
+
+    // the UART raises THRE as soon as the interrupt is enabled with an
+    // empty FIFO, which starts the first batch
+    if (!g_tx_active && tx_used()) {
+        g_tx_active = true;
+        outb(COM1_PORT + UART_IER, g_ier | IER_THRI);
     }
-}
\ No newline at end of file
+
+    irq_restore(flags);
+}
+
+size_t serial_tx_space(void) {
+    if (!g_tx_irq) return SIZE_MAX;
+    return SERIAL_TX_SIZE - tx_used();
+}
+
+void serial_flush(void) {
+    while (g_tx_irq && __atomic_load_n(&g_tx_head, __ATOMIC_RELAXED) != __atomic_load_n(&g_tx_tail, __ATOMIC_RELAXED)) {
+        asm volatile("pause");
+    }
+}
+
+void serial_enable_irq(void) {
+    request_irq(COM1_IRQ, serial_irq, NULL);
+    g_tx_irq = true;
+
+    g_ier = IER_RDI | IER_RLSI;
+    outb(COM1_PORT + UART_IER, g_ier);
+
+    kprintf("serial: %u baud, interrupt-driven, %u byte TX ring, %u byte RX ring, RX trigger %u\n",
+            g_baud, SERIAL_TX_SIZE, SERIAL_RX_SIZE, g_rx_trigger);
+}
+
+size_t serial_read(char *buf, size_t size) {
+    size_t n = 0;
+
+    while (n < size && g_rx_tail != g_rx_head) {
+        buf[n++] = (char)g_rx_ring[g_rx_tail % SERIAL_RX_SIZE];
+        g_rx_tail++;
+    }
+
+    return n;
+}
+
+void serial_set_echo(bool echo) {
+    g_line_echo = echo;
+}
+
+static void echo(const char *s, size_t len) {
+    if (g_line_echo) serial_write(s, len);
+}
+
+bool serial_poll_line(char *buf, size_t size) {
+    char c;
+
+    while (serial_read(&c, 1)) {
+        switch (c) {
+            case '\r':
+            case '\n': {
+                // a CR LF pair from a terminal is one line end
+                echo("\n", 1);
+                size_t len = g_line_len < size - 1 ? g_line_len : size - 1;
+                for (size_t i = 0; i < len; i++) buf[i] = g_line[i];
+                buf[len] = '\0';
+                g_line_len = 0;
+                if (c == '\r' && g_rx_tail != g_rx_head &&
+                    g_rx_ring[g_rx_tail % SERIAL_RX_SIZE] == '\n') {
+                    g_rx_tail++;
+                }
+                return true;
+            }
+            case '\b':
+            case 0x7F:
+                if (g_line_len) {
+                    g_line_len--;
+                    echo("\b \b", 3);
+                }
+                break;
+            case 0x15:  // ^U: discard the line
+                while (g_line_len) {
+                    g_line_len--;
+                    echo("\b \b", 3);
+                }
+                break;
+            default:
+                if ((uint8_t)c >= 0x20 && g_line_len < SERIAL_LINE_MAX - 1) {
+                    g_line[g_line_len++] = c;
+                    echo(&c, 1);
+                }
+                break;
+        }
+    }
+
+    return false;
+}
+
+void serial_panic(void) {
+    if (!g_tx_irq) return;
+
+    uint64_t flags = irq_save();
+
+    g_tx_irq = false;
+    g_ier = 0;
+    tx_stop();
+    while (tx_used()) {
+        // the handler may have been interrupted mid-batch; wait for the FIFO
+        while (!(inb(COM1_PORT + UART_LSR) & LSR_THRE));
+        tx_fill_fifo();
+    }
+
+    irq_restore(flags);
+}
+
+void serial_get_stats(struct serial_stats *out) {
+    uint64_t flags = irq_save();
+    *out = g_stats;
+    irq_restore(flags);
+}
+
+void serial_puts(const char *s) {
+    logring_puts(s, 0, LOG_SINK_SERIAL);
+}
@@ -1,8 +1,61 @@
 #ifndef ESTELLA_DRIVERS_SERIAL_H
 #define ESTELLA_DRIVERS_SERIAL_H
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// set with `make SERIAL_BAUD=...`, overridden by serial.baud= on the cmdline
+#ifndef SERIAL_DEFAULT_BAUD
+#define SERIAL_DEFAULT_BAUD 115200
+#endif
+
+// longest line serial_poll_line() assembles
+#define SERIAL_LINE_MAX 128
+
+struct serial_stats {
+    uint64_t tx_queued;         // bytes put in the transmit ring
+    uint64_t tx_dropped;        // bytes lost to a full ring
+    uint64_t tx_polled;         // bytes sent synchronously
+    uint64_t tx_interrupts;     // THRE interrupts that sent a batch
+    uint64_t tx_irq_bytes;      // bytes sent from the interrupt handler
+    uint64_t tx_batch_max;      // largest batch, at most the 16-byte FIFO
+    uint64_t rx_bytes;
+    uint64_t rx_dropped;        // RX ring full
+    uint64_t rx_overruns;       // UART FIFO overflowed before we read it
+    uint64_t rx_interrupts;
+    uint64_t rx_batch_max;      // most bytes taken from the FIFO in one interrupt
+};
+
 void serial_init(void);
+// Reprogram the line: baud must divide 115200, rx_trigger is the FIFO fill
+// level (1, 4, 8 or 14 bytes) that raises the receive interrupt.
+bool serial_configure(uint32_t baud, uint8_t rx_trigger);
+uint32_t serial_get_baud(void);
+uint8_t serial_get_rx_trigger(void);
 void serial_putc(char c);
+// queued through the log ring, see log/logring.h
 void serial_puts(const char *s);
+// Writes to the UART, expanding '\n' to "\r\n". Polls per byte until
+// serial_enable_irq(); afterwards queues into the transmit ring.
+void serial_write(const char *s, size_t len);
+// bytes serial_write() can take without dropping, SIZE_MAX while polling
+size_t serial_tx_space(void);
+// waits until the transmit ring is empty; needs interrupts enabled
+void serial_flush(void);
+
+// route COM1 through the IOAPIC and transmit from the THRE interrupt
+void serial_enable_irq(void);
+// send whatever is queued by polling and stay synchronous from now on
+void serial_panic(void);
+
+// raw received bytes, returns how many were copied
+size_t serial_read(char *buf, size_t size);
+// Line discipline over serial_read(): echo, backspace, ^U, CR/LF/CRLF line
+// ends. Returns true with a NUL-terminated line in buf once one is complete.
+bool serial_poll_line(char *buf, size_t size);
+void serial_set_echo(bool echo);
+
+void serial_get_stats(struct serial_stats *out);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,448 @@
+#include <drivers/virtio_console.h>
+#include <drivers/pci.h>
+#include <drivers/serial.h>
+#include <arch/x86_64/apic.h>
+#include <arch/x86_64/cpu.h>
+#include <mm/pmm.h>
+#include <mm/vmm.h>
+#include <klib/memory.h>
+#include <klib/printf.h>
+
+#define VIRTIO_VENDOR               0x1AF4
+#define VIRTIO_DEV_CONSOLE_LEGACY   0x1003  // transitional, still has the modern capabilities
+#define VIRTIO_DEV_CONSOLE          0x1043
+
+// virtio_pci_cap.cfg_type
+#define VIRTIO_PCI_CAP_COMMON_CFG   1
+#define VIRTIO_PCI_CAP_NOTIFY_CFG   2
+
+#define VIRTIO_STATUS_ACKNOWLEDGE   0x01
+#define VIRTIO_STATUS_DRIVER        0x02
+#define VIRTIO_STATUS_DRIVER_OK     0x04
+#define VIRTIO_STATUS_FEATURES_OK   0x08
+#define VIRTIO_STATUS_FAILED        0x80
+
+#define VIRTIO_F_VERSION_1          32
+
+#define VIRTQ_AVAIL_F_NO_INTERRUPT  1
+
+// port 0 queues; without VIRTIO_CONSOLE_F_MULTIPORT there are only these two
+#define VIRTIO_CONSOLE_TXQ          1
+
+#define VIRTQ_SIZE_MAX 64
+
+// virtio 1.x common configuration, at cfg_type 1
+struct virtio_pci_common_cfg {
+    uint32_t device_feature_select;
+    uint32_t device_feature;
+    uint32_t driver_feature_select;
+    uint32_t driver_feature;
+    uint16_t msix_config;
+    uint16_t num_queues;
+    uint8_t device_status;
+    uint8_t config_generation;
+    uint16_t queue_select;
+    uint16_t queue_size;
+    uint16_t queue_msix_vector;
+    uint16_t queue_enable;
+    uint16_t queue_notify_off;
+    uint64_t queue_desc;
+    uint64_t queue_driver;
+    uint64_t queue_device;
+};
+
+struct virtq_desc {
+    uint64_t addr;
+    uint32_t len;
+    uint16_t flags;
+    uint16_t next;
+};
+
+struct virtq_avail {
+    uint16_t flags;
+    uint16_t idx;
+    uint16_t ring[VIRTQ_SIZE_MAX];
+};
+
+struct virtq_used_elem {
+    uint32_t id;
+    uint32_t len;
+};
+
+struct virtq_used {
+    uint16_t flags;
+    uint16_t idx;
+    struct virtq_used_elem ring[VIRTQ_SIZE_MAX];
+};
+
+// the whole split ring lives in one page
+#define VIRTQ_AVAIL_OFFSET 1024
+#define VIRTQ_USED_OFFSET  2048
+
+_Static_assert(sizeof(struct virtq_desc) * VIRTQ_SIZE_MAX <= VIRTQ_AVAIL_OFFSET, "descriptor table overlaps avail ring");
+_Static_assert(VIRTQ_AVAIL_OFFSET + sizeof(struct virtq_avail) <= VIRTQ_USED_OFFSET, "avail ring overlaps used ring");
+_Static_assert(VIRTQ_USED_OFFSET + sizeof(struct virtq_used) <= PAGE_SIZE, "virtqueue does not fit a page");
+
+static volatile struct virtio_pci_common_cfg *g_common;
+static volatile uint16_t *g_notify;
+
+static struct virtq_desc *g_desc;
+static volatile struct virtq_avail *g_avail;
+static volatile struct virtq_used *g_used;
+static uint16_t g_queue_size;
+static uint16_t g_avail_idx;        // next avail slot, published on flush
+static uint16_t g_notified_idx;     // avail idx the device was last told about
+static uint16_t g_used_idx;         // next used entry to reclaim
+
+// staging buffer i is always described by descriptor i
+static char *g_buf[VIRTIO_CONSOLE_BUFFERS];
+static uint64_t g_buf_phys[VIRTIO_CONSOLE_BUFFERS];
+static bool g_buf_busy[VIRTIO_CONSOLE_BUFFERS];
+static size_t g_buf_count;
+static int g_fill = -1;             // buffer being filled, -1 = none
+static size_t g_fill_len;
+
+static bool g_present = false;
+static struct virtio_console_stats g_stats;
+
+static void *map_mmio(uint64_t phys, size_t len)
+{
+    uint64_t start = phys & ~(uint64_t)(PAGE_SIZE - 1);
+    uint64_t end = (phys + len + PAGE_SIZE - 1) & ~(uint64_t)(PAGE_SIZE - 1);
+
+    for (uint64_t p = start; p < end; p += PAGE_SIZE) {
+        uint64_t virt = phys_to_virt(p);
+        if (vmm_get_physical(virt) == p) continue;
+        vmm_map(virt, p, PTE_PRESENT | PTE_WRITE | PTE_PCD | PTE_PWT);
+    }
+
+    return (void *)phys_to_virt(phys);
+}
+
+static bool find_caps(const struct pci_device *dev)
+{
+    if (!(pci_read16(dev, PCI_STATUS) & PCI_STATUS_CAP_LIST)) return false;
+
+    uint32_t notify_multiplier = 0;
+    uint64_t notify_base = 0;
+    uint8_t ptr = pci_read8(dev, PCI_CAP_PTR) & 0xFC;
+
+    for (int guard = 0; ptr && guard < 48; guard++) {
+        uint8_t id = pci_read8(dev, ptr);
+        uint8_t next = pci_read8(dev, ptr + 1) & 0xFC;
+
+        if (id == PCI_CAP_ID_VENDOR) {
+            uint8_t type = pci_read8(dev, ptr + 3);
+            uint8_t bar = pci_read8(dev, ptr + 4);
+            uint32_t offset = pci_read32(dev, ptr + 8);
+            uint32_t length = pci_read32(dev, ptr + 12);
+            uint64_t base = pci_bar_address(dev, bar);
+
+            if (base && type == VIRTIO_PCI_CAP_COMMON_CFG && !g_common) {
+                g_common = map_mmio(base + offset, length);
+            } else if (base && type == VIRTIO_PCI_CAP_NOTIFY_CFG && !notify_base) {
+                notify_multiplier = pci_read32(dev, ptr + 16);
+                notify_base = (uint64_t)(uintptr_t)map_mmio(base + offset, length);
+            }
+        }
+        ptr = next;
+    }
+
+    if (!g_common || !notify_base) return false;
+
+    g_common->queue_select = VIRTIO_CONSOLE_TXQ;
+    g_notify = (volatile uint16_t *)(notify_base + (uint64_t)g_common->queue_notify_off * notify_multiplier);
+    return true;
+}
+
+static bool negotiate(void)
+{
+    g_common->device_status = 0;
+    while (g_common->device_status != 0) asm volatile("pause");
+
+    g_common->device_status = VIRTIO_STATUS_ACKNOWLEDGE;
+    g_common->device_status |= VIRTIO_STATUS_DRIVER;
+
+    g_common->device_feature_select = 1;
+    if (!(g_common->device_feature & (1u << (VIRTIO_F_VERSION_1 - 32)))) return false;
+
+    // nothing but VERSION_1: no multiport, no emergency write, no event index
+    g_common->driver_feature_select = 0;
+    g_common->driver_feature = 0;
+    g_common->driver_feature_select = 1;
+    g_common->driver_feature = 1u << (VIRTIO_F_VERSION_1 - 32);
+
+    g_common->device_status |= VIRTIO_STATUS_FEATURES_OK;
+    return (g_common->device_status & VIRTIO_STATUS_FEATURES_OK) != 0;
+}
+
+static bool setup_txq(void)
+{
+    g_common->queue_select = VIRTIO_CONSOLE_TXQ;
+    uint16_t size = g_common->queue_size;
+    if (!size) return false;
+    if (size > VIRTQ_SIZE_MAX) size = VIRTQ_SIZE_MAX;
+    g_common->queue_size = size;
+    g_queue_size = size;
+
+    uint64_t ring_phys = (uint64_t)(uintptr_t)pmm_alloc_zeroed();
+    if (!ring_phys) return false;
+
+    uint8_t *ring = (uint8_t *)phys_to_virt(ring_phys);
+    g_desc = (struct virtq_desc *)ring;
+    g_avail = (volatile struct virtq_avail *)(ring + VIRTQ_AVAIL_OFFSET);
+    g_used = (volatile struct virtq_used *)(ring + VIRTQ_USED_OFFSET);
+
+    // completions are reaped by polling, the device need not interrupt
+    g_avail->flags = VIRTQ_AVAIL_F_NO_INTERRUPT;
+
+    g_buf_count = size < VIRTIO_CONSOLE_BUFFERS ? size : VIRTIO_CONSOLE_BUFFERS;
+    for (size_t i = 0; i < g_buf_count; i++) {
+        void *frames = pmm_alloc_frames(VIRTIO_CONSOLE_BUF_SIZE / PAGE_SIZE);
+        if (!frames) {
+            g_buf_count = i;
+            break;
+        }
+        g_buf_phys[i] = (uint64_t)(uintptr_t)frames;
+        g_buf[i] = (char *)phys_to_virt(g_buf_phys[i]);
+        g_desc[i].addr = g_buf_phys[i];
+    }
+    if (!g_buf_count) return false;
+
+    g_common->queue_desc = ring_phys;
+    g_common->queue_driver = ring_phys + VIRTQ_AVAIL_OFFSET;
+    g_common->queue_device = ring_phys + VIRTQ_USED_OFFSET;
+    g_common->queue_enable = 1;
+    return true;
+}
+
+bool virtio_console_init(void)
+{
+    pci_init();
+
+    const struct pci_device *dev = pci_find_device(VIRTIO_VENDOR, VIRTIO_DEV_CONSOLE);
+    if (!dev) dev = pci_find_device(VIRTIO_VENDOR, VIRTIO_DEV_CONSOLE_LEGACY);
+    if (!dev) return false;
+
+    pci_enable_bus_master(dev);
+
+    if (!find_caps(dev)) {
+        kprintf("virtio-console: no modern virtio-pci capabilities\n");
+        return false;
+    }
+
+    if (!negotiate() || !setup_txq()) {
+        g_common->device_status |= VIRTIO_STATUS_FAILED;
+        kprintf("virtio-console: device setup failed\n");
+        return false;
+    }
+
+    g_common->device_status |= VIRTIO_STATUS_DRIVER_OK;
+    g_present = true;
+
+    kprintf("virtio-console: %02x:%02x.%x, queue size %u, %zu x %u KiB buffers\n",
+            dev->bus, dev->slot, dev->func, g_queue_size, g_buf_count, VIRTIO_CONSOLE_BUF_SIZE / 1024);
+    return true;
+}
+
+bool virtio_console_present(void)
+{
+    return g_present;
+}
+
+static void reclaim(void)
+{
+    uint16_t used = __atomic_load_n(&g_used->idx, __ATOMIC_ACQUIRE);
+
+    while (g_used_idx != used) {
+        uint32_t id = g_used->ring[g_used_idx % g_queue_size].id;
+        if (id < g_buf_count) g_buf_busy[id] = false;
+        g_used_idx++;
+    }
+}
+
+// hand the buffer being filled to the avail ring; the device sees it on the next notify
+static void submit_fill(void)
+{
+    if (g_fill < 0) return;
+
+    if (g_fill_len) {
+        g_desc[g_fill].len = (uint32_t)g_fill_len;
+        g_desc[g_fill].flags = 0;
+        g_avail->ring[g_avail_idx % g_queue_size] = (uint16_t)g_fill;
+        g_avail_idx++;
+        g_buf_busy[g_fill] = true;
+        g_stats.buffers++;
+    }
+
+    g_fill = -1;
+    g_fill_len = 0;
+}
+
+static void notify(void)
+{
+    if (g_notified_idx == g_avail_idx) return;
+
+    // ring entries before the index, the index before the doorbell
+    __atomic_store_n(&g_avail->idx, g_avail_idx, __ATOMIC_RELEASE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    *g_notify = VIRTIO_CONSOLE_TXQ;
+
+    g_notified_idx = g_avail_idx;
+    g_stats.notifications++;
+}
+
+static bool take_buffer(void)
+{
+    reclaim();
+
+    for (size_t i = 0; i < g_buf_count; i++) {
+        if (!g_buf_busy[i]) {
+            g_fill = (int)i;
+            g_fill_len = 0;
+            return true;
+        }
+    }
+    return false;
+}
+
+// before calibration the TSC rate is unknown; assume a slow 1 GHz
+static uint64_t wait_tsc(void)
+{
+    uint64_t hz = tsc_frequency_hz ? tsc_frequency_hz : 1000000000;
+    return hz / 1000000 * VIRTIO_CONSOLE_WAIT_US;
+}
+
+size_t virtio_console_write(const char *s, size_t len)
+{
+    if (!g_present) return 0;
+
+    uint64_t flags = irq_save();
+    size_t done = 0;
+
+    while (done < len) {
+        if (g_fill < 0 && !take_buffer()) {
+            // everything is queued: ring the doorbell and wait for the
+            // device, which in QEMU consumes buffers inside the notify exit
+            notify();
+            uint64_t deadline = rdtsc() + wait_tsc();
+            while (!take_buffer() && rdtsc() < deadline) asm volatile("pause");
+            if (g_fill < 0) {
+                g_stats.dropped_writes++;
+                break;
+            }
+        }
+
+        size_t n = len - done;
+        if (n > VIRTIO_CONSOLE_BUF_SIZE - g_fill_len) n = VIRTIO_CONSOLE_BUF_SIZE - g_fill_len;
+        memcpy(g_buf[g_fill] + g_fill_len, s + done, n);
+        g_fill_len += n;
+        done += n;
+
+        if (g_fill_len == VIRTIO_CONSOLE_BUF_SIZE) submit_fill();
+    }
+
+    g_stats.bytes += done;
+    g_stats.dropped += len - done;
+
+    irq_restore(flags);
+    return done;
+}
+
+size_t virtio_console_tx_space(void)
+{
+    if (!g_present) return 0;
+
+    uint64_t flags = irq_save();
+    reclaim();
+
+    size_t space = g_fill >= 0 ? VIRTIO_CONSOLE_BUF_SIZE - g_fill_len : 0;
+    for (size_t i = 0; i < g_buf_count; i++) {
+        if (!g_buf_busy[i] && (int)i != g_fill) space += VIRTIO_CONSOLE_BUF_SIZE;
+    }
+
+    irq_restore(flags);
+    return space;
+}
+
+void virtio_console_flush(void)
+{
+    if (!g_present) return;
+
+    uint64_t flags = irq_save();
+    submit_fill();
+    notify();
+    irq_restore(flags);
+}
+
+void virtio_console_sync(void)
+{
+    if (!g_present) return;
+
+    virtio_console_flush();
+    for (int spin = 0; spin < 10000000; spin++) {
+        reclaim();
+        if (g_used_idx == g_avail_idx) return;
+        asm volatile("pause");
+    }
+}
+
+void virtio_console_get_stats(struct virtio_console_stats *out)
+{
+    uint64_t flags = irq_save();
+    *out = g_stats;
+    irq_restore(flags);
+}
+
+static uint64_t kib_per_s(size_t bytes, uint64_t tsc)
+{
+    return tsc ? (uint64_t)bytes * tsc_frequency_hz / 1024 / tsc : 0;
+}
+
+void virtio_console_bench(size_t bytes)
+{
+    if (!tsc_frequency_hz) return;
+
+    static const char line[] =
+        "virtio-console bench: 0123456789abcdefghijklmnopqrstuvwxyz ABCDEFGHIJKLMNOPQRSTUVWXYZ\n";
+    const size_t line_len = sizeof(line) - 1;
+    size_t lines = bytes / line_len;
+    if (!lines) lines = 1;
+    bytes = lines * line_len;
+
+    // UART: as many bytes as the transmit ring takes at a time, then wait for
+    // the THRE interrupt to empty it
+    serial_flush();
+    uint64_t t0 = rdtsc();
+    for (size_t i = 0; i < lines; i++) {
+        while (serial_tx_space() < 2 * line_len) asm volatile("pause");
+        serial_write(line, line_len);
+    }
+    serial_flush();
+    uint64_t uart_tsc = rdtsc() - t0;
+
+    kprintf("virtio-console bench: %zu bytes\n", bytes);
+    kprintf("  serial_write:   %lu KiB/s\n", kib_per_s(bytes, uart_tsc));
+    if (!g_present) {
+        kprintf("  virtio-console: not present (QEMU: -device virtio-serial-pci -device virtconsole)\n");
+        return;
+    }
+
+    struct virtio_console_stats before, after;
+    virtio_console_sync();
+    virtio_console_get_stats(&before);
+
+    t0 = rdtsc();
+    for (size_t i = 0; i < lines; i++) {
+        virtio_console_write(line, line_len);
+    }
+    virtio_console_sync();
+    uint64_t virtio_tsc = rdtsc() - t0;
+
+    virtio_console_get_stats(&after);
+
+    kprintf("  virtio-console: %lu KiB/s, %lu buffers, %lu notifications, %lu bytes dropped in %lu writes\n",
+            kib_per_s(bytes, virtio_tsc),
+            after.buffers - before.buffers, after.notifications - before.notifications,
+            after.dropped - before.dropped, after.dropped_writes - before.dropped_writes);
+}
@@ -0,0 +1,48 @@
+#ifndef ESTELLA_DRIVERS_VIRTIO_CONSOLE_H
+#define ESTELLA_DRIVERS_VIRTIO_CONSOLE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// virtio-console (QEMU: -device virtio-serial-pci -device virtconsole) over
+// modern virtio-pci. Output is copied into large staging buffers and the
+// device is notified once per flush rather than once per byte, which makes
+// it a much cheaper log channel than the UART under a hypervisor.
+
+#define VIRTIO_CONSOLE_BUFFERS  8
+#define VIRTIO_CONSOLE_BUF_SIZE (16 * 1024)
+// longest virtio_console_write() waits, interrupts off, for the device to
+// hand a buffer back before it drops the rest of the record
+#define VIRTIO_CONSOLE_WAIT_US  50
+
+struct virtio_console_stats {
+    uint64_t bytes;             // accepted by virtio_console_write()
+    uint64_t buffers;           // staging buffers handed to the device
+    uint64_t notifications;     // doorbell writes, each one a VM exit
+    uint64_t dropped;           // bytes lost because every buffer was busy
+    uint64_t dropped_writes;    // writes cut short after VIRTIO_CONSOLE_WAIT_US
+};
+
+// probes PCI for the device and sets up the transmit queue
+bool virtio_console_init(void);
+bool virtio_console_present(void);
+
+// Copies len bytes into the current staging buffer; full buffers are queued
+// but the device only hears about them on virtio_console_flush(). Returns
+// fewer than len if no buffer came back within VIRTIO_CONSOLE_WAIT_US.
+size_t virtio_console_write(const char *s, size_t len);
+// bytes virtio_console_write() can take right now without waiting
+size_t virtio_console_tx_space(void);
+// queues the partly filled buffer and notifies the device once
+void virtio_console_flush(void);
+// flushes and waits for the device to hand every buffer back
+void virtio_console_sync(void);
+
+void virtio_console_get_stats(struct virtio_console_stats *out);
+
+// pushes the same bytes through serial_write() and the virtio console and
+// reports both rates on serial
+void virtio_console_bench(size_t bytes);
+
+#endif
@@ -0,0 +1,248 @@
+#include <klib/printf.h>
+#include <klib/string.h>
+#include <drivers/serial.h>
+
+#define FLAG_LEFT  (1u << 0)
+#define FLAG_ZERO  (1u << 1)
+#define FLAG_PLUS  (1u << 2)
+#define FLAG_SPACE (1u << 3)
+
+#define NO_PRECISION ((size_t)-1)
+
+struct out {
+    char *buf;
+    size_t size;
+    size_t pos;
+};
+
+static inline void out_char(struct out *o, char c) {
+    if (o->pos + 1 < o->size) {
+        o->buf[o->pos] = c;
+    }
+    o->pos++;
+}
+
+static void out_fill(struct out *o, char c, size_t n) {
+    while (n--) {
+        out_char(o, c);
+    }
+}
+
+static void out_mem(struct out *o, const char *s, size_t n) {
+    size_t room = (o->pos + 1 < o->size) ? o->size - 1 - o->pos : 0;
+    size_t copy = n < room ? n : room;
+
+    for (size_t i = 0; i < copy; i++) {
+        o->buf[o->pos + i] = s[i];
+    }
+    o->pos += n;
+}
+
+// emits [prefix][padding][zeros][digits] honouring width, '-' and '0';
+// zeros is what an integer precision adds in front of the digits
+static void out_field(struct out *o, const char *prefix, size_t prefix_len, size_t zeros,
+                      const char *body, size_t body_len, size_t width, unsigned flags) {
+    size_t len = prefix_len + zeros + body_len;
+    size_t pad = width > len ? width - len : 0;
+
+    if (flags & FLAG_LEFT) {
+        out_mem(o, prefix, prefix_len);
+        out_fill(o, '0', zeros);
+        out_mem(o, body, body_len);
+        out_fill(o, ' ', pad);
+    } else if (flags & FLAG_ZERO) {
+        out_mem(o, prefix, prefix_len);
+        out_fill(o, '0', pad + zeros);
+        out_mem(o, body, body_len);
+    } else {
+        out_fill(o, ' ', pad);
+        out_mem(o, prefix, prefix_len);
+        out_fill(o, '0', zeros);
+        out_mem(o, body, body_len);
+    }
+}
+
+// Integer precision is a minimum digit count: it pads with zeros, turns
+// off the '0' flag, and .0 prints nothing at all for the value 0.
+static void out_int(struct out *o, const char *prefix, size_t prefix_len, const char *digits,
+                    size_t len, bool zero, size_t width, size_t precision, unsigned flags) {
+    size_t zeros = 0;
+
+    if (precision != NO_PRECISION) {
+        flags &= ~FLAG_ZERO;
+        if (zero && !precision) len = 0;
+        zeros = precision > len ? precision - len : 0;
+    }
+    out_field(o, prefix, prefix_len, zeros, digits, len, width, flags);
+}
+
+// what an int argument becomes after the 'h' / 'hh' conversion
+static uint64_t narrow(uint64_t v, int shorts) {
+    return shorts == 1 ? (uint16_t)v : shorts >= 2 ? (uint8_t)v : (uint32_t)v;
+}
+
+static int64_t narrow_signed(int64_t v, int shorts) {
+    return shorts == 1 ? (int16_t)v : shorts >= 2 ? (int8_t)v : (int32_t)v;
+}
+
+static char *format_hex(uint64_t value, char *end, bool upper) {
+    const char *digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+    char *p = end;
+
+    do {
+        *--p = digits[value & 0xF];
+        value >>= 4;
+    } while (value);
+
+    return p;
+}
+
+int kvsnprintf(char *buf, size_t size, const char *fmt, va_list ap) {
+    struct out o = { .buf = buf, .size = size, .pos = 0 };
+    char num[24];
+    char *end = num + sizeof(num);
+
+    while (*fmt) {
+        if (*fmt != '%') {
+            const char *lit = fmt;
+            while (*fmt && *fmt != '%') fmt++;
+            out_mem(&o, lit, (size_t)(fmt - lit));
+            continue;
+        }
+        fmt++;
+
+        unsigned flags = 0;
+        for (;; fmt++) {
+            if (*fmt == '-') flags |= FLAG_LEFT;
+            else if (*fmt == '0') flags |= FLAG_ZERO;
+            else if (*fmt == '+') flags |= FLAG_PLUS;
+            else if (*fmt == ' ') flags |= FLAG_SPACE;
+            else break;
+        }
+
+        size_t width = 0;
+        if (*fmt == '*') {
+            int w = va_arg(ap, int);
+            if (w < 0) {
+                flags |= FLAG_LEFT;
+                w = -w;
+            }
+            width = (size_t)w;
+            fmt++;
+        } else {
+            while (*fmt >= '0' && *fmt <= '9') {
+                width = width * 10 + (size_t)(*fmt++ - '0');
+            }
+        }
+
+        size_t precision = NO_PRECISION;
+        if (*fmt == '.') {
+            fmt++;
+            precision = 0;
+            if (*fmt == '*') {
+                // a negative precision counts as none, as in C
+                int p = va_arg(ap, int);
+                precision = p < 0 ? NO_PRECISION : (size_t)p;
+                fmt++;
+            } else {
+                while (*fmt >= '0' && *fmt <= '9') {
+                    precision = precision * 10 + (size_t)(*fmt++ - '0');
+                }
+            }
+        }
+
+        int longs = 0, shorts = 0;
+        while (*fmt == 'l' || *fmt == 'z' || *fmt == 'h') {
+            if (*fmt == 'h') shorts++;
+            else longs++;
+            fmt++;
+        }
+
+        char conv = *fmt;
+        if (!conv) break;
+        fmt++;
+
+        switch (conv) {
+            case 'd':
+            case 'i': {
+                int64_t v = longs ? va_arg(ap, int64_t) : narrow_signed(va_arg(ap, int), shorts);
+                uint64_t mag = v < 0 ? (uint64_t)0 - (uint64_t)v : (uint64_t)v;
+                const char *sign = v < 0 ? "-" : (flags & FLAG_PLUS) ? "+" : (flags & FLAG_SPACE) ? " " : "";
+                char *p = u64_format_dec(mag, end);
+                out_int(&o, sign, *sign ? 1 : 0, p, (size_t)(end - p), !mag, width, precision, flags);
+                break;
+            }
+            case 'u': {
+                uint64_t v = longs ? va_arg(ap, uint64_t) : narrow(va_arg(ap, unsigned int), shorts);
+                char *p = u64_format_dec(v, end);
+                out_int(&o, "", 0, p, (size_t)(end - p), !v, width, precision, flags);
+                break;
+            }
+            case 'x':
+            case 'X': {
+                uint64_t v = longs ? va_arg(ap, uint64_t) : narrow(va_arg(ap, unsigned int), shorts);
+                char *p = format_hex(v, end, conv == 'X');
+                out_int(&o, "", 0, p, (size_t)(end - p), !v, width, precision, flags);
+                break;
+            }
+            case 'p': {
+                uint64_t v = (uint64_t)(uintptr_t)va_arg(ap, void *);
+                char *p = end - 16;
+                char *first = format_hex(v, end, false);
+                while (first > p) *--first = '0';
+                out_field(&o, "0x", 2, 0, p, 16, width, flags & ~FLAG_ZERO);
+                break;
+            }
+            case 's': {
+                const char *s = va_arg(ap, const char *);
+                if (!s) s = "(null)";
+                size_t len = 0;
+                if (precision == NO_PRECISION) {
+                    len = strlen(s);
+                } else {
+                    while (len < precision && s[len]) len++;
+                }
+                out_field(&o, "", 0, 0, s, len, width, flags & ~FLAG_ZERO);
+                break;
+            }
+            case 'c': {
+                char c = (char)va_arg(ap, int);
+                out_field(&o, "", 0, 0, &c, 1, width, flags & ~FLAG_ZERO);
+                break;
+            }
+            case '%':
+                out_char(&o, '%');
+                break;
+            default:
+                out_char(&o, '%');
+                out_char(&o, conv);
+                break;
+        }
+    }
+
+    if (size) {
+        buf[o.pos < size ? o.pos : size - 1] = '\0';
+    }
+
+    return (int)o.pos;
+}
+
+int ksnprintf(char *buf, size_t size, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int n = kvsnprintf(buf, size, fmt, ap);
+    va_end(ap);
+    return n;
+}
+
+int kprintf(const char *fmt, ...) {
+    char buf[KPRINTF_BUF_SIZE];
+
+    va_list ap;
+    va_start(ap, fmt);
+    int n = kvsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+
+    serial_puts(buf);
+    return n;
+}
@@ -0,0 +1,23 @@
+#ifndef KLIB_PRINTF_H
+#define KLIB_PRINTF_H
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// output longer than this is truncated by kprintf / fb_printf
+#define KPRINTF_BUF_SIZE 256
+
+// supported: %d %i %u %x %X %p %s %c %%, flags '-' '0' '+' ' ',
+// width / precision (also '*'), length modifiers l ll z h hh.
+// 'l', 'll' and 'z' all mean 64 bits. Precision is the minimum digit
+// count for integers and the maximum length for %s, as in C. %p is always
+// 0x and 16 digits.
+int kvsnprintf(char *buf, size_t size, const char *fmt, va_list ap);
+int ksnprintf(char *buf, size_t size, const char *fmt, ...) __attribute__((format(printf, 3, 4)));
+
+// formats into one stack buffer and writes it to serial in a single call
+int kprintf(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+#endif
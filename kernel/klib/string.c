@@ -1,34 +1,100 @@
 #include <klib/string.h>
 
-size_t strlen(const char *s) {
-    size_t len = 0;
+#define ONES  0x0101010101010101ULL
+#define HIGHS 0x8080808080808080ULL
+
+// non-zero iff some byte of v is zero
+#define HAS_ZERO_BYTE(v) (((v) - ONES) & ~(v) & HIGHS)
+
+typedef uint64_t __attribute__((may_alias)) word_t;
+
+static const char dec_pairs[200] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
 
+size_t strlen(const char *s) {
     if (!s) {
         return 0;
     }
 
-    while (s[len]) {
-        len++;
+    const char *p = s;
+
+    // bytes up to the first aligned word
+    while ((uintptr_t)p & (sizeof(word_t) - 1)) {
+        if (!*p) return (size_t)(p - s);
+        p++;
     }
 
-    return len;
+    // aligned loads never cross a page boundary, so reading past the
+    // terminator inside the last word is safe
+    const word_t *w = (const word_t *)p;
+    while (!HAS_ZERO_BYTE(*w)) {
+        w++;
+    }
+
+    p = (const char *)w;
+    while (*p) {
+        p++;
+    }
+
+    return (size_t)(p - s);
 }
 
 char *strcat(char *dest, const char *src)
 {
-    char *end = dest;
-    while (*end != '\0')
-        end++;
-    while (*src != '\0')
-    {
-        *end = *src;
-        end++;
-        src++;
-    }
-    *end = '\0';
+    char *end = dest + strlen(dest);
+    size_t n = strlen(src);
+
+    for (size_t i = 0; i <= n; i++) {
+        end[i] = src[i];
+    }
     return dest;
 }
 
+int strcmp(const char *a, const char *b) {
+    while (*a && *a == *b) {
+        a++;
+        b++;
+    }
+    return (unsigned char)*a - (unsigned char)*b;
+}
+
+void *memchr(const void *s, int c, size_t n) {
+    const uint8_t *p = (const uint8_t *)s;
+    uint8_t ch = (uint8_t)c;
+
+    while (n && ((uintptr_t)p & (sizeof(word_t) - 1))) {
+        if (*p == ch) return (void *)p;
+        p++;
+        n--;
+    }
+
+    uint64_t pattern = ONES * ch;
+    const word_t *w = (const word_t *)p;
+    while (n >= sizeof(word_t)) {
+        uint64_t v = *w ^ pattern;
+        if (HAS_ZERO_BYTE(v)) break;
+        w++;
+        n -= sizeof(word_t);
+    }
+
+    p = (const uint8_t *)w;
+    while (n--) {
+        if (*p == ch) return (void *)p;
+        p++;
+    }
+
+    return NULL;
+}
+
 void u64_to_hex(uint64_t value, char *buffer) {
     static const char digits[] = "0123456789ABCDEF";
     buffer[0] = '0';
@@ -41,24 +107,114 @@ void u64_to_hex(uint64_t value, char *buffer) {
     buffer[18] = '\0';
 }
 
+size_t u64_dec_digits(uint64_t value) {
+    size_t n = 1;
+    for (;;) {
+        if (value < 10) return n;
+        if (value < 100) return n + 1;
+        if (value < 1000) return n + 2;
+        if (value < 10000) return n + 3;
+        value /= 10000;
+        n += 4;
+    }
+}
+
+char *u64_format_dec(uint64_t value, char *end) {
+    char *p = end;
+
+    // two digits per division
+    while (value >= 100) {
+        size_t pair = (size_t)(value % 100) * 2;
+        value /= 100;
+        *--p = dec_pairs[pair + 1];
+        *--p = dec_pairs[pair];
+    }
+
+    if (value >= 10) {
+        size_t pair = (size_t)value * 2;
+        *--p = dec_pairs[pair + 1];
+        *--p = dec_pairs[pair];
+    } else {
+        *--p = (char)('0' + value);
+    }
+
+    return p;
+}
+
 void u64_to_dec(uint64_t value, char *buffer) {
-    char temp[21];
-    size_t idx = 0;
+    size_t len = u64_dec_digits(value);
+    u64_format_dec(value, buffer + len);
+    buffer[len] = '\0';
+}
+
+uint32_t utf8_decode(const char **pos, const char *end) {
+    const uint8_t *p = (const uint8_t *)*pos;
+    uint8_t lead = *p;
 
-    if (value == 0) {
-        buffer[0] = '0';
-        buffer[1] = '\0';
-        return;
+    if (lead < 0x80) {
+        *pos += 1;
+        return lead;
     }
 
-    while (value > 0 && idx < sizeof(temp)) {
-        temp[idx++] = (char)('0' + (value % 10));
-        value /= 10;
+    size_t len;
+    uint32_t cp, min;
+    if ((lead & 0xE0) == 0xC0) {
+        len = 2; cp = lead & 0x1F; min = 0x80;
+    } else if ((lead & 0xF0) == 0xE0) {
+        len = 3; cp = lead & 0x0F; min = 0x800;
+    } else if ((lead & 0xF8) == 0xF0) {
+        len = 4; cp = lead & 0x07; min = 0x10000;
+    } else {
+        *pos += 1;
+        return UTF8_INVALID;
     }
 
-    size_t out = 0;
-    while (idx > 0) {
-        buffer[out++] = temp[--idx];
+    if ((size_t)((const uint8_t *)end - p) < len) {
+        *pos += 1;
+        return UTF8_INVALID;
     }
-    buffer[out] = '\0';
+
+    for (size_t i = 1; i < len; i++) {
+        if ((p[i] & 0xC0) != 0x80) {
+            *pos += 1;
+            return UTF8_INVALID;
+        }
+        cp = (cp << 6) | (p[i] & 0x3F);
+    }
+
+    if (cp < min || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) {
+        *pos += 1;
+        return UTF8_INVALID;
+    }
+
+    *pos += len;
+    return cp;
+}
+
+bool str_to_u64(const char *s, size_t len, uint64_t *out) {
+    uint64_t result = 0;
+    unsigned base = 10;
+    size_t i = 0;
+
+    if (!len) return false;
+
+    if (len > 2 && s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) {
+        base = 16;
+        i = 2;
+    }
+
+    for (; i < len; i++) {
+        char c = s[i];
+        unsigned digit;
+
+        if (c >= '0' && c <= '9') digit = (unsigned)(c - '0');
+        else if (base == 16 && c >= 'a' && c <= 'f') digit = (unsigned)(c - 'a' + 10);
+        else if (base == 16 && c >= 'A' && c <= 'F') digit = (unsigned)(c - 'A' + 10);
+        else return false;
+
+        result = result * base + digit;
+    }
+
+    *out = result;
+    return true;
 }
@@ -1,12 +1,29 @@
 #ifndef KLIB_STRING_H
 #define KLIB_STRING_H
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
 size_t strlen(const char *s);
 char *strcat(char *dest, const char *src);
+int strcmp(const char *a, const char *b);
+void *memchr(const void *s, int c, size_t n);
 void u64_to_hex(uint64_t value, char *buffer);
 void u64_to_dec(uint64_t value, char *buffer);
 
-#endif
\ No newline at end of file
+// parses len chars of decimal or 0x-prefixed hex, false on anything else
+bool str_to_u64(const char *s, size_t len, uint64_t *out);
+
+// number of decimal digits in value
+size_t u64_dec_digits(uint64_t value);
+// writes value right-aligned so the last digit lands at end[-1], returns the first digit
+char *u64_format_dec(uint64_t value, char *end);
+
+// Decodes one UTF-8 sequence at *pos (not past end) and advances *pos.
+// Malformed, overlong or truncated input yields UTF8_INVALID and skips one byte.
+#define UTF8_INVALID 0xFFFFFFFFu
+#define UTF8_REPLACEMENT 0xFFFDu
+uint32_t utf8_decode(const char **pos, const char *end);
+
+#endif
@@ -0,0 +1,170 @@
+#include <log/klog.h>
+#include <log/logring.h>
+#include <arch/x86_64/apic.h>
+#include <arch/x86_64/cpu.h>
+#include <klib/printf.h>
+#include <klib/string.h>
+#include <colors.h>
+
+// in-memory copy of recent lines, oldest overwritten first
+#define KLOG_MEM_SIZE (16 * 1024)
+
+// header: "[%5lu.%06lu] L tag: "
+#define KLOG_LINE_MAX (KPRINTF_BUF_SIZE + 48)
+
+int klog_level = KLOG_INFO;
+
+static char g_mem[KLOG_MEM_SIZE];
+static uint64_t g_mem_head = 0;   // bytes ever written
+
+static const uint32_t level_colors[] = { COL_FAIL, COL_WARNING, COL_NORMAL, COL_INFO };
+static const char level_chars[] = "EWID";
+static const char *const level_names[] = { "err", "warn", "info", "debug" };
+
+static void fb_sink_write(const struct klog_record *rec)
+{
+    logring_write(rec->msg, rec->msg_len, rec->color, LOG_SINK_FB);
+}
+
+static void serial_sink_write(const struct klog_record *rec)
+{
+    logring_write(rec->line, rec->line_len, 0, LOG_SINK_SERIAL);
+}
+
+static void mem_sink_write(const struct klog_record *rec)
+{
+    uint64_t flags = irq_save();
+    for (size_t i = 0; i < rec->line_len; i++) {
+        g_mem[g_mem_head++ % KLOG_MEM_SIZE] = rec->line[i];
+    }
+    irq_restore(flags);
+}
+
+static struct klog_sink g_mem_sink = {
+    .name = "mem", .write = mem_sink_write, .level = KLOG_DEBUG,
+};
+static struct klog_sink g_serial_sink = {
+    .name = "serial", .write = serial_sink_write, .level = KLOG_DEBUG, .next = &g_mem_sink,
+};
+static struct klog_sink g_fb_sink = {
+    .name = "fb", .write = fb_sink_write, .level = KLOG_INFO, .next = &g_serial_sink,
+};
+
+static struct klog_sink *g_sinks = &g_fb_sink;
+
+void klog_write(int level, const char *tag, uint32_t color, const char *fmt, ...)
+{
+    if (level < KLOG_ERR) level = KLOG_ERR;
+    if (level > KLOG_DEBUG) level = KLOG_DEBUG;
+
+    struct klog_record rec = {
+        .tsc = rdtsc(),
+        .level = level,
+        .tag = tag,
+        .color = color ? color : level_colors[level],
+    };
+
+    char line[KLOG_LINE_MAX];
+    int hdr;
+    if (tsc_frequency_hz) {
+        uint64_t us = rec.tsc / (tsc_frequency_hz / 1000000);
+        hdr = ksnprintf(line, sizeof(line), "[%5lu.%06lu] %c %s: ",
+                        us / 1000000, us % 1000000, level_chars[level], tag);
+    } else {
+        // before the TSC is calibrated
+        hdr = ksnprintf(line, sizeof(line), "[     -      ] %c %s: ", level_chars[level], tag);
+    }
+    if (hdr < 0 || (size_t)hdr >= sizeof(line) - 2) return;
+
+    va_list ap;
+    va_start(ap, fmt);
+    int n = kvsnprintf(line + hdr, sizeof(line) - (size_t)hdr - 1, fmt, ap);
+    va_end(ap);
+    if (n < 0) return;
+
+    size_t len = (size_t)hdr + strlen(line + hdr);
+    // one record is one line; callers may or may not end with '\n'
+    while (len > (size_t)hdr && line[len - 1] == '\n') len--;
+    line[len++] = '\n';
+    line[len] = '\0';
+
+    rec.line = line;
+    rec.line_len = len;
+    rec.msg = line + hdr;
+    rec.msg_len = len - (size_t)hdr;
+
+    for (struct klog_sink *s = g_sinks; s; s = s->next) {
+        if (!s->muted && level <= s->level) s->write(&rec);
+    }
+}
+
+void klog_add_sink(struct klog_sink *sink)
+{
+    uint64_t flags = irq_save();
+    sink->next = g_sinks;
+    g_sinks = sink;
+    irq_restore(flags);
+}
+
+struct klog_sink *klog_find_sink(const char *name)
+{
+    for (struct klog_sink *s = g_sinks; s; s = s->next) {
+        if (!strcmp(s->name, name)) return s;
+    }
+    return NULL;
+}
+
+bool klog_mute(const char *name, bool muted)
+{
+    struct klog_sink *s = klog_find_sink(name);
+    if (!s) return false;
+    s->muted = muted;
+    return true;
+}
+
+void klog_set_level(int level)
+{
+    if (level < KLOG_ERR) level = KLOG_ERR;
+    if (level > KLOG_DEBUG) level = KLOG_DEBUG;
+    klog_level = level;
+}
+
+int klog_parse_level(const char *s)
+{
+    for (int i = KLOG_ERR; i <= KLOG_DEBUG; i++) {
+        if (!strcmp(s, level_names[i])) return i;
+    }
+    if (s[0] >= '0' && s[0] <= '3' && s[1] == '\0') return s[0] - '0';
+    return -1;
+}
+
+const char *klog_level_name(int level)
+{
+    return level >= KLOG_ERR && level <= KLOG_DEBUG ? level_names[level] : "?";
+}
+
+void klog_dump(void)
+{
+    uint64_t flags = irq_save();
+    uint64_t head = g_mem_head;
+    uint64_t start = head > KLOG_MEM_SIZE ? head - KLOG_MEM_SIZE : 0;
+
+    // the oldest line was probably cut by the wrap; start at the next one
+    if (start) {
+        while (start < head && g_mem[start % KLOG_MEM_SIZE] != '\n') start++;
+        start++;
+    }
+
+    char chunk[128];
+    size_t n = 0;
+    for (uint64_t i = start; i < head; i++) {
+        chunk[n++] = g_mem[i % KLOG_MEM_SIZE];
+        if (n == sizeof(chunk)) {
+            logring_write(chunk, n, 0, LOG_SINK_SERIAL);
+            n = 0;
+        }
+    }
+    if (n) logring_write(chunk, n, 0, LOG_SINK_SERIAL);
+
+    irq_restore(flags);
+}
@@ -0,0 +1,83 @@
+#ifndef ESTELLA_LOG_KLOG_H
+#define ESTELLA_LOG_KLOG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Leveled kernel log. A message is formatted once into a record carrying
+// its level, subsystem tag, colour and TSC timestamp; every enabled sink
+// (framebuffer console, serial, in-memory ring) is handed that record.
+//
+// A file picks its tag by defining KLOG_TAG before including this header:
+//     #define KLOG_TAG "pmm"
+//     #include <log/klog.h>
+//     klog_info("%zu frames free", n);
+// The trailing newline is added by klog.
+
+#define KLOG_ERR   0
+#define KLOG_WARN  1
+#define KLOG_INFO  2
+#define KLOG_DEBUG 3
+
+// messages above this level are compiled out (make KLOG_LEVEL=...)
+#ifndef KLOG_MAX_LEVEL
+#define KLOG_MAX_LEVEL KLOG_DEBUG
+#endif
+
+#ifndef KLOG_TAG
+#define KLOG_TAG "kernel"
+#endif
+
+// runtime threshold; a disabled message costs this one compare
+extern int klog_level;
+
+struct klog_record {
+    uint64_t tsc;
+    int level;
+    const char *tag;
+    uint32_t color;         // framebuffer colour, level default when 0 was asked for
+    const char *line;       // "[    1.234567] I tag: message\n"
+    size_t line_len;
+    const char *msg;        // "message\n", points into line
+    size_t msg_len;
+};
+
+struct klog_sink {
+    const char *name;
+    void (*write)(const struct klog_record *rec);
+    int level;              // most verbose level this sink takes
+    bool muted;
+    struct klog_sink *next;
+};
+
+#define klog_color(lvl, col, fmt, ...)                                          \
+    do {                                                                        \
+        if ((lvl) <= KLOG_MAX_LEVEL && (lvl) <= klog_level)                     \
+            klog_write((lvl), KLOG_TAG, (col), fmt, ##__VA_ARGS__);             \
+    } while (0)
+
+#define klog_err(fmt, ...)   klog_color(KLOG_ERR, 0, fmt, ##__VA_ARGS__)
+#define klog_warn(fmt, ...)  klog_color(KLOG_WARN, 0, fmt, ##__VA_ARGS__)
+#define klog_info(fmt, ...)  klog_color(KLOG_INFO, 0, fmt, ##__VA_ARGS__)
+#define klog_debug(fmt, ...) klog_color(KLOG_DEBUG, 0, fmt, ##__VA_ARGS__)
+
+// use the macros above; this formats and dispatches unconditionally
+void klog_write(int level, const char *tag, uint32_t color, const char *fmt, ...)
+    __attribute__((format(printf, 4, 5)));
+
+// the fb, serial and mem sinks are registered from the start
+void klog_add_sink(struct klog_sink *sink);
+struct klog_sink *klog_find_sink(const char *name);
+// e.g. klog_mute("fb", true) around benchmarks; false if there is no such sink
+bool klog_mute(const char *name, bool muted);
+
+void klog_set_level(int level);
+// "err", "warn", "info", "debug" or a digit, -1 if unknown
+int klog_parse_level(const char *s);
+const char *klog_level_name(int level);
+
+// replays the in-memory ring on serial, oldest first
+void klog_dump(void);
+
+#endif
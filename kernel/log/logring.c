@@ -0,0 +1,273 @@
+#include <log/logring.h>
+#include <klib/memory.h>
+#include <klib/string.h>
+#include <klib/printf.h>
+#include <drivers/fbtext.h>
+#include <drivers/serial.h>
+#include <drivers/virtio_console.h>
+#include <arch/x86_64/cpu.h>
+#include <arch/x86_64/apic.h>
+#include <arch/x86_64/idle.h>
+
+#define LOGRING_MASK (LOGRING_SIZE - 1)
+#define LOGRING_ALIGN 16
+
+#define REC_COMMITTED (1u << 0)
+#define REC_PAD       (1u << 1)
+
+// Every record starts on a 16-byte boundary, so a record that would run past
+// the end of the ring is preceded by a pad record of at least header size.
+// The text follows the header and is NUL-terminated.
+struct logring_hdr {
+    uint64_t tsc;       // when the producer queued it
+    uint32_t color;
+    uint16_t size;      // whole record, header and padding included
+    uint8_t flags;      // REC_*, written last by the producer
+    uint8_t sinks;
+};
+
+_Static_assert(sizeof(struct logring_hdr) == LOGRING_ALIGN, "log record header must be one alignment unit");
+_Static_assert((LOGRING_SIZE & LOGRING_MASK) == 0, "LOGRING_SIZE must be a power of two");
+
+static uint8_t g_ring[LOGRING_SIZE] __attribute__((aligned(LOGRING_ALIGN)));
+
+// free-running byte positions: producers advance head, the drainer tail
+static uint64_t g_head = 0;
+static uint64_t g_tail = 0;
+
+static bool g_async = false;
+static unsigned g_serial_route = LOG_SINK_SERIAL;
+static bool g_draining = false;
+
+static struct logring_stats g_stats;
+static uint64_t g_max_latency_tsc = 0;
+
+static inline struct logring_hdr *hdr_at(uint64_t pos)
+{
+    return (struct logring_hdr *)&g_ring[pos & LOGRING_MASK];
+}
+
+static inline void stat_add(uint64_t *counter, uint64_t n)
+{
+    __atomic_fetch_add(counter, n, __ATOMIC_RELAXED);
+}
+
+static void stat_max(uint64_t *counter, uint64_t value)
+{
+    uint64_t cur = __atomic_load_n(counter, __ATOMIC_RELAXED);
+    while (value > cur &&
+           !__atomic_compare_exchange_n(counter, &cur, value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+static inline unsigned route(unsigned sinks)
+{
+    if (!(sinks & LOG_SINK_SERIAL)) return sinks;
+    return (sinks & ~LOG_SINK_SERIAL) | __atomic_load_n(&g_serial_route, __ATOMIC_RELAXED);
+}
+
+// sinks are already routed
+static void emit(const char *s, size_t len, uint32_t color, unsigned sinks)
+{
+    if (sinks & LOG_SINK_SERIAL) serial_write(s, len);
+    if (sinks & LOG_SINK_VIRTIO) virtio_console_write(s, len);
+    if (sinks & LOG_SINK_FB) fb_write(s, len, color);
+}
+
+void logring_write(const char *s, size_t len, uint32_t color, unsigned sinks)
+{
+    if (!s || !len) return;
+    if (len > LOGRING_RECORD_MAX) len = LOGRING_RECORD_MAX;
+
+    if (!__atomic_load_n(&g_async, __ATOMIC_RELAXED)) {
+        // keep order with anything still queued from async mode
+        logring_drain(0);
+        sinks = route(sinks);
+        emit(s, len, color, sinks);
+        if (sinks & LOG_SINK_VIRTIO) virtio_console_flush();
+        return;
+    }
+
+    size_t need = (sizeof(struct logring_hdr) + len + 1 + LOGRING_ALIGN - 1) & ~(size_t)(LOGRING_ALIGN - 1);
+    uint64_t head = __atomic_load_n(&g_head, __ATOMIC_RELAXED);
+    uint64_t start, end, pad, tail;
+
+    do {
+        size_t offset = head & LOGRING_MASK;
+        pad = offset + need > LOGRING_SIZE ? LOGRING_SIZE - offset : 0;
+        start = head + pad;
+        end = start + need;
+
+        tail = __atomic_load_n(&g_tail, __ATOMIC_ACQUIRE);
+        if (end - tail > LOGRING_SIZE) {
+            stat_add(&g_stats.dropped_records, 1);
+            stat_add(&g_stats.dropped_bytes, len);
+            return;
+        }
+    } while (!__atomic_compare_exchange_n(&g_head, &head, end, true, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+
+    if (pad) {
+        struct logring_hdr *p = hdr_at(head);
+        p->size = (uint16_t)pad;
+        __atomic_store_n(&p->flags, REC_PAD | REC_COMMITTED, __ATOMIC_RELEASE);
+    }
+
+    struct logring_hdr *h = hdr_at(start);
+    char *text = (char *)(h + 1);
+
+    h->tsc = rdtsc();
+    h->color = color;
+    h->size = (uint16_t)need;
+    h->sinks = (uint8_t)sinks;
+    memcpy(text, s, len);
+    text[len] = '\0';
+    __atomic_store_n(&h->flags, REC_COMMITTED, __ATOMIC_RELEASE);
+    idle_wake(IDLE_WAKE_LOG);
+
+    stat_add(&g_stats.records, 1);
+    stat_add(&g_stats.bytes, len);
+    stat_max(&g_stats.high_water, end - tail);
+}
+
+void logring_puts(const char *s, uint32_t color, unsigned sinks)
+{
+    if (s) logring_write(s, strlen(s), color, sinks);
+}
+
+void logring_printf(uint32_t color, unsigned sinks, const char *fmt, ...)
+{
+    char buf[KPRINTF_BUF_SIZE];
+
+    va_list ap;
+    va_start(ap, fmt);
+    int n = kvsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+
+    if (n > 0) {
+        logring_write(buf, (size_t)n < sizeof(buf) ? (size_t)n : sizeof(buf) - 1, color, sinks);
+    }
+}
+
+size_t logring_drain(size_t budget)
+{
+    if (__atomic_exchange_n(&g_draining, true, __ATOMIC_ACQUIRE)) {
+        return 0;
+    }
+
+    size_t written = 0;
+    bool virtio = false;
+    uint64_t tail = g_tail;
+
+    while (tail != __atomic_load_n(&g_head, __ATOMIC_ACQUIRE)) {
+        struct logring_hdr *h = hdr_at(tail);
+        uint8_t flags = __atomic_load_n(&h->flags, __ATOMIC_ACQUIRE);
+
+        // reserved but not yet published; later records wait behind it
+        if (!(flags & REC_COMMITTED)) break;
+
+        size_t size = h->size;
+        if (!(flags & REC_PAD)) {
+            const char *text = (const char *)(h + 1);
+            size_t len = strlen(text);
+
+            unsigned sinks = route(h->sinks);
+
+            // leave it queued until the UART ring can take it whole,
+            // counting every byte twice in case it is all newlines
+            if ((sinks & LOG_SINK_SERIAL) && serial_tx_space() < 2 * len) break;
+            if ((sinks & LOG_SINK_VIRTIO) && virtio_console_tx_space() < len) break;
+
+            stat_max(&g_max_latency_tsc, rdtsc() - h->tsc);
+            emit(text, len, h->color, sinks);
+            virtio |= (sinks & LOG_SINK_VIRTIO) != 0;
+            written += len;
+            g_stats.drained_records++;
+        }
+
+        // producers only ever see zeroed space, so a stale flags byte can't
+        // look like a published header on the next lap
+        memset(h, 0, size);
+        tail += size;
+        __atomic_store_n(&g_tail, tail, __ATOMIC_RELEASE);
+
+        if (budget && written >= budget) break;
+    }
+
+    // one doorbell for everything this pass wrote
+    if (virtio) virtio_console_flush();
+
+    __atomic_store_n(&g_draining, false, __ATOMIC_RELEASE);
+    return written;
+}
+
+void logring_set_async(bool async)
+{
+    if (!async) {
+        __atomic_store_n(&g_async, false, __ATOMIC_RELAXED);
+        logring_drain(0);
+        return;
+    }
+    __atomic_store_n(&g_async, true, __ATOMIC_RELAXED);
+}
+
+bool logring_is_async(void)
+{
+    return __atomic_load_n(&g_async, __ATOMIC_RELAXED);
+}
+
+void logring_panic(void)
+{
+    __atomic_store_n(&g_async, false, __ATOMIC_RELAXED);
+    // whoever was draining is not coming back
+    __atomic_store_n(&g_draining, false, __ATOMIC_RELEASE);
+    logring_drain(0);
+    virtio_console_sync();
+}
+
+void logring_route_serial(unsigned sinks)
+{
+    sinks &= LOG_SINK_SERIAL | LOG_SINK_VIRTIO;
+    if (!virtio_console_present()) sinks &= ~LOG_SINK_VIRTIO;
+    if (!sinks) sinks = LOG_SINK_SERIAL;
+
+    logring_drain(0);
+    __atomic_store_n(&g_serial_route, sinks, __ATOMIC_RELAXED);
+}
+
+void logring_get_stats(struct logring_stats *out)
+{
+    out->records = __atomic_load_n(&g_stats.records, __ATOMIC_RELAXED);
+    out->bytes = __atomic_load_n(&g_stats.bytes, __ATOMIC_RELAXED);
+    out->dropped_records = __atomic_load_n(&g_stats.dropped_records, __ATOMIC_RELAXED);
+    out->dropped_bytes = __atomic_load_n(&g_stats.dropped_bytes, __ATOMIC_RELAXED);
+    out->high_water = __atomic_load_n(&g_stats.high_water, __ATOMIC_RELAXED);
+    out->drained_records = g_stats.drained_records;
+    out->max_latency_tsc = __atomic_load_n(&g_max_latency_tsc, __ATOMIC_RELAXED);
+}
+
+void logring_bench(size_t records)
+{
+    if (!tsc_frequency_hz) return;
+
+    struct logring_stats before;
+    logring_get_stats(&before);
+
+    uint64_t t0 = rdtsc();
+    for (size_t i = 0; i < records; i++) {
+        logring_printf(0, LOG_SINK_SERIAL, "logring bench record %zu of %zu\n", i + 1, records);
+    }
+    uint64_t t1 = rdtsc();
+
+    struct logring_stats after;
+    logring_get_stats(&after);
+
+    uint64_t ns = (t1 - t0) * 1000 / (tsc_frequency_hz / 1000000);
+
+    kprintf("logring bench: %zu records, %lu ns per record (%s), %lu dropped\n",
+            records, records ? ns / records : 0,
+            logring_is_async() ? "queued" : "synchronous",
+            after.dropped_records - before.dropped_records);
+    kprintf("logring: %lu records, %lu bytes, %lu dropped (%lu bytes), high water %lu of %u bytes, max wait %lu us\n",
+            after.records, after.bytes, after.dropped_records, after.dropped_bytes,
+            after.high_water, LOGRING_SIZE, after.max_latency_tsc * 1000000 / tsc_frequency_hz);
+}
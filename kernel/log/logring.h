@@ -0,0 +1,61 @@
+#ifndef ESTELLA_LOG_LOGRING_H
+#define ESTELLA_LOG_LOGRING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Lock-free multi-producer log queue. Writers only reserve space with one
+// compare-and-swap, copy their bytes and publish the record; the console
+// and serial port are fed later by logring_drain(), normally from the idle
+// loop. Records that do not fit are dropped and counted, never waited on.
+
+#define LOGRING_SIZE        (64 * 1024)     // bytes, power of two
+#define LOGRING_RECORD_MAX  1024            // longest text per record
+#define LOGRING_IDLE_BUDGET 256             // text bytes drained per idle loop pass
+
+#define LOG_SINK_FB      (1u << 0)
+#define LOG_SINK_SERIAL  (1u << 1)
+#define LOG_SINK_VIRTIO  (1u << 2)
+#define LOG_SINK_ALL     (LOG_SINK_FB | LOG_SINK_SERIAL)
+
+struct logring_stats {
+    uint64_t records;           // records queued
+    uint64_t bytes;             // text bytes queued
+    uint64_t dropped_records;
+    uint64_t dropped_bytes;
+    uint64_t high_water;        // most ring bytes in use at once
+    uint64_t drained_records;
+    uint64_t max_latency_tsc;   // longest a record waited to be drained
+};
+
+// Queue len bytes of s for the given sinks. While the ring is synchronous
+// (the default, and after logring_panic()) the text is written out directly.
+void logring_write(const char *s, size_t len, uint32_t color, unsigned sinks);
+void logring_puts(const char *s, uint32_t color, unsigned sinks);
+void logring_printf(uint32_t color, unsigned sinks, const char *fmt, ...) __attribute__((format(printf, 3, 4)));
+
+// Hand records to their sinks until the ring is empty or at least budget
+// text bytes were written (0 = no limit). Returns the text bytes written.
+// Only one caller drains at a time; a concurrent call returns 0.
+size_t logring_drain(size_t budget);
+
+// true: queue and return, false: write through (after draining the backlog)
+void logring_set_async(bool async);
+bool logring_is_async(void);
+
+// Where records queued for LOG_SINK_SERIAL are written: LOG_SINK_SERIAL
+// (the default), LOG_SINK_VIRTIO, or both. Callers keep asking for the
+// serial sink; this is the one switch for the machine's debug channel.
+void logring_route_serial(unsigned sinks);
+
+// For fatal paths: writes out everything queued, ignoring a drain that was
+// interrupted, and makes all later writes synchronous.
+void logring_panic(void);
+
+void logring_get_stats(struct logring_stats *out);
+
+// times logring_printf() for the given number of records, reports on serial
+void logring_bench(size_t records);
+
+#endif
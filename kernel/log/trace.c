@@ -0,0 +1,197 @@
+#include <log/trace.h>
+#include <log/logring.h>
+#include <drivers/serial.h>
+#include <arch/x86_64/alternative.h>
+#include <arch/x86_64/apic.h>
+#include <arch/x86_64/cpu.h>
+#include <arch/x86_64/msr.h>
+#include <klib/printf.h>
+#include <klib/string.h>
+#include <klib/memory.h>
+
+#define TRACE_RING_MASK (TRACE_RING_SIZE - 1)
+
+#define IA32_TSC_AUX 0xC0000103
+
+_Static_assert((TRACE_RING_SIZE & TRACE_RING_MASK) == 0, "TRACE_RING_SIZE must be a power of two");
+
+struct trace_ring {
+    uint64_t head;      // records ever written
+    struct trace_record records[TRACE_RING_SIZE];
+} __attribute__((aligned(64)));
+
+struct static_key trace_keys[TRACE_EVENT_COUNT];
+
+static struct trace_ring g_rings[TRACE_MAX_CPUS];
+
+static const char *const event_names[TRACE_EVENT_COUNT] = {
+    [TRACE_LAPIC_TIMER] = "timer",
+    [TRACE_KEYBOARD] = "kbd",
+    [TRACE_PMM_ALLOC] = "pmm",
+    [TRACE_VMM_MAP] = "vmm",
+};
+
+void trace_record(uint16_t event, uint64_t arg0, uint64_t arg1)
+{
+    uint32_t cpu = 0;
+    uint64_t tsc;
+
+    if (static_cpu_has(X86_FEATURE_RDTSCP)) {
+        tsc = rdtscp(&cpu);
+        if (cpu >= TRACE_MAX_CPUS) cpu = 0;
+    } else {
+        tsc = rdtsc();
+    }
+
+    // only this CPU and its interrupt handlers write here; the atomic add
+    // keeps a nested tracepoint from taking the same slot
+    struct trace_ring *ring = &g_rings[cpu];
+    uint64_t pos = __atomic_fetch_add(&ring->head, 1, __ATOMIC_RELAXED);
+    struct trace_record *r = &ring->records[pos & TRACE_RING_MASK];
+
+    __atomic_store_n(&r->seq, 0, __ATOMIC_RELAXED);
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+    r->tsc = tsc;
+    r->arg0 = arg0;
+    r->arg1 = arg1;
+    r->event = event;
+    r->cpu = (uint16_t)cpu;
+    __atomic_store_n(&r->seq, (uint32_t)(pos + 1), __ATOMIC_RELEASE);
+}
+
+void trace_init(void)
+{
+    if (cpu_has(X86_FEATURE_RDTSCP)) {
+        wrmsr(IA32_TSC_AUX, 0);   // the boot CPU; APs will load their index
+    }
+}
+
+static int trace_update(uint32_t mask, bool enable)
+{
+    int sites = 0;
+
+    for (int event = 1; event < TRACE_EVENT_COUNT; event++) {
+        if (!(mask & (1u << event))) continue;
+        sites += enable ? static_key_enable(&trace_keys[event]) : static_key_disable(&trace_keys[event]);
+    }
+    return sites;
+}
+
+int trace_enable(uint32_t mask)
+{
+    return trace_update(mask, true);
+}
+
+int trace_disable(uint32_t mask)
+{
+    return trace_update(mask, false);
+}
+
+uint32_t trace_enabled_mask(void)
+{
+    uint32_t mask = 0;
+    for (int event = 1; event < TRACE_EVENT_COUNT; event++) {
+        if (static_key_enabled(&trace_keys[event])) mask |= 1u << event;
+    }
+    return mask;
+}
+
+uint32_t trace_parse_events(const char *list)
+{
+    uint32_t mask = 0;
+
+    while (*list) {
+        const char *end = list;
+        while (*end && *end != ',') end++;
+        size_t len = (size_t)(end - list);
+
+        if (len == 3 && !memcmp(list, "all", 3)) {
+            mask |= ((1u << TRACE_EVENT_COUNT) - 1) & ~1u;
+        }
+        for (int event = 1; event < TRACE_EVENT_COUNT; event++) {
+            if (strlen(event_names[event]) == len && !memcmp(list, event_names[event], len)) {
+                mask |= 1u << event;
+            }
+        }
+
+        list = *end ? end + 1 : end;
+    }
+
+    return mask;
+}
+
+// Straight to the UART: a full dump is far larger than the log ring.
+// Waits for transmit ring space instead of dropping.
+static void dump_line(const char *s, size_t len)
+{
+    while (serial_tx_space() < 2 * len) asm volatile("pause");
+    serial_write(s, len);
+}
+
+static void dump_printf(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+static void dump_printf(const char *fmt, ...)
+{
+    char buf[128];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = kvsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    if (n > 0) dump_line(buf, (size_t)n < sizeof(buf) ? (size_t)n : sizeof(buf) - 1);
+}
+
+static void dump_ring(uint32_t cpu)
+{
+    struct trace_ring *ring = &g_rings[cpu];
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint64_t start = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+    static const char hex[] = "0123456789abcdef";
+
+    for (uint64_t pos = start; pos < head; pos++) {
+        struct trace_record *slot = &ring->records[pos & TRACE_RING_MASK];
+        struct trace_record r;
+
+        // skip slots being rewritten under us
+        uint32_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        if (seq != (uint32_t)(pos + 1)) continue;
+        r = *slot;
+        if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != seq) continue;
+
+        // little-endian record bytes, 64 hex digits
+        char line[2 * sizeof(r) + 1];
+        const uint8_t *bytes = (const uint8_t *)&r;
+        for (size_t i = 0; i < sizeof(r); i++) {
+            line[2 * i] = hex[bytes[i] >> 4];
+            line[2 * i + 1] = hex[bytes[i] & 0xF];
+        }
+        line[sizeof(line) - 1] = '\n';
+        dump_line(line, sizeof(line));
+    }
+}
+
+void trace_dump(void)
+{
+    // anything queued before the dump comes out first
+    logring_drain(0);
+
+    dump_printf("trace: begin tsc_hz=%lu cpus=%u record=%zu\n",
+                tsc_frequency_hz, TRACE_MAX_CPUS, sizeof(struct trace_record));
+    for (uint32_t cpu = 0; cpu < TRACE_MAX_CPUS; cpu++) {
+        uint64_t head = __atomic_load_n(&g_rings[cpu].head, __ATOMIC_RELAXED);
+        if (!head) continue;
+        dump_printf("trace: cpu %u written %lu lost %lu\n", cpu, head,
+                    head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0);
+        dump_ring(cpu);
+    }
+    dump_printf("trace: end\n");
+}
+
+void trace_reset(void)
+{
+    for (uint32_t cpu = 0; cpu < TRACE_MAX_CPUS; cpu++) {
+        uint64_t flags = irq_save();
+        __atomic_store_n(&g_rings[cpu].head, 0, __ATOMIC_RELAXED);
+        for (size_t i = 0; i < TRACE_RING_SIZE; i++) g_rings[cpu].records[i].seq = 0;
+        irq_restore(flags);
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef ESTELLA_LOG_TRACE_H
+#define ESTELLA_LOG_TRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <arch/x86_64/jump_label.h>
+
+// Binary event trace. Each tracepoint writes one fixed-size record into the
+// ring of the CPU it runs on; the oldest records are overwritten. A
+// tracepoint whose event is off is a 5-byte NOP (see jump_label.h).
+//
+// `trace dump` on serial prints the rings as hex, tools/tracedecode.py
+// turns that into a timeline.
+
+#define TRACE_MAX_CPUS   4
+#define TRACE_RING_SIZE  2048   // records per CPU, power of two
+
+// event ids, stable: the decoder knows them by number
+#define TRACE_LAPIC_TIMER   1   // arg0 = tick count
+#define TRACE_KEYBOARD      2   // arg0 = scancode
+#define TRACE_PMM_ALLOC     3   // arg0 = frames, arg1 = physical address (0 = failed)
+#define TRACE_VMM_MAP       4   // arg0 = virtual, arg1 = physical | flags
+#define TRACE_EVENT_COUNT   5
+
+struct trace_record {
+    uint64_t tsc;
+    uint64_t arg0;
+    uint64_t arg1;
+    uint16_t event;
+    uint16_t cpu;
+    uint32_t seq;       // low bits of ring position + 1, written last
+};
+
+_Static_assert(sizeof(struct trace_record) == 32, "trace records are 32 bytes");
+
+extern struct static_key trace_keys[TRACE_EVENT_COUNT];
+
+void trace_record(uint16_t event, uint64_t arg0, uint64_t arg1);
+
+#define trace(event, arg0, arg1)                                            \
+    do {                                                                    \
+        if (static_key_false(&trace_keys[event]))                           \
+            trace_record((event), (uint64_t)(arg0), (uint64_t)(arg1));      \
+    } while (0)
+
+// loads IA32_TSC_AUX with the CPU number so records can be tagged by rdtscp
+void trace_init(void);
+
+// mask of (1 << event) bits; returns the number of call sites patched
+int trace_enable(uint32_t mask);
+int trace_disable(uint32_t mask);
+uint32_t trace_enabled_mask(void);
+// comma-separated event names ("timer,kbd,pmm,vmm" or "all") to a mask
+uint32_t trace_parse_events(const char *list);
+
+// prints every CPU's ring on serial, oldest first
+void trace_dump(void);
+void trace_reset(void);
+
+#endif
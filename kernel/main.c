@@ -6,18 +6,32 @@
 
 #include <klib/memory.h>
 #include <klib/string.h>
+#include <klib/printf.h>
 #include <arch/x86_64/gdt.h>
 #include <arch/x86_64/idt.h>
 #include <arch/x86_64/acpi.h>
 #include <arch/x86_64/apic.h>
+#include <arch/x86_64/cpufeature.h>
+#include <arch/x86_64/alternative.h>
+#include <arch/x86_64/idle.h>
+#include <arch/x86_64/irq.h>
+#include <arch/x86_64/tsc.h>
 #include <drivers/font.h>
 #include <drivers/fbtext.h>
+#include <drivers/fb2d.h>
 #include <drivers/serial.h>
+#include <drivers/virtio_console.h>
 #include <drivers/keyboard.h>
+#include <log/logring.h>
+#include <log/klog.h>
+#include <log/trace.h>
 #include <mm/pmm.h>
 #include <mm/vmm.h>
 #include <colors.h>
+#include <time/hrtimer.h>
+#include <time/clocksource.h>
 #include <stopwatch.h>
+#include <cmdline.h>
 
 #define ESTELLA_VERSION "v0.Estella.7.0"
 
@@ -66,6 +80,12 @@ volatile struct limine_rsdp_request rsdp_request = {
     .revision = 0
 };
 
+__attribute__((used, section(".limine_requests")))
+static volatile struct limine_executable_cmdline_request cmdline_request = {
+    .id = LIMINE_EXECUTABLE_CMDLINE_REQUEST_ID,
+    .revision = 0
+};
+
 __attribute__((used, section(".limine_requests_start")))
 static volatile uint64_t limine_requests_start_marker[] = LIMINE_REQUESTS_START_MARKER;
 
@@ -79,8 +99,10 @@ void hcf(void) {
 }
 
 static void print_system_info(struct limine_framebuffer *fb) {
-    fb_print("SonnaOS ", COL_TITLE);
-    fb_print("https://github.com/aprentxdev/SonnaOS", 0x20B2AA);
+    // banner goes through the log ring so it stays in order with klog output
+    logring_puts("SonnaOS ", COL_TITLE, LOG_SINK_FB);
+    logring_puts("https://github.com/aprentxdev/SonnaOS\n", 0x20B2AA, LOG_SINK_FB);
+    logring_puts(ESTELLA_VERSION " x86_64 EFI | limine protocol\n", COL_VERSION, LOG_SINK_FB);
 
     if (firmware_type_request.response) {
         const char *fw = "Unknown";
@@ -90,17 +112,9 @@ static void print_system_info(struct limine_framebuffer *fb) {
             case LIMINE_FIRMWARE_TYPE_EFI64: fw = "EFI64"; break;
             case LIMINE_FIRMWARE_TYPE_SBI: fw = "SBI"; break;
         }
-        fb_print("   Firmware:   ", COL_LABEL);
-        fb_print(fw, COL_VALUE);
-        fb_print("\n", 0);
-
-        serial_puts("Firmware: ");
-        serial_puts(fw);
-        serial_puts("\n");
+        klog_color(KLOG_INFO, COL_VALUE, "Firmware: %s", fw);
     }
 
-    fb_print(ESTELLA_VERSION " x86_64 EFI | limine protocol", COL_VERSION);
-    
     if (bootloader_info_request.response) {
         char bootloader_str[64];
         {
@@ -121,13 +135,7 @@ static void print_system_info(struct limine_framebuffer *fb) {
             bootloader_str[pos < sizeof(bootloader_str) ? pos : sizeof(bootloader_str) - 1] = '\0'; 
         }
 
-        fb_print("     Bootloader: ", COL_LABEL);
-        fb_print(bootloader_str, COL_VALUE);
-        fb_print("\n", 0);
-
-        serial_puts("Bootloader: ");
-        serial_puts(bootloader_str);
-        serial_puts("\n");
+        klog_color(KLOG_INFO, COL_VALUE, "Bootloader: %s", bootloader_str);
     }
 }
 
@@ -137,52 +145,16 @@ static void print_memory_info(void) {
     size_t free = pmm_get_free_frames();
     size_t used = pmm_get_used_frames();
 
-    fb_print("Memory Overview\n", COL_SECTION_TITLE);
-
-    fb_print("> Total   ", COL_LABEL);
-    fb_print_number(total * PAGE_SIZE / 1024 / 1024, COL_VALUE);
-    fb_print(" MiB (", COL_VALUE);
-    fb_print_number(total, COL_VALUE);
-    fb_print(" pages)\n", COL_VALUE);
-
-    fb_print("> Usable  ", COL_LABEL);
-    fb_print_number(usable * PAGE_SIZE / 1024 / 1024, COL_VALUE);
-    fb_print(" MiB (", COL_VALUE);
-    fb_print_number(usable, COL_VALUE);
-    fb_print(" pages)\n", COL_VALUE);
-
-    fb_print("> Used    ", COL_LABEL);
-    fb_print_number(used * PAGE_SIZE / 1024 / 1024, COL_USED);
-    fb_print(" MiB (", COL_USED);
-    fb_print_number(used, COL_USED);
-    fb_print(" pages)\n", COL_USED);
-
-    fb_print("> Free    ", COL_LABEL);
-    fb_print_number(free * PAGE_SIZE / 1024 / 1024, COL_FREE);
-    fb_print(" MiB (", COL_FREE);
-    fb_print_number(free, COL_FREE);
-    fb_print(" pages)\n\n", COL_FREE);
-
-    char buf[80];
-    serial_puts("Memory: total ");
-    u64_to_dec(total * PAGE_SIZE / 1024 / 1024, buf);
-    serial_puts(buf);
-    serial_puts(" MiB (");
-    u64_to_dec(total, buf);
-    serial_puts(buf);
-    serial_puts(" pages), usable ");
-    u64_to_dec(usable * PAGE_SIZE / 1024 / 1024, buf);
-    serial_puts(buf);
-    serial_puts(" MiB (");
-    u64_to_dec(usable, buf);
-    serial_puts(buf);
-    serial_puts(" pages), free ");
-    u64_to_dec(free * PAGE_SIZE / 1024 / 1024, buf);
-    serial_puts(buf);
-    serial_puts(" MiB (");
-    u64_to_dec(free, buf);
-    serial_puts(buf);
-    serial_puts(" pages)\n");
+    size_t total_mib = total * PAGE_SIZE / 1024 / 1024;
+    size_t usable_mib = usable * PAGE_SIZE / 1024 / 1024;
+    size_t free_mib = free * PAGE_SIZE / 1024 / 1024;
+    size_t used_mib = used * PAGE_SIZE / 1024 / 1024;
+
+    klog_color(KLOG_INFO, COL_SECTION_TITLE, "Memory Overview");
+    klog_color(KLOG_INFO, COL_VALUE, "> Total   %zu MiB (%zu pages)", total_mib, total);
+    klog_color(KLOG_INFO, COL_VALUE, "> Usable  %zu MiB (%zu pages)", usable_mib, usable);
+    klog_color(KLOG_INFO, COL_USED,  "> Used    %zu MiB (%zu pages)", used_mib, used);
+    klog_color(KLOG_INFO, COL_FREE,  "> Free    %zu MiB (%zu pages)", free_mib, free);
 }
 
 void run_pmm_tests(void) {
@@ -203,21 +175,18 @@ void run_pmm_tests(void) {
     if (*(uint64_t*)phys_to_virt((uint64_t)p4) != 0) goto fail;
     pmm_free(p4);
 
-    fb_print("PMM tests: OK\n", COL_SUCCESS_INIT);
-    serial_puts("PMM tests OK\n");
+    klog_color(KLOG_INFO, COL_SUCCESS_INIT, "PMM tests: OK");
     return;
 
 fail:
-    fb_print("PMM tests: FAILED\n", COL_FAIL);
-    serial_puts("PMM tests FAILED\n");
+    klog_err("PMM tests: FAILED");
 }
 
 void run_vmm_tests(void) {
     uint64_t vaddr = 0xFFFF900000000000ULL;
     void *phys = pmm_alloc();
     if (!phys) {
-        fb_print("VMM tests: FAILED\n", COL_FAIL);
-        serial_puts("VMM tests FAILED\n");
+        klog_err("VMM tests: FAILED");
     }
 
     if (!vmm_map(vaddr, (uint64_t)phys, PTE_KERNEL_RW)) pmm_free(phys);
@@ -229,8 +198,320 @@ void run_vmm_tests(void) {
     vmm_unmap(vaddr);
     pmm_free(phys);
 
-    fb_print("VMM tests: OK\n", COL_SUCCESS_INIT);
-    serial_puts("VMM tests OK\n");
+    klog_color(KLOG_INFO, COL_SUCCESS_INIT, "VMM tests: OK");
+}
+
+static void print_keyboard_stats(void) {
+    struct keyboard_stats st;
+    keyboard_get_stats(&st);
+
+    uint64_t tsc_per_us = tsc_frequency_hz / 1000000;
+    if (!tsc_per_us) tsc_per_us = 1;
+
+    kprintf("keyboard: %lu events, %lu dropped, %lu handled, latency us min %lu avg %lu max %lu\n",
+            st.events, st.dropped, st.handled,
+            st.latency_min_tsc / tsc_per_us,
+            st.handled ? st.latency_total_tsc / st.handled / tsc_per_us : 0,
+            st.latency_max_tsc / tsc_per_us);
+}
+
+static void print_idle_stats(void) {
+    struct idle_stats st;
+    idle_get_stats(&st);
+
+    uint64_t tsc_per_us = tsc_frequency_hz / 1000000;
+    if (!tsc_per_us) tsc_per_us = 1;
+    uint64_t span = timer_get_tsc() - st.since_tsc;
+    uint64_t permille = span ? st.idle_tsc / (span / 1000 + 1) : 0;
+
+    kprintf("idle: %s, residency %lu.%lu%% over %lu ms, %lu sleeps (%lu spurious)\n",
+            idle_mode_name(st.mode), permille / 10, permille % 10, span / tsc_per_us / 1000,
+            st.sleeps, st.spurious);
+    kprintf("idle: wakeups kbd %lu timer %lu serial %lu log %lu, latency us min %lu avg %lu max %lu\n",
+            st.wakeups[0], st.wakeups[1], st.wakeups[2], st.wakeups[3],
+            st.latency_min_tsc / tsc_per_us,
+            st.latency_count ? st.latency_total_tsc / st.latency_count / tsc_per_us : 0,
+            st.latency_max_tsc / tsc_per_us);
+}
+
+static void print_hrtimer_stats(void) {
+    struct hrtimer_stats st;
+    hrtimer_get_stats(&st);
+
+    kprintf("hrtimer: %s, %lu fired, %lu overruns, %lu interrupts, %lu deadline writes, "
+            "late ns min %lu avg %lu max %lu\n",
+            timer_mode_name(), st.fired, st.overruns, st.interrupts, st.programmed,
+            hrtimer_tsc_to_ns(st.late_min_tsc),
+            st.fired ? hrtimer_tsc_to_ns(st.late_total_tsc / st.fired) : 0,
+            hrtimer_tsc_to_ns(st.late_max_tsc));
+
+    struct timer_stats tick;
+    timer_get_stats(&tick);
+    uint64_t seconds = tsc_frequency_hz ? tick.elapsed_tsc / tsc_frequency_hz : 0;
+    kprintf("tick: %lu jiffies, %lu timer interrupts, %lu avoided (%lu/s), period %lu ns, lapic %lu Hz\n",
+            tick.jiffies, tick.interrupts, tick.avoided, seconds ? tick.avoided / seconds : 0,
+            tick.period_ns, tick.lapic_hz);
+}
+
+static void print_irq_stats(void) {
+    for (int v = IRQ_VECTOR_BASE; v < IRQ_VECTOR_COUNT; v++) {
+        struct irq_stats st;
+        uint32_t gsi;
+        if (!irq_get_stats(v, &st, &gsi)) continue;
+
+        uint64_t avg = st.count ? st.total_cycles / st.count : 0;
+        if (gsi != IRQ_NO_GSI)
+            kprintf("irq 0x%x (gsi %u): %lu interrupts, cycles avg %lu max %lu\n",
+                    v, gsi, st.count, avg, st.max_cycles);
+        else
+            kprintf("irq 0x%x: %lu interrupts, cycles avg %lu max %lu\n", v, st.count, avg, st.max_cycles);
+    }
+}
+
+static void print_tsc_calibration(void) {
+    struct tsc_calibration cal;
+    tsc_get_calibration(&cal);
+
+    kprintf("tsc: %lu Hz via %s, %u windows (%u rejected), +-%lu ppm, %lu us",
+            cal.hz, cal.source ? cal.source : "none", cal.windows, cal.rejected, cal.error_ppm,
+            cal.hz >= 1000000 ? cal.duration_tsc / (cal.hz / 1000000) : 0);
+    if (cal.refined_hz) kprintf(", refined %lu Hz", cal.refined_hz);
+    kprintf("\n");
+}
+
+static void print_serial_stats(void) {
+    struct serial_stats st;
+    serial_get_stats(&st);
+
+    kprintf("serial: %lu bytes queued, %lu dropped, %lu polled, %lu interrupts, "
+            "%lu bytes per interrupt (max %lu)\n",
+            st.tx_queued, st.tx_dropped, st.tx_polled, st.tx_interrupts,
+            st.tx_interrupts ? st.tx_irq_bytes / st.tx_interrupts : 0, st.tx_batch_max);
+    kprintf("serial: %lu bytes received, %lu dropped, %lu overruns, %lu interrupts, "
+            "%lu bytes per interrupt (max %lu)\n",
+            st.rx_bytes, st.rx_dropped, st.rx_overruns, st.rx_interrupts,
+            st.rx_interrupts ? st.rx_bytes / st.rx_interrupts : 0, st.rx_batch_max);
+}
+
+static void serial_setup_from_cmdline(void) {
+    uint64_t baud = SERIAL_DEFAULT_BAUD;
+    uint64_t trigger = 14;
+
+    cmdline_get_u64("serial.baud", &baud);
+    cmdline_get_u64("serial.rxtrigger", &trigger);
+
+    if (baud == SERIAL_DEFAULT_BAUD && trigger == 14) return;
+
+    // checked before narrowing, so 270 cannot pass as a trigger of 14
+    if (baud > UINT32_MAX || trigger > UINT8_MAX || !serial_configure((uint32_t)baud, (uint8_t)trigger)) {
+        kprintf("serial: ignoring serial.baud=%lu serial.rxtrigger=%lu\n", baud, trigger);
+    }
+}
+
+// log=serial (default), log=virtio or log=both picks the debug channel
+static void log_setup_from_cmdline(void) {
+    char route[16];
+    if (!cmdline_get_str("log", route, sizeof(route))) return;
+
+    unsigned sinks = LOG_SINK_SERIAL;
+    if (!strcmp(route, "virtio")) sinks = LOG_SINK_VIRTIO;
+    else if (!strcmp(route, "both")) sinks = LOG_SINK_SERIAL | LOG_SINK_VIRTIO;
+
+    if ((sinks & LOG_SINK_VIRTIO) && !virtio_console_present()) {
+        kprintf("log: %s requested but there is no virtio console\n", route);
+    }
+    logring_route_serial(sinks);
+}
+
+// loglevel=err|warn|info|debug, klog.fb=off keeps klog off the console
+static void klog_setup_from_cmdline(void) {
+    char value[16];
+
+    if (cmdline_get_str("loglevel", value, sizeof(value))) {
+        int level = klog_parse_level(value);
+        if (level >= 0) klog_set_level(level);
+        else klog_warn("unknown loglevel '%s'", value);
+    }
+    if (cmdline_get_str("klog.fb", value, sizeof(value)) && !strcmp(value, "off")) {
+        klog_mute("fb", true);
+    }
+}
+
+static bool parse_idle_mode(const char *s, enum idle_mode *mode) {
+    for (enum idle_mode m = IDLE_POLL; m <= IDLE_MWAIT; m++) {
+        if (!strcmp(s, idle_mode_name(m))) {
+            *mode = m;
+            return true;
+        }
+    }
+    return false;
+}
+
+// idle=poll|hlt|mwait overrides the pick made from CPUID
+static void idle_setup_from_cmdline(void) {
+    char value[8];
+    enum idle_mode mode;
+
+    if (!cmdline_get_str("idle", value, sizeof(value))) return;
+    if (!parse_idle_mode(value, &mode) || !idle_set_mode(mode)) {
+        klog_warn("idle=%s not available", value);
+    }
+}
+
+// trace=timer,kbd,pmm,vmm (or all) turns tracepoints on from boot
+static void trace_setup_from_cmdline(void) {
+    char events[48];
+    if (!cmdline_get_str("trace", events, sizeof(events))) return;
+
+    uint32_t mask = trace_parse_events(events);
+    int sites = trace_enable(mask);
+    klog_info("trace: %s, %d call sites patched", events, sites);
+}
+
+// trace on|off <events>, trace dump, trace reset
+static void run_trace_command(size_t argc, char **argv) {
+    if (argc > 2 && !strcmp(argv[1], "on")) {
+        kprintf("trace: %d call sites enabled\n", trace_enable(trace_parse_events(argv[2])));
+    } else if (argc > 2 && !strcmp(argv[1], "off")) {
+        kprintf("trace: %d call sites disabled\n", trace_disable(trace_parse_events(argv[2])));
+    } else if (argc > 1 && !strcmp(argv[1], "dump")) {
+        trace_dump();
+    } else if (argc > 1 && !strcmp(argv[1], "reset")) {
+        trace_reset();
+    } else {
+        kprintf("trace: events mask %x; usage: trace on|off <timer,kbd,pmm,vmm|all>, trace dump, trace reset\n",
+                trace_enabled_mask());
+    }
+}
+
+static void run_benchmarks(struct fb_surface *screen, size_t console_lines) {
+    // results go to serial; console log output would only disturb the timings
+    struct klog_sink *fb_sink = klog_find_sink("fb");
+    bool was_muted = fb_sink->muted;
+    fb_sink->muted = true;
+
+    fb_bench_glyphs(100000);
+    fb_bench_console(console_lines);
+    fb2d_bench(screen);
+    logring_bench(256);
+    virtio_console_bench(64 * 1024);
+    hrtimer_bench(1000, 250);
+    clocksource_bench(1000000);
+    print_serial_stats();
+
+    fb_sink->muted = was_muted;
+    klog_info("benchmarks done, results on serial");
+}
+
+// Commands typed on COM1, one per line. Lets a test harness drive the
+// kernel without a keyboard.
+static void run_serial_command(char *line, struct fb_surface *screen) {
+    char *argv[4];
+    size_t argc = 0;
+
+    for (char *p = line; *p && argc < 4;) {
+        while (*p == ' ') *p++ = '\0';
+        if (!*p) break;
+        argv[argc++] = p;
+        while (*p && *p != ' ') p++;
+    }
+    if (!argc) return;
+
+    uint64_t value = 0;
+    bool has_value = argc > 1 && str_to_u64(argv[1], strlen(argv[1]), &value);
+
+    if (!strcmp(argv[0], "help")) {
+        kprintf("commands: help, bench [console lines], stats, baud <rate>, loglevel <level>, "
+                "fblog on|off, dmesg, trace ..., idle [poll|hlt|mwait|reset], stopwatch, panic\n");
+    } else if (!strcmp(argv[0], "bench")) {
+        run_benchmarks(screen, has_value && value ? (size_t)value : 2000);
+    } else if (!strcmp(argv[0], "stats")) {
+        print_serial_stats();
+        print_keyboard_stats();
+        print_idle_stats();
+        print_hrtimer_stats();
+        print_irq_stats();
+        print_tsc_calibration();
+    } else if (!strcmp(argv[0], "baud") && has_value) {
+        // rejected before the cast, which would wrap 2^32 + 9600 to 9600
+        if (value > UINT32_MAX) {
+            kprintf("serial: %lu baud is not a divisor of 115200\n", value);
+        } else {
+            kprintf("serial: switching to %lu baud\n", value);
+            logring_drain(0);
+            // keeps the RX trigger serial.rxtrigger= set
+            if (!serial_configure((uint32_t)value, serial_get_rx_trigger())) {
+                kprintf("serial: %lu baud is not a divisor of 115200\n", value);
+            }
+        }
+    } else if (!strcmp(argv[0], "loglevel") && argc > 1) {
+        int level = klog_parse_level(argv[1]);
+        if (level >= 0) klog_set_level(level);
+        kprintf("klog: level %s\n", klog_level_name(klog_level));
+    } else if (!strcmp(argv[0], "fblog") && argc > 1) {
+        klog_mute("fb", strcmp(argv[1], "on") != 0);
+    } else if (!strcmp(argv[0], "dmesg")) {
+        klog_dump();
+    } else if (!strcmp(argv[0], "trace")) {
+        run_trace_command(argc, argv);
+    } else if (!strcmp(argv[0], "idle")) {
+        enum idle_mode mode;
+        if (argc > 1 && !strcmp(argv[1], "reset")) {
+            idle_reset_stats();
+        } else if (argc > 1 && (!parse_idle_mode(argv[1], &mode) || !idle_set_mode(mode))) {
+            kprintf("idle: %s not available\n", argv[1]);
+        } else {
+            print_idle_stats();
+        }
+    } else if (!strcmp(argv[0], "stopwatch")) {
+        stopwatch_toggle();
+    } else if (!strcmp(argv[0], "panic")) {
+        asm ("ud2");
+    } else {
+        kprintf("unknown command '%s', try help\n", argv[0]);
+    }
+}
+
+static void handle_key(const struct key_event *ev, struct fb_surface *screen) {
+    if (ev->released) return;
+
+    switch (ev->scancode) {
+        case KEY_PAGE_UP:
+            fb_scroll_view((int)fbtext_get_rows() - 1);
+            return;
+        case KEY_PAGE_DOWN:
+            fb_scroll_view(-((int)fbtext_get_rows() - 1));
+            return;
+    }
+
+    switch (ev->ch) {
+        case 't':
+        case 'T':
+            stopwatch_toggle();
+            break;
+
+        case 'b':
+        case 'B':
+            run_benchmarks(screen, 2000);
+            break;
+
+        case '[':
+            fb_scroll_view((int)fbtext_get_rows() / 2);
+            break;
+
+        case ']':
+            fb_scroll_view(-(int)fbtext_get_rows() / 2);
+            break;
+
+        case 'q':
+        case 'Q':
+            logring_puts("\nTriggering test panic...\n", COL_FAIL, LOG_SINK_ALL);
+            asm ("ud2");
+            break;
+
+        default:
+            break;
+    }
 }
 
 void EstellaEntry(void) {
@@ -242,6 +523,12 @@ void EstellaEntry(void) {
     serial_puts("EstellaEntry\n");
 
     if (!LIMINE_BASE_REVISION_SUPPORTED(limine_base_revision)) hcf();
+
+    if (cmdline_request.response) {
+        cmdline_init(cmdline_request.response->cmdline);
+        serial_setup_from_cmdline();
+        klog_setup_from_cmdline();
+    }
     if (!framebuffer_request.response || framebuffer_request.response->framebuffer_count == 0) hcf();
     if (!hhdm_request.response || !memmap_request.response || !module_request.response || !rsdp_request.response) hcf();
 
@@ -261,63 +548,81 @@ void EstellaEntry(void) {
         .line_height = psf2->height + 1,
         .glyph_count = psf2->length
     };
+    font_load_unicode(&font, font_module);
     struct limine_framebuffer *fb = framebuffer_request.response->framebuffers[0];
     fbtext_init(fb, &font);
 
+    struct fb_surface screen;
+    fb2d_surface_from_limine(&screen, fb);
+
+    // CPUID must be known before any feature-dependent code runs
+    cpu_features_init();
+    apply_alternatives();
+    trace_init();
+    trace_setup_from_cmdline();
+
     // init everything
-    gdt_init(); fb_print("GDT with TSS initialized;", COL_SUCCESS_INIT);
-    idt_init(); fb_print(" IDT initialized;", COL_SUCCESS_INIT);
-    pmm_init(); fb_print("  PMM initialized;", COL_SUCCESS_INIT); 
-    vmm_init(); fb_print("  VMM initialized;", COL_SUCCESS_INIT); 
-    apic_init(); fb_print("  APIC initialized;", COL_SUCCESS_INIT);
-    keyboard_init(); fb_print(" PS/2 keyboard driver initialized\n", COL_SUCCESS_INIT);
+    gdt_init();
+    idt_init();
+    // exceptions can flush the log ring from here on
+    logring_set_async(true);
+    pmm_init();
+    vmm_init();
+    fbtext_enable_backbuffer();
+    apic_init();
+    clocksource_init();
+    tsc_refine_start();
+    // at most one framebuffer blit per 60 Hz frame from here on
+    fbtext_set_flush_interval(tsc_frequency_hz / 60);
+    keyboard_init();
+    serial_enable_irq();
+    kprintf("cmdline: \"%s\"\n", cmdline_raw());
+    virtio_console_init();
+    log_setup_from_cmdline();
     stopwatch_init();
+    idle_init();
+    idle_setup_from_cmdline();
 
     run_pmm_tests(); run_vmm_tests();
-    fb_print("\n", 0); print_system_info(fb);
-    fb_print("\n", 0); print_memory_info();
+    logring_puts("\n", 0, LOG_SINK_FB); print_system_info(fb);
+    logring_puts("\n", 0, LOG_SINK_FB); print_memory_info();
 
     // Enabling interrupts
     asm volatile("sti");
 
-    fb_print("Controls:\n", COL_INFO);
-    fb_print("t : Start / Pause stopwatch\n", COL_INFO);
-    fb_print("q : Trigger kernel panic (from #UD)\n", COL_INFO);
-    fb_print("\n", 0);
-
-    serial_puts("Controls: t = toggle stopwatch, q = trigger panic\n");
+    klog_color(KLOG_INFO, COL_INFO, "Controls:");
+    klog_color(KLOG_INFO, COL_INFO, "t : Start / Pause stopwatch");
+    klog_color(KLOG_INFO, COL_INFO, "b : Run benchmarks");
+    klog_color(KLOG_INFO, COL_INFO, "[ / ], PgUp / PgDn : Scroll back / forward");
+    klog_color(KLOG_INFO, COL_INFO, "q : Trigger kernel panic (from #UD)");
 
     while (1)
     {
-        if (keyboard_has_data())
-        {
-            char ch = keyboard_get_char();
-
-            if (ch != 0)
-            {
-                switch (ch)
-                {
-                    case 't':
-                    case 'T':
-                        stopwatch_toggle();
-                        break;
-
-                    case 'q':
-                    case 'Q':
-                        fb_print("\nTriggering test panic...\n", COL_FAIL);
-                        serial_puts("\nTriggering test panic...\n");
-                        asm ("ud2");
-                        break;
-                    default:
-                        break;
-                }
-            }
+        struct key_event ev;
+        while (keyboard_read_event(&ev)) {
+            handle_key(&ev, &screen);
         }
 
-        uint64_t now = timer_get_tsc();
-        stopwatch_update(now, tsc_frequency_hz);
+        stopwatch_update(clock_monotonic_ns());
+
+        // more may be waiting behind a command line or a full drain budget
+        char line[SERIAL_LINE_MAX];
+        bool busy = serial_poll_line(line, sizeof(line));
+        if (busy) {
+            run_serial_command(line, &screen);
+        }
+
+        busy |= logring_drain(LOGRING_IDLE_BUDGET) >= LOGRING_IDLE_BUDGET;
+
+        if (busy) {
+            fb_flush_tick();
+            continue;
+        }
 
-        asm volatile("pause");
+        // nothing left: show what was printed, then sleep until a
+        // keyboard, timer, serial or log wakeup
+        fb_flush();
+        idle_wait();
     }
 
     hcf();
@@ -1,9 +1,13 @@
 // Physical memory manager using a simple bitmap
+#define KLOG_TAG "pmm"
+
 #include <mm/pmm.h>
 #include <stdbool.h>
 #include <klib/memory.h>
-#include <drivers/serial.h>
 #include <klib/string.h>
+#include <log/klog.h>
+#include <log/trace.h>
+#include <colors.h>
 
 static uint8_t *pmm_bitmap; 
 static size_t pmm_bitmap_bytes;
@@ -156,7 +160,8 @@ void pmm_init() {
         }
     }
 
-    serial_puts("PMM initialized\n");
+    klog_color(KLOG_INFO, COL_SUCCESS_INIT, "PMM initialized, %zu of %zu frames free",
+               pmm_free_frames_count, pmm_total_frames_count);
 }
 
 void *pmm_alloc(void) {
@@ -175,6 +180,7 @@ void *pmm_alloc_zeroed(void) {
 
 void *pmm_alloc_frames(size_t count) {
     if (count == 0 || pmm_free_frames_count < count) {
+        trace(TRACE_PMM_ALLOC, count, 0);
         return NULL;
     }
 
@@ -199,6 +205,7 @@ void *pmm_alloc_frames(size_t count) {
                 pmm_used_frames_count += count;
 
                 next_fit_hint = (run_start + count) % pmm_bitmap_frames;
+                trace(TRACE_PMM_ALLOC, count, run_start * PAGE_SIZE);
                 return (void *)(run_start * PAGE_SIZE);
             }
         } else {
@@ -212,6 +219,7 @@ void *pmm_alloc_frames(size_t count) {
         }
     }
 
+    trace(TRACE_PMM_ALLOC, count, 0);
     return NULL;
 }
 
@@ -238,11 +246,7 @@ void pmm_free_frames(void *phys_addr, size_t count) {
         if (cur >= pmm_bitmap_frames) break;
 
         if (!pmm_test_frame(cur)) {
-            serial_puts("pmm_free_frames: double-free or invalid free at frame ");
-            char buf[32];
-            u64_to_dec(cur, buf);
-            serial_puts(buf);
-            serial_puts("\n");
+            klog_err("pmm_free_frames: double-free or invalid free at frame %zu", cur);
             continue;
         }
         pmm_clear_frame(cur);
@@ -1,7 +1,13 @@
+#define KLOG_TAG "vmm"
+
 #include <mm/vmm.h>
 #include <klib/memory.h>
-#include <drivers/serial.h>
 #include <klib/string.h>
+#include <arch/x86_64/cpu.h>
+#include <log/klog.h>
+#include <log/trace.h>
+#include <colors.h>
+#include <klib/printf.h>
 
 #define PML4_SHIFT 39
 #define PDP_SHIFT 30
@@ -20,10 +26,6 @@
 
 #define PAGE_OFFSET(v) ((v) & 0xFFF)
 
-static inline void invlpg(uint64_t addr) {
-    asm volatile("invlpg (%0)" ::"r"(addr) : "memory");
-}
-
 static uint64_t kernel_pml4_phys = 0;
 
 static uint64_t *get_pml4e(uint64_t *pml4, uint64_t virt) {
@@ -60,7 +62,7 @@ static bool create_table(uint64_t *entry, uint64_t flags) {
     if (*entry & PTE_PRESENT) return true;
     void *new_table = pmm_alloc_zeroed();
     if (!new_table) {
-        serial_puts("create_table: failed to alloc page table");
+        klog_err("create_table: failed to alloc page table");
         return false;
     }
     uint64_t phys = (uint64_t)new_table;
@@ -71,6 +73,8 @@ static bool create_table(uint64_t *entry, uint64_t flags) {
 bool vmm_map(uint64_t virt, uint64_t phys, uint64_t flags) {
     if (virt & 0xFFF || phys & 0xFFF) return false;
 
+    trace(TRACE_VMM_MAP, virt, phys | (flags & 0xFFF));
+
     uint64_t *pml4 = (uint64_t *)phys_to_virt(kernel_pml4_phys);
 
     uint64_t *pml4e = get_pml4e(pml4, virt);
@@ -86,7 +90,7 @@ bool vmm_map(uint64_t virt, uint64_t phys, uint64_t flags) {
     if (!pte) return false;
 
     if (*pte & PTE_PRESENT) {
-        serial_puts("vmm_map: already mapped\n");
+        klog_warn("vmm_map: %p already mapped", (void *)virt);
         return false;
     }
 
@@ -110,7 +114,7 @@ bool vmm_map_huge_2mb(uint64_t virt, uint64_t phys, uint64_t flags) {
     if (!pde) return false;
 
     if (*pde & PTE_PRESENT) {
-        serial_puts("vmm_map_huge_2mb: already mapped\n");
+        klog_warn("vmm_map_huge_2mb: %p already mapped", (void *)virt);
         return false;
     }
 
@@ -183,15 +187,10 @@ void vmm_dump_pte(uint64_t virt) {
     uint64_t phys = vmm_get_physical(virt);
     uint64_t flags = vmm_get_flags(virt);
 
-    char buf[32];
-    serial_puts("virt: "); u64_to_hex(virt, buf); serial_puts(buf); serial_puts("\n");
-    serial_puts("phys: "); u64_to_hex(phys, buf); serial_puts(buf); serial_puts("\n");
-    serial_puts("flags: "); u64_to_hex(flags, buf); serial_puts(buf); serial_puts("\n");
+    kprintf("virt: %p\nphys: %p\nflags: %p\n", (void *)virt, (void *)phys, (void *)flags);
 }
 
 void vmm_init(void) {
-    uint64_t cr3;
-    asm volatile("mov %%cr3, %0" : "=r"(cr3));
-    kernel_pml4_phys = cr3 & ~0xFFFULL;
-    serial_puts("VMM initialized\n");
+    kernel_pml4_phys = read_cr3() & ~0xFFFULL;
+    klog_color(KLOG_INFO, COL_SUCCESS_INIT, "VMM initialized");
 }
\ No newline at end of file
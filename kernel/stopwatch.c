@@ -1,33 +1,49 @@
+#define KLOG_TAG "stopwatch"
+
 #include <stopwatch.h>
-#include <drivers/fbtext.h>
-#include <drivers/serial.h>
+#include <log/klog.h>
+#include <log/logring.h>
 #include <arch/x86_64/apic.h>
-#include <klib/string.h>
+#include <arch/x86_64/idle.h>
+#include <time/clocksource.h>
+#include <time/hrtimer.h>
 #include <colors.h>
 
+#define NS_PER_SEC 1000000000UL
+
 static bool running = false;
-static uint64_t start_tsc = 0;
-static uint64_t last_display = 0;
+static uint64_t start_ns = 0;
+static uint64_t shown_seconds = 0;
+
+// fires on each whole second after the start; the idle loop then redraws
+static void display_fn(struct hrtimer *timer)
+{
+    idle_wake(IDLE_WAKE_TIMER);
+}
+
+static struct hrtimer display_timer = { .fn = display_fn, .index = -1 };
 
 void stopwatch_init(void)
 {
     running = false;
-    start_tsc = 0;
-    last_display = 0;
+    start_ns = 0;
+    shown_seconds = 0;
 }
 
 void stopwatch_toggle(void)
 {
     if (running) {
+        uint64_t elapsed = stopwatch_get_elapsed_ns();
         running = false;
-        fb_print("stopwatch STOPPED\n", COL_WARNING);
-        serial_puts("stopwatch STOPPED\n");
+        hrtimer_cancel(&display_timer);
+        klog_color(KLOG_INFO, COL_WARNING, "stopwatch STOPPED at %lu.%06lu s",
+                   elapsed / NS_PER_SEC, elapsed % NS_PER_SEC / 1000);
     } else {
         running = true;
-        start_tsc = timer_get_tsc();
-        last_display = start_tsc;
-        fb_print("stopwatch STARTED\n", COL_USED);
-        serial_puts("stopwatch STARTED\n");
+        start_ns = clock_monotonic_ns();
+        shown_seconds = 0;
+        hrtimer_start_periodic(&display_timer, hrtimer_ns_to_tsc(NS_PER_SEC));
+        klog_color(KLOG_INFO, COL_USED, "stopwatch STARTED");
     }
 }
 
@@ -36,32 +52,27 @@ bool stopwatch_is_running(void)
     return running;
 }
 
-uint64_t stopwatch_get_elapsed_seconds(void)
+uint64_t stopwatch_get_elapsed_ns(void)
 {
     if (!running) return 0;
-    uint64_t now = timer_get_tsc();
-    return (now - start_tsc) / tsc_frequency_hz;
+    return clock_monotonic_ns() - start_ns;
 }
 
-void stopwatch_update(uint64_t current_tsc, uint64_t tsc_per_sec)
+uint64_t stopwatch_get_elapsed_seconds(void)
+{
+    return stopwatch_get_elapsed_ns() / NS_PER_SEC;
+}
+
+void stopwatch_update(uint64_t now_ns)
 {
     if (!running) return;
 
-    if (current_tsc - last_display >= tsc_per_sec)
+    uint64_t elapsed = (now_ns - start_ns) / NS_PER_SEC;
+    if (elapsed != shown_seconds)
     {
-        uint64_t elapsed = (current_tsc - start_tsc) / tsc_per_sec;
-
-        char buf[32];
-        u64_to_dec(elapsed, buf);
+        // a status line redrawn in place, not a log record
+        logring_printf(COL_VALUE, LOG_SINK_ALL, "Time: %lu s   \r", elapsed);
 
-        fb_print("Time: ", COL_LABEL);
-        fb_print(buf, COL_VALUE);
-        fb_print(" s   \r", COL_LABEL);
-
-        serial_puts("Time: ");
-        serial_puts(buf);
-        serial_puts(" s\r");
-
-        last_display = current_tsc;
+        shown_seconds = elapsed;
     }
-}
\ No newline at end of file
+}
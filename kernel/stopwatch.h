@@ -5,11 +5,13 @@
 #include <stdbool.h>
 
 void stopwatch_init(void);
-void stopwatch_update(uint64_t current_tsc, uint64_t tsc_per_sec);
+// redraws the elapsed seconds when they changed; now_ns from clock_monotonic_ns()
+void stopwatch_update(uint64_t now_ns);
 bool stopwatch_is_running(void);
 void stopwatch_toggle(void);
 void stopwatch_reset(void);
 
 uint64_t stopwatch_get_elapsed_seconds(void);
+uint64_t stopwatch_get_elapsed_ns(void);
 
 #endif
\ No newline at end of file
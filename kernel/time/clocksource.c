@@ -0,0 +1,229 @@
+#define KLOG_TAG "clock"
+
+#include <time/clocksource.h>
+#include <time/hrtimer.h>
+#include <arch/x86_64/acpi.h>
+#include <arch/x86_64/apic.h>
+#include <arch/x86_64/hpet.h>
+#include <arch/x86_64/pmtimer.h>
+#include <arch/x86_64/cpu.h>
+#include <arch/x86_64/cpufeature.h>
+#include <arch/x86_64/alternative.h>
+#include <mm/pmm.h>
+#include <mm/vmm.h>
+#include <log/klog.h>
+#include <klib/printf.h>
+#include <klib/string.h>
+
+// until clocksource_init() maps the real page
+static struct clock_page g_boot_page;
+
+static struct clock_page *g_page_rw = &g_boot_page;            // HHDM alias
+static const volatile struct clock_page *g_page = &g_boot_page;
+static uint64_t g_page_phys = 0;
+
+static struct clocksource *g_sources = NULL;
+static struct clocksource *g_current = NULL;
+
+// keeps cycle_last within half a wrap of narrow counters
+static struct hrtimer g_refresh_timer = { .index = -1 };
+
+static uint64_t tsc_read(void)
+{
+    return rdtsc();
+}
+
+static uint64_t hpet_counter_read(void)
+{
+    return hpet_read(HPET_MAIN_COUNTER);
+}
+
+static struct clocksource g_tsc_clocksource = {
+    .name = "tsc", .read = tsc_read, .mask = UINT64_MAX, .mode = CLOCK_MODE_TSC,
+};
+
+static struct clocksource g_hpet_clocksource = {
+    .name = "hpet", .read = hpet_counter_read, .rating = 250, .mode = CLOCK_MODE_NONE,
+};
+
+static struct clocksource g_pmtimer_clocksource = {
+    .name = "pmtimer", .read = pmtimer_read, .rating = 200, .mode = CLOCK_MODE_NONE,
+};
+
+static inline uint64_t read_counter(uint32_t mode)
+{
+    return mode == CLOCK_MODE_TSC ? rdtsc() : g_current->read();
+}
+
+uint64_t clock_monotonic_ns(void)
+{
+    const volatile struct clock_page *p = g_page;
+
+    for (;;) {
+        uint32_t seq = __atomic_load_n(&p->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1) {
+            asm volatile("pause");
+            continue;
+        }
+        if (p->mode == CLOCK_MODE_NONE && !g_current) return 0;
+
+        uint64_t delta = (read_counter(p->mode) - p->cycle_last) & p->mask;
+        // an unordered rdtsc may land just before cycle_last was taken
+        if (p->mask == UINT64_MAX && (int64_t)delta < 0) delta = 0;
+        uint64_t ns = p->base_ns + clocksource_cyc2ns(delta, p->mult, p->shift);
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&p->seq, __ATOMIC_RELAXED) == seq) return ns;
+    }
+}
+
+// Moves the base to now on cs, carrying over the time so far so the clock
+// stays continuous across a switch. Interrupts must be off.
+static void clock_page_update(struct clocksource *cs)
+{
+    uint64_t now_ns = clock_monotonic_ns();
+    struct clock_page *p = g_page_rw;
+
+    __atomic_store_n(&p->seq, p->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    p->cycle_last = cs->read();
+    p->base_ns = now_ns;
+    p->mask = cs->mask;
+    p->mode = cs->mode;
+    clocksource_calc_mult_shift(cs->freq_hz, &p->mult, &p->shift);
+    g_current = cs;
+
+    __atomic_store_n(&p->seq, p->seq + 1, __ATOMIC_RELEASE);
+}
+
+static void refresh_fn(struct hrtimer *timer)
+{
+    clock_page_update(g_current);
+}
+
+static void select_clocksource(struct clocksource *cs)
+{
+    uint64_t flags = irq_save();
+    clock_page_update(cs);
+    irq_restore(flags);
+
+    hrtimer_cancel(&g_refresh_timer);
+    if (cs->mask != UINT64_MAX && timer_running()) {
+        uint64_t wrap_ns = clocksource_cyc2ns(cs->mask, g_page_rw->mult, g_page_rw->shift);
+        g_refresh_timer.fn = refresh_fn;
+        hrtimer_start_periodic(&g_refresh_timer, hrtimer_ns_to_tsc(wrap_ns / 2));
+    }
+
+    klog_info("using %s, %lu Hz, mult %u shift %u", cs->name, cs->freq_hz,
+              g_page_rw->mult, g_page_rw->shift);
+}
+
+void clocksource_register(struct clocksource *cs)
+{
+    if (!cs->freq_hz) return;
+
+    cs->next = g_sources;
+    g_sources = cs;
+    klog_debug("%s: %lu Hz, rating %d", cs->name, cs->freq_hz, cs->rating);
+
+    if (!g_current || cs->rating > g_current->rating) select_clocksource(cs);
+}
+
+bool clocksource_set_freq(const char *name, uint64_t freq_hz)
+{
+    for (struct clocksource *cs = g_sources; cs; cs = cs->next) {
+        if (strcmp(cs->name, name)) continue;
+
+        uint64_t flags = irq_save();
+        if (cs == g_current) {
+            // time up to now is still converted at the old rate
+            clock_page_update(cs);
+            cs->freq_hz = freq_hz;
+            clock_page_update(cs);
+        } else {
+            cs->freq_hz = freq_hz;
+        }
+        irq_restore(flags);
+        return true;
+    }
+    return false;
+}
+
+static void clock_page_init(void)
+{
+    uint64_t phys = (uint64_t)pmm_alloc_zeroed();
+    if (!phys) {
+        klog_warn("no memory for the clock page, keeping it in .data");
+        return;
+    }
+    if (!vmm_map(CLOCK_PAGE_VADDR, phys, PTE_KERNEL_RO)) {
+        pmm_free((void *)phys);
+        return;
+    }
+
+    g_page_phys = phys;
+    g_page_rw = (struct clock_page *)phys_to_virt(phys);
+    *g_page_rw = g_boot_page;
+    g_page = (const volatile struct clock_page *)CLOCK_PAGE_VADDR;
+}
+
+void clocksource_init(void)
+{
+    clock_page_init();
+
+    if (tsc_frequency_hz) {
+        g_tsc_clocksource.freq_hz = tsc_frequency_hz;
+        g_tsc_clocksource.rating = cpu_has(X86_FEATURE_INVARIANT_TSC) ? 300 : 100;
+        clocksource_register(&g_tsc_clocksource);
+    }
+
+    // only needed as a fallback, and only probed then
+    if (!g_current || g_current->rating < 250) {
+        if (!hpet_va) hpet_init(rsdp_request.response->address);
+        if (hpet_frequency_hz) {
+            bool wide = hpet_read(HPET_CAPABILITIES) & HPET_CAP_COUNT_64;
+            g_hpet_clocksource.mask = wide ? UINT64_MAX : UINT32_MAX;
+            g_hpet_clocksource.freq_hz = hpet_frequency_hz;
+            clocksource_register(&g_hpet_clocksource);
+        }
+    }
+    if (!g_current || g_current->rating < 200) {
+        if (pmtimer_init(rsdp_request.response->address)) {
+            g_pmtimer_clocksource.mask = pmtimer_mask;
+            g_pmtimer_clocksource.freq_hz = PMTIMER_HZ;
+            clocksource_register(&g_pmtimer_clocksource);
+        }
+    }
+
+    if (!g_current) klog_warn("no clocksource, clock_monotonic_ns() stays 0");
+}
+
+const struct clocksource *clocksource_current(void)
+{
+    return g_current;
+}
+
+uint64_t clock_page_phys(void)
+{
+    return g_page_phys;
+}
+
+void clocksource_bench(size_t reads)
+{
+    if (!g_current || !reads) return;
+
+    uint64_t backwards = 0;
+    uint64_t prev = clock_monotonic_ns();
+    uint64_t start = rdtsc();
+
+    for (size_t i = 0; i < reads; i++) {
+        uint64_t now = clock_monotonic_ns();
+        if (now < prev) backwards++;
+        prev = now;
+    }
+
+    uint64_t cycles = rdtsc() - start;
+    kprintf("clock: %s, %zu reads, %lu cycles/read, %lu went backwards\n",
+            g_current->name, reads, cycles / reads, backwards);
+}
@@ -0,0 +1,80 @@
+#ifndef ESTELLA_TIME_CLOCKSOURCE_H
+#define ESTELLA_TIME_CLOCKSOURCE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Monotonic nanosecond clock. Each clocksource is a free-running counter;
+// the best registered one (highest rating) drives clock_monotonic_ns().
+// Counter to ns is ((delta & mask) * mult) >> shift with a 128-bit
+// product, so no division and no overflow for any delta.
+//
+// The conversion state lives on its own page, written by the kernel
+// through the HHDM and read through a read-only mapping. The layout of
+// struct clock_page is fixed so the page can later be mapped into user
+// mode for a syscall-free clock.
+
+#define CLOCK_PAGE_VADDR    0xFFFFFFFF7FFFF000ULL
+
+#define CLOCK_MODE_NONE     0   // counter only readable by the kernel
+#define CLOCK_MODE_TSC      1   // rdtsc, usable anywhere
+
+struct clock_page {
+    uint32_t seq;           // odd while the kernel is updating
+    uint32_t mode;          // CLOCK_MODE_*
+    uint64_t cycle_last;    // counter value at base_ns
+    uint64_t base_ns;
+    uint64_t mask;          // counter width
+    uint32_t mult;
+    uint32_t shift;
+};
+
+struct clocksource {
+    const char *name;
+    uint64_t (*read)(void);
+    uint64_t mask;
+    uint64_t freq_hz;
+    int rating;             // TSC 300 when invariant, HPET 250, PM timer 200, TSC 100 otherwise
+    uint32_t mode;          // CLOCK_MODE_*
+    struct clocksource *next;
+};
+
+static inline uint64_t clocksource_cyc2ns(uint64_t cycles, uint32_t mult, uint32_t shift)
+{
+    return (uint64_t)(((unsigned __int128)cycles * mult) >> shift);
+}
+
+// largest shift that keeps mult in 32 bits, for the most precision
+static inline void clocksource_calc_mult_shift(uint64_t freq_hz, uint32_t *mult, uint32_t *shift)
+{
+    // 1e9 << 33 still fits in 64 bits
+    for (uint32_t s = 33; s > 0; s--) {
+        uint64_t m = ((1000000000ULL << s) + freq_hz / 2) / freq_hz;
+        if (m <= UINT32_MAX) {
+            *mult = (uint32_t)m;
+            *shift = s;
+            return;
+        }
+    }
+    *mult = (uint32_t)(1000000000ULL / freq_hz);
+    *shift = 0;
+}
+
+// switches to cs if it rates higher than the current one
+void clocksource_register(struct clocksource *cs);
+// after a recalibration; the clock stays continuous. False if not registered.
+bool clocksource_set_freq(const char *name, uint64_t freq_hz);
+// registers the TSC, then HPET and PM timer as needed, maps the clock
+// page; after apic_init()
+void clocksource_init(void);
+const struct clocksource *clocksource_current(void);
+uint64_t clock_page_phys(void);
+
+// 0 until clocksource_init()
+uint64_t clock_monotonic_ns(void);
+
+// times clock_monotonic_ns() and checks it never goes backwards
+void clocksource_bench(size_t reads);
+
+#endif
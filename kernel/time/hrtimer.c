@@ -0,0 +1,255 @@
+#define KLOG_TAG "hrtimer"
+
+#include <time/hrtimer.h>
+#include <arch/x86_64/apic.h>
+#include <arch/x86_64/cpu.h>
+#include <log/klog.h>
+#include <klib/printf.h>
+
+#define NS_PER_SEC 1000000000ULL
+
+static struct hrtimer *g_heap[HRTIMER_MAX];
+static size_t g_count = 0;
+static uint64_t g_armed = 0;        // deadline last written, 0 = none
+static struct hrtimer_stats g_stats;
+
+static inline void heap_set(size_t i, struct hrtimer *timer)
+{
+    g_heap[i] = timer;
+    timer->index = (int)i;
+}
+
+static void sift_up(size_t i)
+{
+    struct hrtimer *timer = g_heap[i];
+
+    while (i) {
+        size_t parent = (i - 1) / 2;
+        if (g_heap[parent]->expires <= timer->expires) break;
+        heap_set(i, g_heap[parent]);
+        i = parent;
+    }
+    heap_set(i, timer);
+}
+
+static void sift_down(size_t i)
+{
+    struct hrtimer *timer = g_heap[i];
+
+    for (;;) {
+        size_t child = 2 * i + 1;
+        if (child >= g_count) break;
+        if (child + 1 < g_count && g_heap[child + 1]->expires < g_heap[child]->expires) child++;
+        if (timer->expires <= g_heap[child]->expires) break;
+        heap_set(i, g_heap[child]);
+        i = child;
+    }
+    heap_set(i, timer);
+}
+
+static bool heap_insert(struct hrtimer *timer)
+{
+    if (g_count == HRTIMER_MAX) return false;
+    heap_set(g_count++, timer);
+    sift_up(timer->index);
+    return true;
+}
+
+static void heap_remove(struct hrtimer *timer)
+{
+    size_t i = (size_t)timer->index;
+    timer->index = -1;
+
+    if (i != --g_count) {
+        struct hrtimer *last = g_heap[g_count];
+        heap_set(i, last);
+        sift_up(i);
+        sift_down((size_t)last->index);
+    }
+}
+
+// keeps the hardware armed for the head of the heap
+static void reprogram(void)
+{
+    uint64_t next = g_count ? g_heap[0]->expires : 0;
+    if (next == g_armed) return;
+
+    g_armed = next;
+    if (timer_program(next)) g_stats.programmed++;
+}
+
+void hrtimer_setup(struct hrtimer *timer, hrtimer_fn fn, void *data)
+{
+    timer->expires = 0;
+    timer->period = 0;
+    timer->fn = fn;
+    timer->data = data;
+    timer->index = -1;
+}
+
+// both fields change under irq_save: the timer may be queued and firing
+static bool start(struct hrtimer *timer, uint64_t expires, uint64_t period)
+{
+    uint64_t flags = irq_save();
+
+    if (timer->index >= 0) heap_remove(timer);
+    timer->expires = expires;
+    timer->period = period;
+    bool ok = heap_insert(timer);
+    reprogram();
+
+    irq_restore(flags);
+    if (!ok) klog_warn("queue full, timer %p not started", (void *)timer);
+    return ok;
+}
+
+bool hrtimer_start(struct hrtimer *timer, uint64_t expires)
+{
+    return start(timer, expires, 0);
+}
+
+bool hrtimer_start_periodic(struct hrtimer *timer, uint64_t period)
+{
+    if (!period) return false;
+    return start(timer, rdtsc() + period, period);
+}
+
+bool hrtimer_cancel(struct hrtimer *timer)
+{
+    uint64_t flags = irq_save();
+
+    bool pending = timer->index >= 0;
+    if (pending) {
+        heap_remove(timer);
+        reprogram();
+    }
+
+    irq_restore(flags);
+    return pending;
+}
+
+bool hrtimer_pending(const struct hrtimer *timer)
+{
+    return timer->index >= 0;
+}
+
+uint64_t hrtimer_next_expiry(void)
+{
+    uint64_t flags = irq_save();
+    uint64_t next = g_count ? g_heap[0]->expires : 0;
+    irq_restore(flags);
+    return next;
+}
+
+void hrtimer_interrupt(void)
+{
+    // a deadline disarms itself when it fires
+    g_armed = 0;
+    g_stats.interrupts++;
+
+    uint64_t now = rdtsc();
+    while (g_count && g_heap[0]->expires <= now) {
+        struct hrtimer *timer = g_heap[0];
+        uint64_t late = now - timer->expires;
+
+        heap_remove(timer);
+        if (timer->period) {
+            // keep the phase; skip whole periods the timer fell behind by
+            timer->expires += timer->period;
+            if (timer->expires <= now) {
+                uint64_t missed = (now - timer->expires) / timer->period + 1;
+                timer->expires += missed * timer->period;
+                g_stats.overruns += missed;
+            }
+            heap_insert(timer);
+        }
+
+        if (!g_stats.fired || late < g_stats.late_min_tsc) g_stats.late_min_tsc = late;
+        if (late > g_stats.late_max_tsc) g_stats.late_max_tsc = late;
+        g_stats.late_total_tsc += late;
+        g_stats.fired++;
+
+        timer->fn(timer);
+        now = rdtsc();
+    }
+
+    reprogram();
+}
+
+uint64_t hrtimer_ns_to_tsc(uint64_t ns)
+{
+    // split so neither product can overflow
+    return ns / NS_PER_SEC * tsc_frequency_hz + ns % NS_PER_SEC * tsc_frequency_hz / NS_PER_SEC;
+}
+
+uint64_t hrtimer_tsc_to_ns(uint64_t tsc)
+{
+    if (!tsc_frequency_hz) return 0;
+    return tsc / tsc_frequency_hz * NS_PER_SEC + tsc % tsc_frequency_hz * NS_PER_SEC / tsc_frequency_hz;
+}
+
+void hrtimer_get_stats(struct hrtimer_stats *out)
+{
+    uint64_t flags = irq_save();
+    *out = g_stats;
+    irq_restore(flags);
+}
+
+struct bench_state {
+    size_t left;
+    uint64_t interval;
+    uint64_t late_min;
+    uint64_t late_max;
+    uint64_t late_total;
+    size_t fired;
+};
+
+static void bench_fn(struct hrtimer *timer)
+{
+    struct bench_state *b = timer->data;
+    uint64_t late = rdtsc() - timer->expires;
+
+    if (!b->fired || late < b->late_min) b->late_min = late;
+    if (late > b->late_max) b->late_max = late;
+    b->late_total += late;
+    b->fired++;
+
+    // relative to the requested expiry, so lateness does not accumulate
+    if (--b->left) hrtimer_start(timer, timer->expires + b->interval);
+}
+
+void hrtimer_bench(size_t count, uint64_t interval_us)
+{
+    if (!tsc_frequency_hz || !timer_running() || !count) {
+        kprintf("hrtimer: no timer interrupt, skipping bench\n");
+        return;
+    }
+    // each expiry waits for a periodic tick; keep the run short
+    if (!timer_is_oneshot() && count > 50) count = 50;
+
+    struct bench_state b = {
+        .left = count,
+        .interval = hrtimer_ns_to_tsc(interval_us * 1000),
+    };
+    struct hrtimer timer;
+    hrtimer_setup(&timer, bench_fn, &b);
+
+    uint64_t start = rdtsc();
+    hrtimer_start(&timer, start + b.interval);
+
+    for (;;) {
+        uint64_t flags = irq_save();
+        if (!b.left) {
+            irq_restore(flags);
+            break;
+        }
+        sti_hlt();
+        irq_restore(flags);
+    }
+
+    uint64_t elapsed = rdtsc() - start;
+    kprintf("hrtimer: %zu x %lu us (%s) in %lu us, late ns min %lu avg %lu max %lu\n",
+            b.fired, interval_us, timer_mode_name(), hrtimer_tsc_to_ns(elapsed) / 1000,
+            hrtimer_tsc_to_ns(b.late_min), hrtimer_tsc_to_ns(b.late_total / b.fired),
+            hrtimer_tsc_to_ns(b.late_max));
+}
@@ -0,0 +1,65 @@
+#ifndef ESTELLA_TIME_HRTIMER_H
+#define ESTELLA_TIME_HRTIMER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// High-resolution timers. Callers own a struct hrtimer and queue it with an
+// absolute TSC expiry; pending timers sit in a binary min-heap and the timer
+// interrupt (TSC-deadline, LAPIC or HPET one-shot) is always armed for the
+// earliest one. With a periodic timer as fallback, expiries are only
+// noticed on the next tick.
+//
+// Callbacks run in the timer interrupt with interrupts off. They may start
+// or cancel any timer, including their own.
+
+#define HRTIMER_MAX 32      // timers pending at once
+
+struct hrtimer;
+typedef void (*hrtimer_fn)(struct hrtimer *timer);
+
+struct hrtimer {
+    uint64_t expires;       // absolute TSC
+    uint64_t period;        // TSC ticks, 0 = one-shot
+    hrtimer_fn fn;
+    void *data;
+    int index;              // heap slot, -1 when not queued
+};
+
+struct hrtimer_stats {
+    uint64_t fired;
+    uint64_t overruns;          // periods skipped because a periodic timer fell behind
+    uint64_t interrupts;        // timer interrupts handled
+    uint64_t programmed;        // deadline writes
+    uint64_t late_min_tsc;      // callback start minus requested expiry
+    uint64_t late_max_tsc;
+    uint64_t late_total_tsc;
+};
+
+void hrtimer_setup(struct hrtimer *timer, hrtimer_fn fn, void *data);
+
+// (re)queue as a one-shot for the absolute TSC value; false if the queue is full
+bool hrtimer_start(struct hrtimer *timer, uint64_t expires);
+// first expiry now + period, then every period
+bool hrtimer_start_periodic(struct hrtimer *timer, uint64_t period);
+// false if it was not pending
+bool hrtimer_cancel(struct hrtimer *timer);
+bool hrtimer_pending(const struct hrtimer *timer);
+
+// earliest pending expiry, 0 when nothing is queued
+uint64_t hrtimer_next_expiry(void);
+
+// called by the timer interrupt: runs what has expired, re-arms
+void hrtimer_interrupt(void);
+
+uint64_t hrtimer_ns_to_tsc(uint64_t ns);
+uint64_t hrtimer_tsc_to_ns(uint64_t tsc);
+
+void hrtimer_get_stats(struct hrtimer_stats *out);
+
+// fires a one-shot timer count times, each interval_us after the previous
+// expiry, and reports how late the callbacks ran on serial
+void hrtimer_bench(size_t count, uint64_t interval_us);
+
+#endif
@@ -0,0 +1,91 @@
+#!/usr/bin/env python3
+"""Turn a `trace dump` captured from the serial console into a timeline.
+
+    make run | tee serial.log       # then type `trace dump` on COM1
+    tools/tracedecode.py serial.log
+
+Record layout matches struct trace_record in kernel/log/trace.h.
+"""
+import argparse
+import struct
+import sys
+
+RECORD = struct.Struct("<QQQHHI")
+
+EVENTS = {
+    1: ("timer", lambda a0, a1: f"tick={a0}"),
+    2: ("kbd", lambda a0, a1: f"scancode=0x{a0:02x}{' (break)' if a0 & 0x80 else ''}"),
+    3: ("pmm_alloc", lambda a0, a1: f"frames={a0} phys=0x{a1:x}" if a1 else f"frames={a0} FAILED"),
+    4: ("vmm_map", lambda a0, a1: f"virt=0x{a0:x} phys=0x{a1 & ~0xFFF:x} flags=0x{a1 & 0xFFF:x}"),
+}
+
+
+def parse(lines):
+    tsc_hz = 0
+    records = []
+    inside = False
+
+    for line in lines:
+        line = line.strip()
+        if line.startswith("trace: begin"):
+            inside = True
+            records = []
+            for field in line.split()[2:]:
+                key, _, value = field.partition("=")
+                if key == "tsc_hz":
+                    tsc_hz = int(value)
+            continue
+        if line.startswith("trace: end"):
+            inside = False
+            continue
+        if not inside or line.startswith("trace:") or len(line) != 2 * RECORD.size:
+            continue
+        try:
+            records.append(RECORD.unpack(bytes.fromhex(line)))
+        except ValueError:
+            continue
+
+    return tsc_hz, records
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("log", nargs="?", help="serial log (default: stdin)")
+    ap.add_argument("--event", action="append", help="only show these events (by name)")
+    args = ap.parse_args()
+
+    with (open(args.log, errors="replace") if args.log else sys.stdin) as f:
+        tsc_hz, records = parse(f)
+
+    if not records:
+        sys.exit("no trace records found")
+
+    records.sort(key=lambda r: r[0])
+    base = records[0][0]
+    last = {}
+
+    def us(cycles):
+        return cycles * 1e6 / tsc_hz if tsc_hz else float(cycles)
+
+    unit = "us" if tsc_hz else "cycles"
+    print(f"{'time ' + unit:>14} {'delta':>10} cpu  event       details")
+
+    counts = {}
+    for tsc, arg0, arg1, event, cpu, _seq in records:
+        name, fmt = EVENTS.get(event, (f"event{event}", lambda a0, a1: f"arg0=0x{a0:x} arg1=0x{a1:x}"))
+        counts[name] = counts.get(name, 0) + 1
+        if args.event and name not in args.event:
+            continue
+        # delta to the previous record of the same event on the same CPU
+        prev = last.get((cpu, event))
+        delta = f"{us(tsc - prev):10.1f}" if prev is not None else f"{'':>10}"
+        last[(cpu, event)] = tsc
+        print(f"{us(tsc - base):14.1f} {delta} {cpu:3}  {name:<11} {fmt(arg0, arg1)}")
+
+    span = us(records[-1][0] - base)
+    summary = ", ".join(f"{n} {c}" for n, c in sorted(counts.items()))
+    print(f"\n{len(records)} records over {span:.1f} {unit}: {summary}")
+
+
+if __name__ == "__main__":
+    main()